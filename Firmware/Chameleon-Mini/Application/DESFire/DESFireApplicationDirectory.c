@@ -35,6 +35,7 @@ This notice must be retained at the top of all source files where indicated.
 #include "DESFireMemoryOperations.h"
 #include "DESFireUtils.h"
 #include "DESFireLogging.h"
+#include "../../Memory.h"
 
 /*
  * Global card structure support routines
@@ -512,6 +513,9 @@ void SelectAppBySlot(uint8_t AppSlot) {
     WriteBlockBytes(&SelectedApp, prevAppCacheSelectedBlockId, sizeof(SelectedAppCacheType));
     ReadBlockBytes(&SelectedApp, appCacheSelectedBlockId, sizeof(SelectedAppCacheType));
     SelectedApp.Slot = AppSlot;
+    /* GetAppProperty() reads the data of the selected app on most commands */
+    MemoryCacheUnpin(prevAppCacheSelectedBlockId * DESFIRE_EEPROM_BLOCK_SIZE, sizeof(SelectedAppCacheType));
+    MemoryCachePin(appCacheSelectedBlockId * DESFIRE_EEPROM_BLOCK_SIZE, sizeof(SelectedAppCacheType));
     SynchronizeAppDir();
 }
 
@@ -6,6 +6,7 @@
  */
 
 #include "ISO14443-3A.h"
+#include "../Memory.h"
 
 #define CRC_INIT		0x6363
 #define CRC_INIT_R		0xC6C6 /* Bit reversed */
@@ -118,6 +119,73 @@ void ISO14443AAppendCRCA(void *Buffer, uint16_t ByteCount) {
 }
 #endif
 
+/* Read a block from memory and append CRCA. The checksum is calculated on the
+ * fly over the bytes that have already been received, while the remaining
+ * ones are still being transferred from FRAM by DMA. */
+#ifdef USE_HW_CRC
+void ISO14443AReadBlockAppendCRCA(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    uint8_t *DataPtr = (uint8_t *) Buffer;
+    uint16_t Processed = 0;
+
+    MemoryReadBlockAsync(Buffer, Address, ByteCount, NULL);
+
+    CRC.CTRL = CRC_RESET0_bm;
+    CRC.CHECKSUM1 = (CRC_INIT_R >> 8) & 0xFF;
+    CRC.CHECKSUM0 = (CRC_INIT_R >> 0) & 0xFF;
+    CRC.CTRL = CRC_SOURCE_IO_gc;
+
+    while (Processed < ByteCount) {
+        uint16_t Available = MemoryReadAvailable();
+
+        /* Never trust the count beyond the caller's buffer */
+        Available = MIN(Available, ByteCount);
+
+        while (Processed < Available) {
+            uint8_t Byte = *DataPtr++;
+            Byte = BitReverseByte(Byte);
+
+            CRC.DATAIN = Byte;
+            Processed++;
+        }
+    }
+
+    while (MemoryReadPending())
+        ;
+
+    DataPtr[0] = BitReverseByte(CRC.CHECKSUM1);
+    DataPtr[1] = BitReverseByte(CRC.CHECKSUM0);
+
+    CRC.CTRL = CRC_SOURCE_DISABLE_gc;
+}
+#else
+void ISO14443AReadBlockAppendCRCA(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    uint16_t Checksum = CRC_INIT;
+    uint8_t *DataPtr = (uint8_t *) Buffer;
+    uint16_t Processed = 0;
+
+    MemoryReadBlockAsync(Buffer, Address, ByteCount, NULL);
+
+    while (Processed < ByteCount) {
+        uint16_t Available = MemoryReadAvailable();
+
+        /* Never trust the count beyond the caller's buffer */
+        Available = MIN(Available, ByteCount);
+
+        while (Processed < Available) {
+            uint8_t Byte = *DataPtr++;
+            Checksum = _crc_ccitt_update(Checksum, Byte);
+            Processed++;
+        }
+    }
+
+    while (MemoryReadPending())
+        ;
+
+    DataPtr[0] = (Checksum >> 0) & 0x00FF;
+    DataPtr[1] = (Checksum >> 8) & 0x00FF;
+}
+#endif
+
 #ifdef USE_HW_CRC
 bool ISO14443ACheckCRCA(const void *Buffer, uint16_t ByteCount) {
     const uint8_t *DataPtr = (const uint8_t *) Buffer;
@@ -288,6 +288,7 @@ static uint8_t AccessAddress;
 static uint16_t CardATQAValue;
 static uint8_t CardSAKValue;
 static bool FromHalt = false;
+static uint16_t PinnedTrailerAddress = 0xFFFF;
 
 #define BYTE_SWAP(x) (((uint8_t)(x)>>4)|((uint8_t)(x)<<4))
 #define NO_ACCESS 0x07
@@ -380,6 +381,17 @@ INLINE void ValueToBlock(uint8_t *Block, uint32_t Value) {
     Block[11] = Block[3];
 }
 
+/* Keys and access conditions of the authenticated sector are needed for every
+ * following command, so keep its trailer in the memory cache */
+static void PinSectorTrailer(uint16_t TrailerAddress) {
+    if (TrailerAddress != PinnedTrailerAddress) {
+        MemoryCacheUnpin(PinnedTrailerAddress, MEM_BYTES_PER_BLOCK);
+        PinnedTrailerAddress = TrailerAddress;
+    }
+
+    MemoryCachePin(TrailerAddress, MEM_BYTES_PER_BLOCK);
+}
+
 void MifareClassicAppInitMini4B(void) {
     State = STATE_IDLE;
     CardATQAValue = MFCLASSIC_MINI_4B_ATQA_VALUE;
@@ -469,8 +481,7 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
             } else if (Buffer[0] == CMD_READ) {
                 if (ISO14443ACheckCRCA(Buffer, CMD_READ_FRAME_SIZE)) {
                     /* Read command. Read data from memory and append CRCA. */
-                    MemoryReadBlock(Buffer, (uint16_t)Buffer[1] * MEM_BYTES_PER_BLOCK, MEM_BYTES_PER_BLOCK);
-                    ISO14443AAppendCRCA(Buffer, MEM_BYTES_PER_BLOCK);
+                    ISO14443AReadBlockAppendCRCA(Buffer, (uint16_t)Buffer[1] * MEM_BYTES_PER_BLOCK, MEM_BYTES_PER_BLOCK);
 
                     return (CMD_READ_RESPONSE_FRAME_SIZE + ISO14443A_CRCA_SIZE)
                            * BITS_PER_BYTE;
@@ -625,6 +636,7 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                     /* set KeyInUse for global use to keep info about authentication */
                     KeyInUse = Buffer[0] & 1;
                     CurrentAddress = SectorStartAddress / MEM_BYTES_PER_BLOCK;
+                    PinSectorTrailer(SectorStartAddress + (AccessOffset & ~(MEM_BYTES_PER_BLOCK - 1)));
                     //if (!AccessConditions[MEM_ACC_GPB_SIZE-1] ||(CurrentAddress != AccessAddress)) {
                     /* Get access conditions from the sector trailor */
                     MemoryReadBlock(AccessConditions, SectorStartAddress + AccessOffset, MEM_ACC_GPB_SIZE);
@@ -632,13 +644,15 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                     //}
 
 
-                    /* Generate a random nonce and read UID and key from memory */
-                    RandomGetBuffer(CardNonce, sizeof(CardNonce));
+                    /* Read UID and key from memory. The key arrives in the background
+                     * while the random nonce and the responses are being generated. */
                     if (ActiveConfiguration.UidSize == 7)
                         MemoryReadBlock(Uid, MEM_UID_CL2_ADDRESS, MEM_UID_CL2_SIZE);
                     else
                         MemoryReadBlock(Uid, MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE);
-                    MemoryReadBlock(Key, SectorStartAddress + KeyOffset, MEM_KEY_SIZE);
+                    MemoryReadBlockAsync(Key, SectorStartAddress + KeyOffset, MEM_KEY_SIZE, NULL);
+
+                    RandomGetBuffer(CardNonce, sizeof(CardNonce));
 
                     /* Precalculate the reader response from card-nonce */
                     for (uint8_t i = 0; i < sizeof(ReaderResponse); i++)
@@ -662,7 +676,10 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                     Buffer[2] = CardNonce[2];
                     Buffer[3] = CardNonce[3];
 
-                    /* Setup crypto1 cipher. Discard in-place encrypted CardNonce. */
+                    /* Wait for the key and setup crypto1 cipher. Discard in-place encrypted CardNonce. */
+                    while (MemoryReadPending())
+                        ;
+
                     Crypto1Setup(Key, Uid, CardNonce);
 
                     return CMD_AUTH_RB_FRAME_SIZE * BITS_PER_BYTE;
@@ -793,10 +810,10 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                                             (uint16_t)(CurrentAddress | 3) * MEM_BYTES_PER_BLOCK + MEM_BYTES_PER_BLOCK - MEM_KEY_SIZE,
                                             MEM_KEY_SIZE);
                         }
+                        ISO14443AAppendCRCA(Buffer, MEM_BYTES_PER_BLOCK);
                     } else {
-                        MemoryReadBlock(Buffer, (uint16_t) Buffer[1] * MEM_BYTES_PER_BLOCK, MEM_BYTES_PER_BLOCK);
+                        ISO14443AReadBlockAppendCRCA(Buffer, (uint16_t) Buffer[1] * MEM_BYTES_PER_BLOCK, MEM_BYTES_PER_BLOCK);
                     }
-                    ISO14443AAppendCRCA(Buffer, MEM_BYTES_PER_BLOCK);
 
                     LogEntry(LOG_INFO_APP_CMD_READ, Buffer, MEM_BYTES_PER_BLOCK + ISO14443A_CRCA_SIZE);
 
@@ -896,19 +913,22 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                     /* set KeyInUse for global use to keep info about authentication */
                     KeyInUse = Buffer[0] & 1;
                     CurrentAddress = SectorStartAddress / MEM_BYTES_PER_BLOCK;
+                    PinSectorTrailer(SectorStartAddress + (AccOffset & ~(MEM_BYTES_PER_BLOCK - 1)));
                     if (CurrentAddress != AccessAddress) {
                         /* Get access conditions from the sector trailor */
                         MemoryReadBlock(AccessConditions, SectorStartAddress + AccOffset, MEM_ACC_GPB_SIZE);
                         AccessAddress = CurrentAddress;
                     }
 
-                    /* Generate a random nonce and read UID and key from memory */
-                    RandomGetBuffer(CardNonce, sizeof(CardNonce));
+                    /* Read UID and key from memory. The key arrives in the background
+                     * while the random nonce and the responses are being generated. */
                     if (ActiveConfiguration.UidSize == 7)
                         MemoryReadBlock(Uid, MEM_UID_CL2_ADDRESS, MEM_UID_CL2_SIZE);
                     else
                         MemoryReadBlock(Uid, MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE);
-                    MemoryReadBlock(Key, SectorStartAddress + KeyOffset, MEM_KEY_SIZE);
+                    MemoryReadBlockAsync(Key, SectorStartAddress + KeyOffset, MEM_KEY_SIZE, NULL);
+
+                    RandomGetBuffer(CardNonce, sizeof(CardNonce));
 
                     /* Precalculate the reader response from card-nonce */
                     for (uint8_t i = 0; i < sizeof(ReaderResponse); i++)
@@ -922,7 +942,10 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
 
                     Crypto1PRNG(CardResponse, 32);
 
-                    /* Setup crypto1 cipher. */
+                    /* Wait for the key and setup crypto1 cipher. */
+                    while (MemoryReadPending())
+                        ;
+
                     Crypto1SetupNested(Key, Uid, CardNonce, false);
 
                     /* Respond with the encrypted random card nonce and expect further authentication
@@ -1060,8 +1083,12 @@ uint16_t MifareClassicAppProcess(uint8_t *Buffer, uint16_t BitCount) {
 void MifareClassicGetUid(ConfigurationUidType Uid) {
     if (ActiveConfiguration.UidSize == 7) {
         //Uid[0]=0x88;
-        MemoryReadBlock(&Uid[0], MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE - 1);
-        MemoryReadBlock(&Uid[3], MEM_UID_CL2_ADDRESS, MEM_UID_CL2_SIZE);
+        MemoryIoVec Vec[] = {
+            { &Uid[0], MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE - 1 },
+            { &Uid[3], MEM_UID_CL2_ADDRESS, MEM_UID_CL2_SIZE }
+        };
+
+        MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
     } else
         MemoryReadBlock(Uid, MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE);
 }
@@ -1073,8 +1100,12 @@ void MifareClassicSetUid(ConfigurationUidType Uid) {
     } else {
         uint8_t BCC =  Uid[0] ^ Uid[1] ^ Uid[2] ^ Uid[3];
 
-        MemoryWriteBlock(Uid, MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE);
-        MemoryWriteBlock(&BCC, MEM_UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE);
+        MemoryIoVec Vec[] = {
+            { Uid, MEM_UID_CL1_ADDRESS, MEM_UID_CL1_SIZE },
+            { &BCC, MEM_UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE }
+        };
+
+        MemoryWriteBlockV(Vec, ARRAY_COUNT(Vec));
     }
 }
 
@@ -171,8 +171,12 @@ void MifareUltralightCAppInit(void) {
 
     PageCount = MIFARE_ULTRALIGHTC_PAGES;
 
-    MemoryReadBlock(&FirstAuthenticatedPage, AuthentificationAddress, 1);
-    MemoryReadBlock(&Access, ReadAccessAddress, 1);
+    MemoryIoVec Vec[] = {
+        { &FirstAuthenticatedPage, AuthentificationAddress, 1 },
+        { &Access, ReadAccessAddress, 1 }
+    };
+
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
     ReadAccessProtected = (Access == 0x00);
     State = STATE_IDLE;
     FromHalt = false;
@@ -195,11 +199,15 @@ static void AppInitEV1Common(void) {
     uint8_t ConfigAreaAddress = PageCount * MIFARE_ULTRALIGHT_PAGE_SIZE - CONFIG_AREA_SIZE;
     uint8_t Access;
 
+    MemoryIoVec Vec[] = {
+        { &FirstAuthenticatedPage, ConfigAreaAddress + CONF_AUTH0_OFFSET, 1 },
+        { &Access, ConfigAreaAddress + CONF_ACCESS_OFFSET, 1 }
+    };
+
     /* Set up the emulation flavor */
     Flavor = UL_EV1;
     /* Fetch some of the configuration into RAM */
-    MemoryReadBlock(&FirstAuthenticatedPage, ConfigAreaAddress + CONF_AUTH0_OFFSET, 1);
-    MemoryReadBlock(&Access, ConfigAreaAddress + CONF_ACCESS_OFFSET, 1);
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
     ReadAccessProtected = !!(Access & CONF_ACCESS_PROT);
     AppInitCommon();
 }
@@ -320,6 +328,11 @@ static uint16_t AppProcess(uint8_t *const Buffer, uint16_t ByteCount) {
                 Buffer[0] = NAK_INVALID_ARG;
                 return NAK_FRAME_SIZE;
             }
+            if (PageAddress + BYTES_PER_READ / MIFARE_ULTRALIGHT_PAGE_SIZE <= PageLimit) {
+                /* No wraparound, read in one go */
+                ISO14443AReadBlockAppendCRCA(Buffer, PageAddress * MIFARE_ULTRALIGHT_PAGE_SIZE, BYTES_PER_READ);
+                return (BYTES_PER_READ + ISO14443A_CRCA_SIZE) * 8;
+            }
             /* Read out, emulating the wraparound */
             for (Offset = 0; Offset < BYTES_PER_READ; Offset += 4) {
                 MemoryReadBlock(&Buffer[Offset], PageAddress * MIFARE_ULTRALIGHT_PAGE_SIZE, MIFARE_ULTRALIGHT_PAGE_SIZE);
@@ -445,8 +458,7 @@ static uint16_t AppProcess(uint8_t *const Buffer, uint16_t ByteCount) {
                 }
                 /* NOTE: With the current implementation, reading the password out is possible. */
                 ByteCount = (EndPageAddress - StartPageAddress + 1) * MIFARE_ULTRALIGHT_PAGE_SIZE;
-                MemoryReadBlock(Buffer, StartPageAddress * MIFARE_ULTRALIGHT_PAGE_SIZE, ByteCount);
-                ISO14443AAppendCRCA(Buffer, ByteCount);
+                ISO14443AReadBlockAppendCRCA(Buffer, StartPageAddress * MIFARE_ULTRALIGHT_PAGE_SIZE, ByteCount);
                 return (ByteCount + ISO14443A_CRCA_SIZE) * 8;
             }
 
@@ -660,8 +672,12 @@ uint16_t MifareUltralightAppProcess(uint8_t *Buffer, uint16_t BitCount) {
 
 void MifareUltralightGetUid(ConfigurationUidType Uid) {
     /* Read UID from memory */
-    MemoryReadBlock(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
-    MemoryReadBlock(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
+    MemoryIoVec Vec[] = {
+        { &Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE },
+        { &Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE }
+    };
+
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
 }
 
 void MifareUltralightSetUid(ConfigurationUidType Uid) {
@@ -669,10 +685,15 @@ void MifareUltralightSetUid(ConfigurationUidType Uid) {
     uint8_t BCC1 = ISO14443A_UID0_CT ^ Uid[0] ^ Uid[1] ^ Uid[2];
     uint8_t BCC2 = Uid[3] ^ Uid[4] ^ Uid[5] ^ Uid[6];
 
-    MemoryWriteBlock(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
-    MemoryWriteBlock(&BCC1, UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE);
-    MemoryWriteBlock(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
-    MemoryWriteBlock(&BCC2, UID_BCC2_ADDRESS, ISO14443A_CL_BCC_SIZE);
+    MemoryIoVec Vec[] = {
+        { &Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE },
+        { &BCC1, UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE },
+        { &Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE },
+        { &BCC2, UID_BCC2_ADDRESS, ISO14443A_CL_BCC_SIZE }
+    };
+
+    /* The ranges are adjacent and written in one go */
+    MemoryWriteBlockV(Vec, ARRAY_COUNT(Vec));
 }
 
 #endif /* CONFIG_MF_ULTRALIGHT_SUPPORT */
@@ -106,8 +106,12 @@ void NTAG215AppInit(void) {
     PageCount = NTAG215_PAGES;
 
     /* Fetch some of the configuration into RAM */
-    MemoryReadBlock(&FirstAuthenticatedPage, CONFIG_AREA_START_ADDRESS + CONF_AUTH0_OFFSET, 1);
-    MemoryReadBlock(&Access, CONFIG_AREA_START_ADDRESS + CONF_ACCESS_OFFSET, 1);
+    MemoryIoVec Vec[] = {
+        { &FirstAuthenticatedPage, CONFIG_AREA_START_ADDRESS + CONF_AUTH0_OFFSET, 1 },
+        { &Access, CONFIG_AREA_START_ADDRESS + CONF_ACCESS_OFFSET, 1 }
+    };
+
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
     ReadAccessProtected = !!(Access & CONF_ACCESS_PROT);
 }
 
@@ -188,6 +192,11 @@ static uint16_t AppProcess(uint8_t *const Buffer, uint16_t ByteCount) {
                 Buffer[0] = NAK_INVALID_ARG;
                 return NAK_FRAME_SIZE;
             }
+            if (PageAddress + BYTES_PER_READ / NTAG215_PAGE_SIZE <= PageLimit) {
+                /* No wraparound, read in one go */
+                ISO14443AReadBlockAppendCRCA(Buffer, PageAddress * NTAG215_PAGE_SIZE, BYTES_PER_READ);
+                return (BYTES_PER_READ + ISO14443A_CRCA_SIZE) * 8;
+            }
             /* Read out, emulating the wraparound */
             for (Offset = 0; Offset < BYTES_PER_READ; Offset += 4) {
                 MemoryReadBlock(&Buffer[Offset], PageAddress * NTAG215_PAGE_SIZE, NTAG215_PAGE_SIZE);
@@ -218,8 +227,7 @@ static uint16_t AppProcess(uint8_t *const Buffer, uint16_t ByteCount) {
             }
 
             ByteCount = (EndPageAddress - StartPageAddress + 1) * NTAG215_PAGE_SIZE;
-            MemoryReadBlock(Buffer, StartPageAddress * NTAG215_PAGE_SIZE, ByteCount);
-            ISO14443AAppendCRCA(Buffer, ByteCount);
+            ISO14443AReadBlockAppendCRCA(Buffer, StartPageAddress * NTAG215_PAGE_SIZE, ByteCount);
             return (ByteCount + ISO14443A_CRCA_SIZE) * 8;
         }
 
@@ -414,8 +422,12 @@ uint16_t NTAG215AppProcess(uint8_t *Buffer, uint16_t BitCount) {
 //HELPER FUNCTIONS
 void NTAG215GetUid(ConfigurationUidType Uid) {
     /* Read UID from memory */
-    MemoryReadBlock(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
-    MemoryReadBlock(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
+    MemoryIoVec Vec[] = {
+        { &Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE },
+        { &Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE }
+    };
+
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
 }
 
 void NTAG215SetUid(ConfigurationUidType Uid) {
@@ -423,8 +435,13 @@ void NTAG215SetUid(ConfigurationUidType Uid) {
     uint8_t BCC1 = ISO14443A_UID0_CT ^ Uid[0] ^ Uid[1] ^ Uid[2];
     uint8_t BCC2 = Uid[3] ^ Uid[4] ^ Uid[5] ^ Uid[6];
 
-    MemoryWriteBlock(&Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE);
-    MemoryWriteBlock(&BCC1, UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE);
-    MemoryWriteBlock(&Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE);
-    MemoryWriteBlock(&BCC2, UID_BCC2_ADDRESS, ISO14443A_CL_BCC_SIZE);
+    MemoryIoVec Vec[] = {
+        { &Uid[0], UID_CL1_ADDRESS, UID_CL1_SIZE },
+        { &BCC1, UID_BCC1_ADDRESS, ISO14443A_CL_BCC_SIZE },
+        { &Uid[UID_CL1_SIZE], UID_CL2_ADDRESS, UID_CL2_SIZE },
+        { &BCC2, UID_BCC2_ADDRESS, ISO14443A_CL_BCC_SIZE }
+    };
+
+    /* The ranges are adjacent and written in one go */
+    MemoryWriteBlockV(Vec, ARRAY_COUNT(Vec));
 }
@@ -484,6 +484,28 @@ static bool Identify(uint8_t *Buffer, uint16_t *BitCount) {
     return false;
 }
 
+/* Answer of SEND and SEND_RAW to a binary frame: bit count (16 bit), data and,
+ * unless Parity is negative, the result of the parity check */
+static void SendBinaryAnswer(const uint8_t *Buffer, uint16_t BitCount, int8_t Parity) {
+    uint8_t tmpBuf[128];
+    uint16_t ByteCount = (BitCount + 7) / 8;
+    uint16_t AnswerCount = 2 + ByteCount + ((Parity >= 0) ? 1 : 0);
+
+    if (AnswerCount > sizeof(tmpBuf)) {
+        CommandLinePendingTaskFinished(COMMAND_INFO_OK_WITH_TEXT_ID, "Too many data.");
+        return;
+    }
+
+    tmpBuf[0] = (BitCount >> 8) & 0xFF;
+    tmpBuf[1] = BitCount & 0xFF;
+    memcpy(&tmpBuf[2], Buffer, ByteCount);
+
+    if (Parity >= 0)
+        tmpBuf[2 + ByteCount] = Parity;
+
+    CommandLinePendingTaskFinishedData(COMMAND_INFO_OK_WITH_TEXT_ID, tmpBuf, AnswerCount);
+}
+
 uint16_t Reader14443AAppProcess(uint8_t *Buffer, uint16_t BitCount) {
     switch (Reader14443CurrentCommand) {
         case Reader14443_Send: {
@@ -503,6 +525,12 @@ uint16_t Reader14443AAppProcess(uint8_t *Buffer, uint16_t BitCount) {
             char tmpBuf[128];
             bool parity = checkParityBits(Buffer, BitCount);
             BitCount = removeParityBits(Buffer, BitCount);
+            if (CommandLinePendingTaskBinary()) {
+                /* Binary frame: bit count, data, parity check result */
+                Reader14443CurrentCommand = Reader14443_Do_Nothing;
+                SendBinaryAnswer(Buffer, BitCount, parity ? 1 : 0);
+                return 0;
+            }
             if ((2 * (BitCount + 7) / 8 + 2 + 4) > 128) { // 2 = \r\n, 4 = size of bitcount in hex
                 sprintf(tmpBuf, "Too many data.");
                 Reader14443CurrentCommand = Reader14443_Do_Nothing;
@@ -538,6 +566,13 @@ uint16_t Reader14443AAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                 return 0;
             }
 
+            if (CommandLinePendingTaskBinary()) {
+                /* Binary frame: bit count, data */
+                Reader14443CurrentCommand = Reader14443_Do_Nothing;
+                SendBinaryAnswer(Buffer, BitCount, -1);
+                return 0;
+            }
+
             char tmpBuf[128];
             uint16_t charCnt = BufferToHexString(tmpBuf, 128, Buffer, (BitCount + 7) / 8);
             uint8_t count[2] = {(BitCount >> 8) & 0xFF, BitCount & 0xFF};
@@ -741,9 +776,10 @@ uint16_t Reader14443AAppProcess(uint8_t *Buffer, uint16_t BitCount) {
                     } else { // clone
                         Reader14443CurrentCommand = Reader14443_Do_Nothing;
                         CodecReaderFieldStop();
-                        MemoryUploadBlock(&MFUContents, 0, 64);
                         CommandLinePendingTaskFinished(COMMAND_INFO_OK_WITH_TEXT_ID, "Card Cloned to Slot");
+                        /* Set configuration first, such that the slot is large enough for the contents */
                         ConfigurationSetById(CONFIG_MF_ULTRALIGHT);
+                        MemoryUploadBlock(&MFUContents, 0, 64);
                         MemoryStore();
                         SettingsSave();
                     }
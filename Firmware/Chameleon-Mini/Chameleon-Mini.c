@@ -32,6 +32,7 @@ int main(void) {
         ApplicationTask();
         CodecTask();
         LogTask();
+        MemoryTask();
         TerminalTask();
     }
 }
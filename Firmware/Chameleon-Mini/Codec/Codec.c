@@ -8,6 +8,8 @@
 #include "Codec.h"
 #include "../System.h"
 #include "../LEDHook.h"
+#include "../Log.h"
+#include <util/atomic.h>
 
 uint16_t Reader_FWT = ISO14443A_RX_PENDING_TIMEOUT;
 
@@ -35,6 +37,14 @@ void (* volatile isr_func_CODEC_TIMER_LOADMOD_CCA_VECT)(void) = NULL;
 void (* volatile isr_func_CODEC_TIMER_LOADMOD_CCB_VECT)(void) = NULL;
 void (* volatile isr_func_CODEC_TIMER_TIMESTAMPS_CCA_VECT)(void) = NULL;
 
+volatile uint16_t CodecTimestampHigh = 0;
+volatile uint32_t CodecFrameTimestamp = LOG_TIMESTAMP_INVALID;
+static bool CodecTimestampRunning = false;
+
+ISR(CODEC_TIMER_TIMESTAMPS_OVF_VECT) {
+    CodecTimestampHigh++;
+}
+
 // the following three functions prevent sending data directly after turning on the reader field
 void CodecReaderFieldStart(void) { // DO NOT CALL THIS FUNCTION INSIDE APPLICATION!
     if (!CodecGetReaderField() && !ReaderFieldFlags.ToBeRestarted) {
@@ -83,6 +93,43 @@ bool CodecIsReaderToBeRestarted(void) {
     return false;
 }
 
+void CodecTimestampStart(void) {
+    CODEC_TIMER_TIMESTAMPS.CTRLA = TC_CLKSEL_OFF_gc;
+    CODEC_TIMER_TIMESTAMPS.CTRLB = 0;
+    CODEC_TIMER_TIMESTAMPS.CTRLD = TC_EVACT_OFF_gc;
+    CODEC_TIMER_TIMESTAMPS.INTCTRLB = 0;
+    CODEC_TIMER_TIMESTAMPS.PER = 0xFFFF;
+    CODEC_TIMER_TIMESTAMPS.CNT = 0;
+    CODEC_TIMER_TIMESTAMPS.INTFLAGS = TC1_OVFIF_bm;
+    CODEC_TIMER_TIMESTAMPS.INTCTRLA = TC_OVFINTLVL_MED_gc;
+
+    CodecTimestampHigh = 0;
+    CodecFrameTimestamp = LOG_TIMESTAMP_INVALID;
+    CodecTimestampRunning = true;
+
+    CODEC_TIMER_TIMESTAMPS.CTRLA = CODEC_TIMESTAMP_CLKSEL;
+}
+
+void CodecTimestampStop(void) {
+    CodecTimestampRunning = false;
+
+    CODEC_TIMER_TIMESTAMPS.CTRLA = TC_CLKSEL_OFF_gc;
+    CODEC_TIMER_TIMESTAMPS.INTCTRLA = TC_OVFINTLVL_OFF_gc;
+    CODEC_TIMER_TIMESTAMPS.INTFLAGS = TC1_OVFIF_bm;
+}
+
+uint32_t CodecGetTimestamp(void) {
+    uint32_t Timestamp = LOG_TIMESTAMP_INVALID;
+
+    if (CodecTimestampRunning) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            Timestamp = CodecGetTimestampISR();
+        }
+    }
+
+    return Timestamp;
+}
+
 void CodecThresholdSet(uint16_t th) { // threshold has to be saved back to eeprom by the caller, if wanted
     GlobalSettings.ActiveSettingPtr->ReaderThreshold = th;
     DACB.CH0DATA = th;
@@ -299,6 +299,33 @@ void CodecReaderFieldRestart(uint16_t delay);
 #define FIELD_RESTART()	CodecReaderFieldRestart(100)
 bool CodecIsReaderToBeRestarted(void);
 
+/* Free running carrier cycle counter (F_CPU / 2) for high resolution log
+ * timestamps, extended to 32 bit by its overflow interrupt. Only the card
+ * emulation codecs run it, the reader and sniffing codecs need
+ * CODEC_TIMER_TIMESTAMPS for themselves. */
+#define CODEC_TIMESTAMP_CLKSEL		TC_CLKSEL_DIV2_gc
+
+extern volatile uint16_t CodecTimestampHigh;
+/* Latched by the codec ISRs at the end of a received frame */
+extern volatile uint32_t CodecFrameTimestamp;
+
+void CodecTimestampStart(void);
+void CodecTimestampStop(void);
+uint32_t CodecGetTimestamp(void);
+
+/* Interrupts have to be disabled, as they are inside the codec ISRs */
+INLINE uint32_t CodecGetTimestampISR(void) {
+    uint16_t Low = CODEC_TIMER_TIMESTAMPS.CNT;
+    uint16_t High = CodecTimestampHigh;
+
+    if ((CODEC_TIMER_TIMESTAMPS.INTFLAGS & TC1_OVFIF_bm) && (Low < 0x8000)) {
+        /* Overflow happened, but its interrupt did not run yet */
+        High++;
+    }
+
+    return ((uint32_t) High << 16) | Low;
+}
+
 void CodecThresholdSet(uint16_t th);
 uint16_t CodecThresholdIncrement(void);
 void CodecThresholdReset(void);
@@ -135,6 +135,10 @@ ISR(CODEC_TIMER_SAMPLING_CCA_VECT) {
              * an interrupt once it has reached the FDT. */
             CODEC_TIMER_LOADMOD.CTRLD = TC_EVACT_OFF_gc;
 
+            /* The frame ended with the last modulation edge, which is where
+             * the FDT timer started counting carrier cycles */
+            CodecFrameTimestamp = CodecGetTimestampISR() - CODEC_TIMER_LOADMOD.CNT;
+
             if (SampleRegister & 0x08) {
                 CODEC_TIMER_LOADMOD.PER = ISO14443A_FRAME_DELAY_PREV1 - 40; /* compensate for ISR prolog */
             } else {
@@ -388,6 +392,7 @@ void ISO14443ACodecInit(void) {
     isr_func_CODEC_DEMOD_IN_INT0_VECT = &isr_ISO14443_2A_TCD0_CCC_vect;
     isr_func_CODEC_TIMER_LOADMOD_OVF_VECT = &isr_ISO14443_2A_CODEC_TIMER_LOADMOD_OVF_VECT;
     CodecInitCommon();
+    CodecTimestampStart();
     StartDemod();
 }
 
@@ -412,7 +417,7 @@ void ISO14443ACodecDeInit(void) {
     CodecSetSubcarrier(CODEC_SUBCARRIERMOD_OFF, 0);
     CodecSetDemodPower(false);
     CodecSetLoadmodState(false);
-
+    CodecTimestampStop();
 }
 
 void ISO14443ACodecTask(void) {
@@ -424,7 +429,7 @@ void ISO14443ACodecTask(void) {
 
         if (DemodBitCount >= ISO14443A_MIN_BITS_PER_FRAME) {
             // For logging data
-            LogEntry(LOG_INFO_CODEC_RX_DATA, CodecBuffer, (DemodBitCount + 7) / 8);
+            LogEntryTimestamped(LOG_INFO_CODEC_RX_DATA, CodecBuffer, (DemodBitCount + 7) / 8, CodecFrameTimestamp);
             LEDHook(LED_CODEC_RX, LED_PULSE);
 
             /* Call application if we received data */
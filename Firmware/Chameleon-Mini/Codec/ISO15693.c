@@ -120,6 +120,8 @@ ISR_SHARED isr_ISO15693_CODEC_DEMOD_IN_INT0_VECT(void) {
  * when we have 8 bits in SampleRegister and they represent an end of frame.
  */
 INLINE void ISO15693_EOC(void) {
+    CodecFrameTimestamp = CodecGetTimestampISR();
+
     /* Set bitrate required by the reader on SOF for our following response */
     if (CodecBuffer[0] & REQ_DATARATE_HIGH) {
         BitRate1 = 256;
@@ -574,6 +576,7 @@ void ISO15693CodecInit(void) {
     /* Activate Power for demodulator */
     CodecSetDemodPower(true);
 
+    CodecTimestampStart();
     StartISO15693Demod();
 }
 
@@ -616,6 +619,7 @@ void ISO15693CodecDeInit(void) {
     CodecSetSubcarrier(CODEC_SUBCARRIERMOD_OFF, 0);
     CodecSetDemodPower(false);
     CodecSetLoadmodState(false);
+    CodecTimestampStop();
 }
 
 void ISO15693CodecTask(void) {
@@ -627,7 +631,7 @@ void ISO15693CodecTask(void) {
         bool bDualSubcarrier = false;
 
         if (DemodByteCount > 0) {
-            LogEntry(LOG_INFO_CODEC_RX_DATA, CodecBuffer, DemodByteCount);
+            LogEntryTimestamped(LOG_INFO_CODEC_RX_DATA, CodecBuffer, DemodByteCount, CodecFrameTimestamp);
             LEDHook(LED_CODEC_RX, LED_PULSE);
 
             if (CodecBuffer[0] & REQ_SUBCARRIER_DUAL) {
@@ -436,7 +436,7 @@ static const PROGMEM ConfigurationType ConfigurationTable[] = {
         .ApplicationGetUidFunc = MifareDesfireGetUid,
         .ApplicationSetUidFunc = MifareDesfireSetUid,
         .UidSize = ISO14443A_UID_SIZE_DOUBLE,
-        .MemorySize = MIFARE_CLASSIC_4K_MEM_SIZE,
+        .MemorySize = MEMORY_SIZE_PER_SETTING, /* The DESFire file system spans the whole setting */
         .ReadOnly = false
     },
 #endif
@@ -456,12 +456,22 @@ void ConfigurationSetById(ConfigurationEnum Configuration) {
 
     CommandLinePendingTaskBreak(); // break possibly pending task
 
+    /* Reserve flash memory for the card memory of this configuration.
+     * Fall back to no configuration if there is not enough space left. */
+    if (!MemoryAllocateSetting(pgm_read_word(&ConfigurationTable[Configuration].MemorySize))) {
+        Configuration = CONFIG_NONE;
+        MemoryAllocateSetting(0);
+    }
+
     GlobalSettings.ActiveSettingPtr->Configuration = Configuration;
 
     /* Copy struct from PROGMEM to RAM */
     memcpy_P(&ActiveConfiguration,
              &ConfigurationTable[Configuration], sizeof(ConfigurationType));
 
+    /* Pinned regions belong to the previous application */
+    MemoryCacheUnpinAll();
+
     CodecInit();
     ApplicationInit();
 
@@ -487,7 +497,9 @@ bool ConfigurationSetByName(const char *Configuration) {
     if (MapTextToId(ConfigurationMap, ARRAY_COUNT(ConfigurationMap), Configuration, &Id)) {
         ConfigurationSetById(Id);
         LogEntry(LOG_INFO_CONFIG_SET, Configuration, StringLength(Configuration, CONFIGURATION_NAME_LENGTH_MAX - 1));
-        return true;
+
+        /* Configuration could not be set due to insufficient memory */
+        return (GlobalSettings.ActiveSettingPtr->Configuration == Id);
     } else {
         return false;
     }
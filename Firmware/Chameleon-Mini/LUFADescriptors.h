@@ -54,8 +54,8 @@
 /** Size in bytes of the CDC device-to-host notification IN endpoint. */
 #define CDC_NOTIFICATION_EPSIZE        8
 
-/** Size in bytes of the CDC data IN and OUT endpoints. */
-#define CDC_TXRX_EPSIZE                16
+/** Size in bytes of the CDC data IN and OUT endpoints, the largest a full speed bulk endpoint may have. */
+#define CDC_TXRX_EPSIZE                64
 
 /* Type Defines: */
 /** Type define for the device configuration descriptor structure. This must be defined in the
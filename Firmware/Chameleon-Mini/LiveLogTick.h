@@ -1,120 +1,148 @@
-/* LiveLogTick.h : Handle flushing of live logging buffers out through USB
- *                 by an atomic code block with interrupts disabled.
- *                 If there are many logs being generated at once, this will maintain
- *                 consistency in the returned buffers and prevent the contents of
- *                 USB serial data from getting jumbled or concatenated.
+/* LiveLogTick.h : Buffering of live logging entries on their way out through USB.
+ *                 In LIVE mode, LogMem is used as a single-producer/single-consumer
+ *                 byte ring. LogEntry() only enqueues the entry, LogTask() drains
+ *                 the ring to the terminal in contiguous chunks. Entries which do
+ *                 not fit are dropped and counted instead of stalling the caller.
+ *                 Every entry is preceded by a 16 bit sequence number, dropped ones
+ *                 use up theirs, so the host can tell where entries are missing.
  */
 
 #ifndef __LIVE_LOG_TICK_H__
 #define __LIVE_LOG_TICK_H__
 
 #include <inttypes.h>
-#include <stdlib.h>
-#include <avr/interrupt.h>
-#include <avr/io.h>
+#include <string.h>
 #include <util/atomic.h>
 
-#include "LUFADescriptors.h"
-
 #include "Log.h"
 #include "Terminal/Terminal.h"
 
-#define cli_memory() __asm volatile( "cli" ::: "memory" )
-#define sei_memory() __asm volatile( "sei" ::: "memory" )
-
-#ifndef FLUSH_LOGS_ON_SPACE_ERROR
-#define FLUSH_LOGS_ON_SPACE_ERROR       (1)
+#if (LOG_SIZE & (LOG_SIZE - 1)) != 0
+#error "LOG_SIZE has to be a power of two for the live logging ring"
 #endif
-typedef struct LogBlockListNode {
-    uint8_t                  *logBlockDataStart;
-    uint8_t                  logBlockDataSize;
-    struct LogBlockListNode  *nextBlock;
-} LogBlockListNode;
 
-#define LOG_BLOCK_LIST_NODE_SIZE             (sizeof(LogBlockListNode) + 4 - (uint8_t) (sizeof(LogBlockListNode) % 4))
-extern LogBlockListNode *LogBlockListBegin;
-extern LogBlockListNode *LogBlockListEnd;
-extern uint8_t LogBlockListElementCount;
+#define LIVE_LOG_RING_MASK                   (LOG_SIZE - 1)
+
+#define LIVE_LOG_SEQUENCE_SIZE               (2)
+
+extern volatile uint16_t LiveLogHead;    /* Only written by the producer (LogEntry) */
+extern volatile uint16_t LiveLogTail;    /* Only written by the consumer (LogTask) */
+extern volatile uint16_t LiveLogQueued;  /* Entries put into the ring, written with LiveLogHead */
+extern uint16_t LiveLogSequence;         /* Number of the next entry */
+extern uint16_t LiveLogDropped;
+extern uint16_t LiveLogFlushed;          /* Entries handed to the terminal */
+extern uint16_t LiveLogPeak;             /* Highest fill level of the ring in bytes */
 
 #define LIVE_LOGGER_POST_TICKS               (6)
 extern uint8_t LiveLogModePostTickCount;
 
-INLINE bool AtomicAppendLogBlock(LogEntryEnum logCode, uint16_t sysTickTime, const uint8_t *logData, uint8_t logDataSize);
-INLINE void FreeLogBlocks(void);
-INLINE bool AtomicLiveLogTick(void);
-INLINE bool LiveLogTick(void);
-
-INLINE bool
-AtomicAppendLogBlock(LogEntryEnum logCode, uint16_t sysTickTime, const uint8_t *logData, uint8_t logDataSize) {
-    bool status = true;
-    if ((logDataSize + 4 + 3 + LOG_BLOCK_LIST_NODE_SIZE > LogMemLeft) && (LogMemPtr != LogMem)) {
-        if (FLUSH_LOGS_ON_SPACE_ERROR) {
-            LiveLogTick();
-            FreeLogBlocks();
-        }
-        status = false;
-    } else if (logDataSize + 4 + 3 + LOG_BLOCK_LIST_NODE_SIZE <= LogMemLeft) {
-        uint8_t alignOffset = 4 - (uint8_t)(((uint16_t) LogMemPtr) % 4);
-        uint8_t *logBlockStart = LogMemPtr + alignOffset;
-        LogBlockListNode logBlock;
-        LogMemPtr += LOG_BLOCK_LIST_NODE_SIZE + alignOffset;
-        LogMemLeft -= LOG_BLOCK_LIST_NODE_SIZE + alignOffset;
-        logBlock.logBlockDataStart = LogMemPtr;
-        logBlock.logBlockDataSize = logDataSize + 4;
-        logBlock.nextBlock = 0;
-        *(LogMemPtr++) = (uint8_t) logCode;
-        *(LogMemPtr++) = logDataSize;
-        *(LogMemPtr++) = (uint8_t)(sysTickTime >> 8);
-        *(LogMemPtr++) = (uint8_t)(sysTickTime >> 0);
-        memcpy(LogMemPtr, logData, logDataSize);
-        LogMemPtr += logDataSize;
-        LogMemLeft -= logDataSize + 4;
-        memcpy(logBlockStart, &logBlock, sizeof(LogBlockListNode));
-        if (LogBlockListBegin != NULL && LogBlockListEnd != NULL) {
-            LogBlockListEnd->nextBlock = (LogBlockListNode *) logBlockStart;
-            LogBlockListEnd = (LogBlockListNode *) logBlockStart;
-        } else {
-            LogBlockListBegin = LogBlockListEnd = (LogBlockListNode *) logBlockStart;
-        }
-        ++LogBlockListElementCount;
-    } else {
-        status = false;
+#define LIVE_LOG_STATS_TICKS                 (10)
+extern uint8_t LiveLogStatsTickCount;
+extern uint16_t LiveLogStatsSequence;    /* LiveLogSequence at the last LOG_INFO_STATS entry */
+
+/* 16 bit accesses are not atomic on the AVR, the index of the other side
+ * might be updated from an interrupt in between */
+INLINE uint16_t LiveLogLoadIndex(volatile uint16_t *Index) {
+    uint16_t Value;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        Value = *Index;
+    }
+
+    return Value;
+}
+
+INLINE void LiveLogStoreIndex(volatile uint16_t *Index, uint16_t Value) {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *Index = Value;
     }
-    return status;
 }
 
-INLINE void
-FreeLogBlocks(void) {
-    LogMemPtr = &LogMem[0];
-    LogMemLeft = LOG_SIZE;
-    LogBlockListBegin = LogBlockListEnd = NULL;
-    LogBlockListElementCount = 0;
+INLINE void LiveLogReset(void) {
+    LiveLogStoreIndex(&LiveLogHead, 0);
+    LiveLogStoreIndex(&LiveLogTail, 0);
+    LiveLogStoreIndex(&LiveLogQueued, 0);
+    LiveLogSequence = 0;
+    LiveLogDropped = 0;
+    LiveLogFlushed = 0;
+    LiveLogPeak = 0;
+    LiveLogStatsTickCount = 0;
+    LiveLogStatsSequence = 0;
 }
 
-INLINE bool
-AtomicLiveLogTick(void) {
-    return LiveLogTick();
+/* One byte stays free, so that a full ring can be told apart from an empty one */
+INLINE uint16_t LiveLogFree(void) {
+    return LIVE_LOG_RING_MASK - ((LiveLogHead - LiveLogLoadIndex(&LiveLogTail)) & LIVE_LOG_RING_MASK);
 }
 
-INLINE bool
-LiveLogTick(void) {
-    LogBlockListNode logBlockCurrent, *tempBlockPtr = NULL;
-    memcpy(&logBlockCurrent, LogBlockListBegin, sizeof(LogBlockListNode));
-    while (LogBlockListElementCount > 0) {
-        TerminalFlushBuffer();
-        TerminalSendBlock(logBlockCurrent.logBlockDataStart, logBlockCurrent.logBlockDataSize);
-        TerminalFlushBuffer();
-        tempBlockPtr = logBlockCurrent.nextBlock;
-        if (tempBlockPtr != NULL) {
-            memcpy(&logBlockCurrent, tempBlockPtr, sizeof(LogBlockListNode));
-        } else {
-            break;
-        }
-        --LogBlockListElementCount;
+INLINE uint16_t LiveLogPut(uint16_t Head, const void *Data, uint16_t ByteCount) {
+    uint16_t ToEnd = LOG_SIZE - Head;
+
+    if (ByteCount > ToEnd) {
+        memcpy(&LogMem[Head], Data, ToEnd);
+        memcpy(&LogMem[0], (const uint8_t *) Data + ToEnd, ByteCount - ToEnd);
+    } else {
+        memcpy(&LogMem[Head], Data, ByteCount);
+    }
+
+    return (Head + ByteCount) & LIVE_LOG_RING_MASK;
+}
+
+INLINE bool LiveLogAppend(const uint8_t *Header, uint8_t HeaderLength, const void *Data, uint8_t Length) {
+    uint16_t Head = LiveLogHead;
+    uint16_t Free = LiveLogFree();
+
+    if (Free < Length + HeaderLength) {
+        LiveLogDropped++;
+        return false;
     }
-    FreeLogBlocks();
-    LiveLogModePostTickCount = 0;
+
+    Head = LiveLogPut(Head, Header, HeaderLength);
+    Head = LiveLogPut(Head, Data, Length);
+
+    if (LIVE_LOG_RING_MASK - Free + Length + HeaderLength > LiveLogPeak)
+        LiveLogPeak = LIVE_LOG_RING_MASK - Free + Length + HeaderLength;
+
+    /* Publish the entry only once it is complete */
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        LiveLogHead = Head;
+        LiveLogQueued++;
+    }
+
     return true;
 }
 
+INLINE void LiveLogTask(void) {
+    uint16_t Tail = LiveLogTail;
+    uint16_t Head;
+    uint16_t Queued;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        Head = LiveLogHead;
+        Queued = LiveLogQueued;
+    }
+
+    if (Head == Tail)
+        return;
+
+    if (Head < Tail) {
+        /* Wrapped, send the part up to the end of the buffer first */
+        uint16_t ByteCount = LOG_SIZE - Tail;
+
+        Tail = (Tail + TerminalSendBlockPartial(&LogMem[Tail], ByteCount)) & LIVE_LOG_RING_MASK;
+    }
+
+    if (Tail < Head)
+        Tail += TerminalSendBlockPartial(&LogMem[Tail], Head - Tail);
+
+    TerminalFlush();
+
+    /* What the terminal did not take stays queued and is offered again, so
+     * that the ring fills up and further entries are counted in LiveLogDropped */
+    LiveLogStoreIndex(&LiveLogTail, Tail);
+
+    if (Tail == Head)
+        LiveLogFlushed = Queued;
+}
+
 #endif
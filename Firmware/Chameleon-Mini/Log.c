@@ -5,136 +5,1259 @@
 #include "System.h"
 #include "Map.h"
 #include "LEDHook.h"
+#include "Codec/Codec.h"
+#include "LogPack.h"
 
 uint8_t LogMem[LOG_SIZE];
 uint8_t *LogMemPtr;
 uint16_t LogMemLeft;
 
+/* The FRAM log is a circular buffer from LogFRAMHead (oldest entry) to
+ * LogFRAMAddr (end of the newest entry). One byte always stays free, so that
+ * a full buffer can be told apart from an empty one. */
 static uint16_t LogFRAMAddr = FRAM_LOG_START_ADDR;
+static uint16_t LogFRAMHead = FRAM_LOG_START_ADDR;
+static uint16_t LogFRAMReadHead = FRAM_LOG_START_ADDR;
 static uint8_t EEMEM LogFRAMAddrValid = false;
 static bool EnableLogSRAMtoFRAM = false;
 LogFuncType CurrentLogFunc;
+/* Filter of the active setting, no entries at all while logging is off */
+uint16_t LogFilterMask = 0;
+/* Set by LogEntryTimestamped() for the entry being logged */
+uint32_t LogFrameTimestamp = LOG_TIMESTAMP_INVALID;
 
-LogBlockListNode *LogBlockListBegin = NULL;
-LogBlockListNode *LogBlockListEnd = NULL;
-uint8_t LogBlockListElementCount = 0;
+volatile uint16_t LiveLogHead = 0;
+volatile uint16_t LiveLogTail = 0;
+volatile uint16_t LiveLogQueued = 0;
+uint16_t LiveLogSequence = 0;
+uint16_t LiveLogDropped = 0;
+uint16_t LiveLogFlushed = 0;
+uint16_t LiveLogPeak = 0;
 uint8_t LiveLogModePostTickCount = 0;
+uint8_t LiveLogStatsTickCount = 0;
+uint16_t LiveLogStatsSequence = 0;
 
 static const MapEntryType PROGMEM LogModeMap[] = {
     { .Id = LOG_MODE_OFF, 	.Text = "OFF" 		},
     { .Id = LOG_MODE_MEMORY, 	.Text = "MEMORY" 	},
-    { .Id = LOG_MODE_LIVE, 	.Text = "LIVE" 	        }
+    { .Id = LOG_MODE_LIVE, 	.Text = "LIVE" 	        },
+    { .Id = LOG_MODE_RING, 	.Text = "RING" 	        },
+    { .Id = LOG_MODE_TRIGGER, 	.Text = "TRIGGER" 	},
+    { .Id = LOG_MODE_STREAM, 	.Text = "STREAM" 	}
 };
 
+static const MapEntryType PROGMEM LogFormatMap[] = {
+    { .Id = LOG_FORMAT_STANDARD, 	.Text = "STANDARD" 	},
+    { .Id = LOG_FORMAT_COMPACT, 	.Text = "COMPACT" 	},
+    { .Id = LOG_FORMAT_TIMESTAMP, 	.Text = "TIMESTAMP" 	}
+};
+
+/* Compact format. Frequent entries with up to LOG_COMPACT_SHORT_MAX_LENGTH
+ * data bytes get a single header byte with LOG_COMPACT_SHORT_FLAG set, the
+ * index into LogCompactShortEntries in bits 6..5 and the length in bits 4..0.
+ * Other entries start with their type, or with LOG_COMPACT_ESCAPE and the
+ * type for types of 0x80 and above, followed by the length. The header ends
+ * with the time since the previous entry as varint, 7 bits per byte starting
+ * with the least significant ones, bit 7 set if another byte follows. */
+#define LOG_COMPACT_SHORT_FLAG		0x80
+#define LOG_COMPACT_SHORT_MAX_LENGTH	0x1F
+#define LOG_COMPACT_ESCAPE		0x01
+#define LOG_HEADER_MAX_SIZE		8
+
+/* LOG_INFO_LOG_TIME entries */
+#define LOG_TIME_SIZE			4
+#define LOG_TIME_ENTRY_MAX_SIZE		(LOG_HEADER_MAX_SIZE + LOG_TIME_SIZE)
+/* Header and the data of a LOG_INFO_LOG_TIME entry, enough to decode any entry */
+#define LOG_DECODE_SIZE			LOG_TIME_ENTRY_MAX_SIZE
+
+static const uint8_t PROGMEM LogCompactShortEntries[] = {
+    LOG_INFO_CODEC_RX_DATA,
+    LOG_INFO_CODEC_TX_DATA,
+    LOG_INFO_CODEC_SNI_READER_DATA,
+    LOG_INFO_CODEC_SNI_CARD_DATA_W_PARITY
+};
+
+/* Log time in ms. It goes on from the newest entry in FRAM after a reboot, so
+ * that times never decrease along the FRAM log. */
+static uint32_t LogClock = 0;
+static uint16_t LogClockSysTick = 0;
+
+/* Time of an entry and its systick, the base for the time of the next one */
+typedef struct {
+    uint32_t Time;
+    uint16_t SysTick;
+} LogTimeType;
+
+/* Previous entry in the memory log. Without a valid one, e.g. after boot or
+ * LOGCLEAR, the next entry is preceded by a LOG_INFO_LOG_TIME entry. */
+static LogTimeType LogMemLast;
+static bool LogMemLastValid = false;
+/* Systick of the previous entry in the live log */
+static uint16_t LiveLogLastSysTick = 0;
+
+/* Has to be called at least every 65535 ms, which LogTick() does */
+static uint32_t LogGetTime(uint16_t SysTick) {
+    LogClock += (uint16_t)(SysTick - LogClockSysTick);
+    LogClockSysTick = SysTick;
+
+    return LogClock;
+}
+
+INLINE void LogEncodeTime(uint8_t *Data, uint32_t Time) {
+    Data[0] = (uint8_t)(Time >> 24);
+    Data[1] = (uint8_t)(Time >> 16);
+    Data[2] = (uint8_t)(Time >> 8);
+    Data[3] = (uint8_t)(Time >> 0);
+}
+
+INLINE uint32_t LogDecodeTime(const uint8_t *Data) {
+    return ((uint32_t) Data[0] << 24) | ((uint32_t) Data[1] << 16) | ((uint16_t) Data[2] << 8) | Data[3];
+}
+
+static uint8_t LogEncodeHeader(uint8_t *Header, LogEntryEnum Entry, uint8_t Length, uint16_t SysTick, uint16_t LastSysTick) {
+    uint16_t Delta = SysTick - LastSysTick;
+    uint8_t *HeaderPtr = Header;
+
+    if (GlobalSettings.LogFormat != LOG_FORMAT_COMPACT) {
+        /* Write down Entry Id, Data length and Timestamp */
+        *HeaderPtr++ = (uint8_t) Entry;
+        *HeaderPtr++ = (uint8_t) Length;
+        *HeaderPtr++ = (uint8_t)(SysTick >> 8);
+        *HeaderPtr++ = (uint8_t)(SysTick >> 0);
+
+        if (GlobalSettings.LogFormat == LOG_FORMAT_TIMESTAMP) {
+            /* Frame timestamp of the codec, or the time of logging for other entries */
+            uint32_t Timestamp = (LogFrameTimestamp != LOG_TIMESTAMP_INVALID) ? LogFrameTimestamp : CodecGetTimestamp();
+
+            *HeaderPtr++ = (uint8_t)(Timestamp >> 24);
+            *HeaderPtr++ = (uint8_t)(Timestamp >> 16);
+            *HeaderPtr++ = (uint8_t)(Timestamp >> 8);
+            *HeaderPtr++ = (uint8_t)(Timestamp >> 0);
+        }
+
+        return HeaderPtr - Header;
+    }
+
+    if (Length <= LOG_COMPACT_SHORT_MAX_LENGTH) {
+        for (uint8_t i = 0; i < ARRAY_COUNT(LogCompactShortEntries); i++) {
+            if (pgm_read_byte(&LogCompactShortEntries[i]) == Entry) {
+                *HeaderPtr++ = LOG_COMPACT_SHORT_FLAG | (i << 5) | Length;
+                break;
+            }
+        }
+    }
+
+    if (HeaderPtr == Header) {
+        if (Entry & 0x80)
+            *HeaderPtr++ = LOG_COMPACT_ESCAPE;
+
+        *HeaderPtr++ = (uint8_t) Entry;
+        *HeaderPtr++ = Length;
+    }
+
+    do {
+        *HeaderPtr = Delta & 0x7F;
+        Delta >>= 7;
+
+        if (Delta != 0)
+            *HeaderPtr |= 0x80;
+
+        HeaderPtr++;
+    } while (Delta != 0);
+
+    return HeaderPtr - Header;
+}
+
+/* Size of the entry starting with Header, which holds at least LOG_HEADER_MAX_SIZE
+ * bytes. If Time is given, Header holds LOG_DECODE_SIZE bytes and Time is
+ * advanced from the previous entry to this one. A LOG_INFO_LOG_TIME entry sets
+ * it, other entries are less than 65536 ms after the previous one. */
+static uint16_t LogDecodeHeader(const uint8_t *Header, LogTimeType *Time) {
+    uint8_t Entry;
+    uint8_t Size;
+    uint8_t Length;
+    uint8_t Shift = 0;
+    uint16_t Delta = 0;
+
+    if (Header[0] == LOG_EMPTY)
+        return 1;
+
+    if (GlobalSettings.LogFormat != LOG_FORMAT_COMPACT) {
+        Entry = Header[0];
+        Length = Header[1];
+        Size = (GlobalSettings.LogFormat == LOG_FORMAT_TIMESTAMP) ? 8 : 4;
+
+        if (Time != NULL)
+            Delta = (((uint16_t) Header[2] << 8) | Header[3]) - Time->SysTick;
+    } else {
+        if (Header[0] & LOG_COMPACT_SHORT_FLAG) {
+            Entry = pgm_read_byte(&LogCompactShortEntries[(Header[0] >> 5) & 0x03]);
+            Length = Header[0] & LOG_COMPACT_SHORT_MAX_LENGTH;
+            Size = 1;
+        } else if (Header[0] == LOG_COMPACT_ESCAPE) {
+            Entry = Header[1];
+            Length = Header[2];
+            Size = 3;
+        } else {
+            Entry = Header[0];
+            Length = Header[1];
+            Size = 2;
+        }
+
+        while (true) {
+            if (Shift < 16)
+                Delta |= (uint16_t)(Header[Size] & 0x7F) << Shift;
+
+            if ((Size == LOG_HEADER_MAX_SIZE - 1) || !(Header[Size] & 0x80))
+                break;
+
+            Size++;
+            Shift += 7;
+        }
+
+        Size++;
+    }
+
+    if (Time != NULL) {
+        Time->SysTick += Delta;
+
+        if ((Entry == LOG_INFO_LOG_TIME) && (Length == LOG_TIME_SIZE))
+            Time->Time = LogDecodeTime(&Header[Size]);
+        else
+            Time->Time += Delta;
+    }
+
+    return Size + Length;
+}
+
+INLINE uint16_t LogEntrySize(const uint8_t *Header) {
+    return LogDecodeHeader(Header, NULL);
+}
+
+/* Layout version of the FRAM log, kept in LogFRAMAddrValid */
+#ifdef LOG_COMPRESSION
+#define LOG_FRAM_LAYOUT		0x14
+#else
+#define LOG_FRAM_LAYOUT		0x03
+#endif
+
+#ifdef LOG_COMPRESSION
+/* Compressed log. Every store to FRAM becomes a block of whole entries. Its
+ * header holds the block type, the size of the following data, the size of the
+ * entries and their number, 16 bit big endian each, and the log time (32 bit)
+ * and systick (16 bit) of the last entry, big endian as well. LOG_BLOCK_LZ
+ * blocks are encoded by LogPack(), with the systicks as differences in the
+ * STANDARD and TIMESTAMP formats. LOG_BLOCK_STORED blocks hold the entries as
+ * they are. Compressing is left to the main loop, see LogTick(), stores on
+ * the codec path when SRAM is full are LOG_BLOCK_STORED. */
+#define LOG_BLOCK_LZ		0x01
+#define LOG_BLOCK_STORED	0x02
+#define LOG_BLOCK_HEADER_SIZE	13
+#define LOG_BLOCK_OVERHEAD	LOG_BLOCK_HEADER_SIZE
+#define LOG_DOWNLOAD_FLAGS	LOG_FORMAT_COMPRESSED
+#define LOG_DOWNLOAD_SRAM_SIZE	0
+#else
+#define LOG_BLOCK_OVERHEAD	0
+#define LOG_DOWNLOAD_FLAGS	0
+#define LOG_DOWNLOAD_SRAM_SIZE	LOG_SIZE
+#endif
+
+INLINE uint16_t LogFRAMAdvance(uint16_t Address, uint16_t ByteCount) {
+    Address += ByteCount;
+
+    if (Address >= FRAM_LOG_START_ADDR + FRAM_LOG_SIZE)
+        Address -= FRAM_LOG_SIZE;
+
+    return Address;
+}
+
+INLINE uint16_t LogFRAMDistance(uint16_t From, uint16_t To) {
+    return (To >= From) ? To - From : FRAM_LOG_SIZE - (From - To);
+}
+
+INLINE uint16_t LogFRAMUsed(void) {
+    return LogFRAMDistance(LogFRAMHead, LogFRAMAddr);
+}
+
+/* Access ByteCount bytes at Address, splitting the range where it wraps */
+static void LogFRAMSplit(MemoryIoVec *Vec, void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    uint16_t ToEnd = FRAM_LOG_START_ADDR + FRAM_LOG_SIZE - Address;
+
+    Vec[0].Buffer = Buffer;
+    Vec[0].Address = Address;
+    Vec[0].ByteCount = MIN(ByteCount, ToEnd);
+    Vec[1].Buffer = (uint8_t *) Buffer + Vec[0].ByteCount;
+    Vec[1].Address = FRAM_LOG_START_ADDR;
+    Vec[1].ByteCount = ByteCount - Vec[0].ByteCount;
+}
+
+static void LogFRAMRead(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    MemoryIoVec Vec[2];
+
+    LogFRAMSplit(Vec, Buffer, Address, ByteCount);
+    MemoryReadBlockV(Vec, ARRAY_COUNT(Vec));
+}
+
+/* Sparse index of the FRAM log, to download parts of it. Entries are numbered
+ * from the oldest one in FRAM after LOGCLEAR or boot, their time is the log
+ * time. LogTask() indexes new entries a few at a time, so that storing entries
+ * does not read them back on the codec path. The points in LogIndex are LogIndexSpacing or more entries
+ * apart. When it is full, every other point is dropped and the spacing doubles,
+ * so that the points always spread over the whole log. With LOG_COMPRESSION,
+ * the points are at the start of blocks. */
+#define LOG_INDEX_SIZE		16
+
+typedef struct {
+    uint32_t Entry;	/* Number of the entry at Address */
+    LogTimeType Last;	/* Time of the entry before, the base for its time */
+    uint16_t Address;
+} LogIndexPointType;
+
+static LogIndexPointType LogIndex[LOG_INDEX_SIZE];
+static uint8_t LogIndexCount = 0;
+static uint32_t LogIndexSpacing = 1;
+/* The oldest entry in FRAM and the first one not indexed yet */
+static LogIndexPointType LogIndexHead;
+static LogIndexPointType LogIndexTail;
+
+#ifdef LOG_COMPRESSION
+/* Move Point past its block, unless that does not end before End */
+static bool LogIndexStep(LogIndexPointType *Point, uint16_t End) {
+    uint8_t Header[LOG_BLOCK_HEADER_SIZE];
+    uint16_t BlockSize;
+
+    if (Point->Address == End)
+        return false;
+
+    LogFRAMRead(Header, Point->Address, sizeof(Header));
+    BlockSize = LOG_BLOCK_HEADER_SIZE + (((uint16_t) Header[1] << 8) | Header[2]);
+
+    if (BlockSize > LogFRAMDistance(Point->Address, End))
+        return false;
+
+    Point->Entry += ((uint16_t) Header[5] << 8) | Header[6];
+    Point->Last.Time = LogDecodeTime(&Header[7]);
+    Point->Last.SysTick = ((uint16_t) Header[11] << 8) | Header[12];
+    Point->Address = LogFRAMAdvance(Point->Address, BlockSize);
+
+    return true;
+}
+#else
+/* Move Point past its entry, unless that does not end before End */
+static bool LogIndexStep(LogIndexPointType *Point, uint16_t End) {
+    uint8_t Header[LOG_DECODE_SIZE];
+    LogTimeType Last = Point->Last;
+    uint16_t EntrySize;
+
+    if (Point->Address == End)
+        return false;
+
+    LogFRAMRead(Header, Point->Address, sizeof(Header));
+    EntrySize = LogDecodeHeader(Header, &Last);
+
+    if (EntrySize > LogFRAMDistance(Point->Address, End))
+        return false;
+
+    if (Header[0] != LOG_EMPTY)
+        Point->Entry++;
+
+    Point->Last = Last;
+    Point->Address = LogFRAMAdvance(Point->Address, EntrySize);
+
+    return true;
+}
+#endif
+
+static void LogIndexReset(void) {
+    LogIndexHead.Entry = 0;
+    LogIndexHead.Last.Time = 0;
+    LogIndexHead.Last.SysTick = 0;
+    LogIndexHead.Address = LogFRAMHead;
+    LogIndexTail = LogIndexHead;
+    LogIndexCount = 0;
+    LogIndexSpacing = 1;
+}
+
+/* Entries indexed per call of LogTask() */
+#define LOG_INDEX_TASK_STEPS	4
+
+/* Index the entries appended to FRAM since the last call, all of them if
+ * Complete is set, otherwise up to LOG_INDEX_TASK_STEPS */
+static void LogIndexUpdate(bool Complete) {
+    uint8_t Steps = LOG_INDEX_TASK_STEPS;
+
+    while ((Complete || (Steps-- > 0)) && LogIndexStep(&LogIndexTail, LogFRAMAddr)) {
+        if ((LogIndexCount > 0) && (LogIndexTail.Entry - LogIndex[LogIndexCount - 1].Entry < LogIndexSpacing))
+            continue;
+
+        if (LogIndexCount == LOG_INDEX_SIZE) {
+            uint8_t Count = 0;
+
+            for (uint8_t i = 0; i < LogIndexCount; i += 2) {
+                LogIndex[Count++] = LogIndex[i];
+            }
+
+            LogIndexCount = Count;
+            LogIndexSpacing *= 2;
+        }
+
+        LogIndex[LogIndexCount++] = LogIndexTail;
+    }
+}
+
+/* Ring mode: forget the points of the entries before the new head */
+static void LogIndexDropOldest(const LogIndexPointType *Head) {
+    uint8_t Dropped = 0;
+
+    while ((Dropped < LogIndexCount) && (LogIndex[Dropped].Entry < Head->Entry))
+        Dropped++;
+
+    LogIndexCount -= Dropped;
+    memmove(&LogIndex[0], &LogIndex[Dropped], LogIndexCount * sizeof(LogIndex[0]));
+    LogIndexHead = *Head;
+}
+
+/* Position of the entry numbered Entry, or of the block holding it */
+static void LogIndexSeekEntry(LogIndexPointType *Point, uint32_t Entry) {
+    LogIndexPointType Next;
+
+    *Point = LogIndexHead;
+
+    for (uint8_t i = 0; (i < LogIndexCount) && (LogIndex[i].Entry <= Entry); i++) {
+        *Point = LogIndex[i];
+    }
+
+    Next = *Point;
+
+    while (LogIndexStep(&Next, LogIndexTail.Address) && (Next.Entry <= Entry)) {
+        *Point = Next;
+    }
+}
+
+/* Position of the first entry logged at Time or later, or of the block holding it */
+static void LogIndexSeekTime(LogIndexPointType *Point, uint32_t Time) {
+    LogIndexPointType Next;
+
+    *Point = LogIndexHead;
+
+    /* The time of a point is the one of the entry before it */
+    for (uint8_t i = 0; (i < LogIndexCount) && (LogIndex[i].Last.Time < Time); i++) {
+        *Point = LogIndex[i];
+    }
+
+    Next = *Point;
+
+    while (LogIndexStep(&Next, LogIndexTail.Address) && (Next.Last.Time < Time)) {
+        *Point = Next;
+    }
+}
+
+static void LogFRAMWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    MemoryIoVec Vec[2];
+
+    LogFRAMSplit(Vec, (void *) Buffer, Address, ByteCount);
+    MemoryWriteBlockV(Vec, ARRAY_COUNT(Vec));
+}
+
+/* Only make the data part of the log once it has been written */
+static void LogFRAMCommit(uint16_t ByteCount) {
+    LogFRAMAddr = LogFRAMAdvance(LogFRAMAddr, ByteCount);
+    MemoryWriteBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
+}
+
+INLINE uint16_t LogFRAMFree(void) {
+    return FRAM_LOG_SIZE - 1 - LogFRAMUsed();
+}
+
+#ifdef LOG_COMPRESSION
+/* FRAM address of the next bytes from LogPack() */
+static uint16_t LogPackAddress;
+
+static void LogPackWrite(const uint8_t *Data, uint8_t ByteCount) {
+    LogFRAMWrite(Data, LogPackAddress, ByteCount);
+    LogPackAddress = LogFRAMAdvance(LogPackAddress, ByteCount);
+}
+
+static void LogEncodeBlockHeader(uint8_t *Header, uint8_t Type, uint16_t Size, const uint8_t *Data, uint16_t ByteCount) {
+    uint16_t Entries = 0;
+
+    for (uint16_t Offset = 0; Offset < ByteCount; Offset += LogEntrySize(&Data[Offset])) {
+        Entries++;
+    }
+
+    Header[0] = Type;
+    Header[1] = (uint8_t)(Size >> 8);
+    Header[2] = (uint8_t)(Size >> 0);
+    Header[3] = (uint8_t)(ByteCount >> 8);
+    Header[4] = (uint8_t)(ByteCount >> 0);
+    Header[5] = (uint8_t)(Entries >> 8);
+    Header[6] = (uint8_t)(Entries >> 0);
+    LogEncodeTime(&Header[7], LogMemLast.Time);
+    Header[11] = (uint8_t)(LogMemLast.SysTick >> 8);
+    Header[12] = (uint8_t)(LogMemLast.SysTick >> 0);
+}
+
+/* LZ blocks of the STANDARD and TIMESTAMP formats hold the systicks as
+ * differences, the COMPACT format has them already */
+static void LogBlockDeltaSysTicks(uint8_t *Data, uint16_t ByteCount, bool Encode) {
+    if (GlobalSettings.LogFormat != LOG_FORMAT_COMPACT)
+        LogPackDeltaSysTicks(Data, ByteCount, (GlobalSettings.LogFormat == LOG_FORMAT_TIMESTAMP) ? 8 : 4, Encode);
+}
+
+/* Store whole entries to FRAM as one block, compressed if Pack is set and
+ * that is smaller. Data may be modified. */
+static bool LogFRAMStore(uint8_t *Data, uint16_t ByteCount, bool Pack) {
+    uint8_t Header[LOG_BLOCK_HEADER_SIZE];
+    uint16_t DataAddress = LogFRAMAdvance(LogFRAMAddr, LOG_BLOCK_HEADER_SIZE);
+    uint16_t Free = LogFRAMFree();
+    uint16_t Size = 0;
+
+    if (Free <= LOG_BLOCK_HEADER_SIZE)
+        return false;
+
+    Free -= LOG_BLOCK_HEADER_SIZE;
+
+    if (Pack) {
+        LogBlockDeltaSysTicks(Data, ByteCount, true);
+        LogPackAddress = DataAddress;
+        Size = LogPack(Data, ByteCount, MIN(ByteCount - 1, Free), LogPackWrite);
+
+        if (Size == 0)
+            LogBlockDeltaSysTicks(Data, ByteCount, false);
+    }
+
+    if (Size > 0) {
+        LogEncodeBlockHeader(Header, LOG_BLOCK_LZ, Size, Data, ByteCount);
+    } else if (ByteCount <= Free) {
+        LogFRAMWrite(Data, DataAddress, ByteCount);
+        Size = ByteCount;
+        LogEncodeBlockHeader(Header, LOG_BLOCK_STORED, Size, Data, ByteCount);
+    } else {
+        return false;
+    }
+
+    LogFRAMWrite(Header, LogFRAMAddr, sizeof(Header));
+    LogFRAMCommit(sizeof(Header) + Size);
+
+    return true;
+}
+#else
+static void LogFRAMAppend(const void *Buffer, uint16_t ByteCount) {
+    LogFRAMWrite(Buffer, LogFRAMAddr, ByteCount);
+    LogFRAMCommit(ByteCount);
+}
+
+/* Store whole entries to FRAM. Pack only matters with LOG_COMPRESSION. */
+static bool LogFRAMStore(uint8_t *Data, uint16_t ByteCount, bool Pack) {
+    if (ByteCount > LogFRAMFree())
+        return false;
+
+    LogFRAMAppend(Data, ByteCount);
+
+    return true;
+}
+#endif
+
+/* Ring mode: drop whole entries from the old end until ByteCount bytes fit */
+static void LogFRAMDropOldest(uint16_t ByteCount) {
+    LogIndexPointType Head = LogIndexHead;
+
+    while (FRAM_LOG_SIZE - 1 - LogFRAMDistance(Head.Address, LogFRAMAddr) < ByteCount) {
+        if (!LogIndexStep(&Head, LogFRAMAddr)) {
+            /* Only an incomplete entry is left, drop it as well */
+            LogIndexUpdate(true);
+            Head = LogIndexTail;
+            Head.Address = LogFRAMAddr;
+            LogIndexTail = Head;
+            break;
+        }
+    }
+
+    if (Head.Address != LogFRAMHead) {
+        /* Persist the new head before its entries get overwritten */
+        LogFRAMHead = Head.Address;
+        MemoryWriteBlock(&LogFRAMHead, FRAM_LOG_HEAD_ADDR, 2);
+        LogIndexDropOldest(&Head);
+
+        /* Entries not indexed yet may have been dropped as well */
+        if (Head.Entry >= LogIndexTail.Entry)
+            LogIndexTail = Head;
+    }
+}
+
+/* Trigger mode. LogMem is a ring of whole entries from LogTriggerHead (oldest)
+ * to LogTriggerTail. While armed, the oldest entries are dropped to keep the
+ * latest PreCount ones. Once triggered, nothing is dropped anymore and
+ * LogSRAMToFRAM() commits the ring to FRAM. The ring leaves room for a
+ * LOG_INFO_LOG_TIME entry, which the commit puts in front of the entries if
+ * the one their time is based on has been dropped. */
+#define LOG_TRIGGER_RING_MASK	(LOG_SIZE - 1)
+#define LOG_TRIGGER_RING_ROOM	(LOG_TRIGGER_RING_MASK - LOG_TIME_ENTRY_MAX_SIZE)
+
+static LogTriggerStateEnum LogTriggerState = LOG_TRIGGER_ARMED;
+static uint16_t LogTriggerHead = 0;
+static uint16_t LogTriggerTail = 0;
+static uint16_t LogTriggerEntries = 0;
+static uint8_t LogTriggerPostLeft = 0;
+/* Time of the entry before LogTriggerHead, and whether it has been dropped */
+static LogTimeType LogTriggerBase;
+static bool LogTriggerRebase = false;
+
+static const MapEntryType PROGMEM LogTriggerStateMap[] = {
+    { .Id = LOG_TRIGGER_ARMED, 	.Text = "ARMED" 	},
+    { .Id = LOG_TRIGGER_TRIGGERED, 	.Text = "TRIGGERED" 	},
+    { .Id = LOG_TRIGGER_DONE, 	.Text = "DONE" 		}
+};
+
+INLINE uint16_t LogTriggerUsed(void) {
+    return (LogTriggerTail - LogTriggerHead) & LOG_TRIGGER_RING_MASK;
+}
+
+static void LogTriggerReset(void) {
+    LogTriggerHead = 0;
+    LogTriggerTail = 0;
+    LogTriggerEntries = 0;
+    LogTriggerState = LOG_TRIGGER_ARMED;
+    LogTriggerRebase = false;
+
+    /* The entries logged before are discarded, let the next one set the time */
+    LogMemLastValid = false;
+}
+
+static void LogTriggerPut(const void *Data, uint16_t ByteCount) {
+    uint16_t ToEnd = LOG_SIZE - LogTriggerTail;
+
+    if (ByteCount > ToEnd) {
+        memcpy(&LogMem[LogTriggerTail], Data, ToEnd);
+        memcpy(&LogMem[0], (const uint8_t *) Data + ToEnd, ByteCount - ToEnd);
+    } else {
+        memcpy(&LogMem[LogTriggerTail], Data, ByteCount);
+    }
+
+    LogTriggerTail = (LogTriggerTail + ByteCount) & LOG_TRIGGER_RING_MASK;
+}
+
+static void LogTriggerDropOldest(void) {
+    uint8_t Header[LOG_DECODE_SIZE];
+
+    for (uint8_t i = 0; i < sizeof(Header); i++) {
+        Header[i] = LogMem[(LogTriggerHead + i) & LOG_TRIGGER_RING_MASK];
+    }
+
+    LogTriggerHead = (LogTriggerHead + LogDecodeHeader(Header, &LogTriggerBase)) & LOG_TRIGGER_RING_MASK;
+    LogTriggerEntries--;
+    LogTriggerRebase = true;
+}
+
+static void LogMemReverse(uint16_t From, uint16_t To) {
+    while (From + 1 < To) {
+        uint8_t Byte = LogMem[From];
+
+        LogMem[From++] = LogMem[--To];
+        LogMem[To] = Byte;
+    }
+}
+
+/* Rotate the ring in place, so that its entries start at LogMem[0] */
+static void LogTriggerLinearize(void) {
+    if (LogTriggerHead == 0)
+        return;
+
+    LogMemReverse(0, LogTriggerHead);
+    LogMemReverse(LogTriggerHead, LOG_SIZE);
+    LogMemReverse(0, LOG_SIZE);
+
+    LogTriggerTail = LogTriggerUsed();
+    LogTriggerHead = 0;
+}
+
+/* Put a LOG_INFO_LOG_TIME entry with the time of the dropped entry in front of
+ * the linearized ring, as the time of the next one is based on it */
+static uint16_t LogTriggerRebaseEntries(uint16_t Used) {
+    uint8_t Header[LOG_TIME_ENTRY_MAX_SIZE];
+    uint8_t HeaderLength = LogEncodeHeader(Header, LOG_INFO_LOG_TIME, LOG_TIME_SIZE,
+                                           LogTriggerBase.SysTick, LogTriggerBase.SysTick);
+
+    LogEncodeTime(&Header[HeaderLength], LogTriggerBase.Time);
+    HeaderLength += LOG_TIME_SIZE;
+
+    memmove(&LogMem[HeaderLength], &LogMem[0], Used);
+    memcpy(&LogMem[0], Header, HeaderLength);
+
+    return Used + HeaderLength;
+}
+
+static void LogTriggerCommit(bool Pack) {
+    uint16_t FRAM_Free = LogFRAMFree();
+    uint16_t Used = LogTriggerUsed();
+
+    /* Room for the capture even if it does not compress, and its time */
+    FRAM_Free = (FRAM_Free > LOG_BLOCK_OVERHEAD + LOG_TIME_ENTRY_MAX_SIZE) ?
+                FRAM_Free - LOG_BLOCK_OVERHEAD - LOG_TIME_ENTRY_MAX_SIZE : 0;
+
+    if (Used > FRAM_Free) {
+        /* Keep the trigger and what follows it rather than the oldest entries */
+        while (LogTriggerUsed() > FRAM_Free) {
+            LogTriggerDropOldest();
+        }
+
+        Used = LogTriggerUsed();
+        LogTriggerState = LOG_TRIGGER_DONE;
+        LEDHook(LED_LOG_MEM_FULL, LED_ON);
+    }
+
+    if (Used > 0) {
+        LogTriggerLinearize();
+
+        if (LogTriggerRebase)
+            Used = LogTriggerRebaseEntries(Used);
+
+        LogFRAMStore(LogMem, Used, Pack);
+
+        /* The next entries follow the ones just stored */
+        LogTriggerBase = LogMemLast;
+        LogTriggerRebase = false;
+    }
+
+    LogTriggerHead = LogTriggerTail;
+    LogTriggerEntries = 0;
+}
+
+/* Stream mode. LogMem is split into two chunks. Entries are added to one of
+ * them, while the other one is written to FRAM by DMA, so that storing never
+ * holds up the codec and nothing is lost as long as the FRAM has room. With
+ * LOG_COMPRESSION, every chunk starts with room for its block header and is
+ * stored as is. LogMemPtr and LogMemLeft refer to the chunk taking entries. */
+#define LOG_STREAM_CHUNK_SIZE	(LOG_SIZE / 2)
+
+static uint8_t *LogStreamChunk = LogMem;
+
+/* Write of the other chunk in progress, in two parts where it wraps */
+static struct {
+    const uint8_t *Data;
+    uint16_t Address;
+    uint16_t Left;	/* Bytes not yet handed to the DMA */
+    uint16_t Size;	/* Bytes to commit once written, 0 if idle */
+} LogStreamWrite;
+
+static void LogStreamReset(void) {
+    LogStreamChunk = LogMem;
+    LogMemPtr = LogMem + LOG_BLOCK_OVERHEAD;
+    LogMemLeft = LOG_STREAM_CHUNK_SIZE - LOG_BLOCK_OVERHEAD;
+}
+
+INLINE uint16_t LogStreamUsed(void) {
+    return LOG_STREAM_CHUNK_SIZE - LogMemLeft;
+}
+
+static void LogStreamWriteNext(void) {
+    uint16_t ToEnd = FRAM_LOG_START_ADDR + FRAM_LOG_SIZE - LogStreamWrite.Address;
+    uint16_t ByteCount = MIN(LogStreamWrite.Left, ToEnd);
+
+    MemoryWriteBlockAsync(LogStreamWrite.Data, LogStreamWrite.Address, ByteCount);
+
+    LogStreamWrite.Data += ByteCount;
+    LogStreamWrite.Address = LogFRAMAdvance(LogStreamWrite.Address, ByteCount);
+    LogStreamWrite.Left -= ByteCount;
+}
+
+/* Continue the write of a chunk, returns true while it is in progress */
+static bool LogStreamPoll(void) {
+    if (LogStreamWrite.Size == 0)
+        return false;
+
+    if (MemoryWritePending())
+        return true;
+
+    if (LogStreamWrite.Left > 0) {
+        LogStreamWriteNext();
+        return true;
+    }
+
+    LogFRAMCommit(LogStreamWrite.Size);
+    LogStreamWrite.Size = 0;
+
+    return false;
+}
+
+static void LogStreamWait(void) {
+    while (LogStreamPoll())
+        ;
+}
+
+/* Start writing the entries of the current chunk and switch to the other one.
+ * Returns false if they do not fit into FRAM anymore. */
+static bool LogStreamStore(void) {
+    uint16_t Size = LogStreamUsed();
+
+    if (Size == LOG_BLOCK_OVERHEAD)
+        return true;
+
+    /* The other chunk becomes free, and the FRAM usage up to date */
+    LogStreamWait();
+
+    if (Size > LogFRAMFree())
+        return false;
+
+#ifdef LOG_COMPRESSION
+    LogEncodeBlockHeader(LogStreamChunk, LOG_BLOCK_STORED, Size - LOG_BLOCK_OVERHEAD,
+                         LogStreamChunk + LOG_BLOCK_OVERHEAD, Size - LOG_BLOCK_OVERHEAD);
+#endif
+
+    LogStreamWrite.Data = LogStreamChunk;
+    LogStreamWrite.Address = LogFRAMAddr;
+    LogStreamWrite.Left = Size;
+    LogStreamWrite.Size = Size;
+    LogStreamWriteNext();
+
+    LogStreamChunk = (LogStreamChunk == LogMem) ? LogMem + LOG_STREAM_CHUNK_SIZE : LogMem;
+    LogMemPtr = LogStreamChunk + LOG_BLOCK_OVERHEAD;
+    LogMemLeft = LOG_STREAM_CHUNK_SIZE - LOG_BLOCK_OVERHEAD;
+
+    return true;
+}
+
+static void LogSRAMStore(bool Pack);
+
 static void LogFuncOff(LogEntryEnum Entry, const void *Data, uint8_t Length) {
     /* Do nothing */
 }
 
+/* Whether an entry at Time needs a LOG_INFO_LOG_TIME entry in front of it */
+INLINE bool LogMemNeedsTime(uint32_t Time) {
+    return !LogMemLastValid || (Time - LogMemLast.Time > 0xFFFF);
+}
+
+static bool LogMemPut(LogEntryEnum Entry, const void *Data, uint8_t Length, uint16_t SysTick, uint32_t Time) {
+    uint8_t Header[LOG_HEADER_MAX_SIZE];
+    uint8_t HeaderLength = LogEncodeHeader(Header, Entry, Length, SysTick, LogMemLast.SysTick);
+
+    if (LogMemLeft < (Length + HeaderLength))
+        return false;
+
+    LogMemLeft -= Length + HeaderLength;
+    LogMemLast.Time = Time;
+    LogMemLast.SysTick = SysTick;
+
+    /* Write down the header */
+    memcpy(LogMemPtr, Header, HeaderLength);
+    LogMemPtr += HeaderLength;
+
+    uint8_t *DataPtr = (uint8_t *) Data;
+
+    /* Write down data bytes */
+    while (Length--) {
+        *LogMemPtr++ = *DataPtr++;
+    }
+
+    return true;
+}
+
 static void LogFuncMemory(LogEntryEnum Entry, const void *Data, uint8_t Length) {
     uint16_t SysTick = SystemGetSysTick();
+    uint32_t Time = LogGetTime(SysTick);
+    bool Stored = true;
 
-    if (LogMemLeft >= (Length + 4)) {
-        LogMemLeft -= Length + 4;
+    if (LogMemNeedsTime(Time)) {
+        uint8_t TimeData[LOG_TIME_SIZE];
 
-        uint8_t *DataPtr = (uint8_t *) Data;
+        LogEncodeTime(TimeData, Time);
+        Stored = LogMemPut(LOG_INFO_LOG_TIME, TimeData, sizeof(TimeData), SysTick, Time);
+        LogMemLastValid = Stored;
+    }
 
-        /* Write down Entry Id, Data length and Timestamp */
-        *LogMemPtr++ = (uint8_t) Entry;
-        *LogMemPtr++ = (uint8_t) Length;
-        *LogMemPtr++ = (uint8_t)(SysTick >> 8);
-        *LogMemPtr++ = (uint8_t)(SysTick >> 0);
-
-        /* Write down data bytes */
-        while (Length--) {
-            *LogMemPtr++ = *DataPtr++;
-        }
-    } else {
+    if (!Stored || !LogMemPut(Entry, Data, Length, SysTick, Time)) {
         /* If memory full. Deactivate logmode */
         LogSetModeById(LOG_MODE_OFF);
         LEDHook(LED_LOG_MEM_FULL, LED_ON);
     }
 }
 
+static void LogFuncRing(LogEntryEnum Entry, const void *Data, uint8_t Length) {
+    if (LogMemLeft < (Length + LOG_HEADER_MAX_SIZE + LOG_TIME_ENTRY_MAX_SIZE)) {
+        /* Do not wait for the next tick, the FRAM ring always takes the SRAM contents */
+        LogSRAMStore(false);
+    }
+
+    LogFuncMemory(Entry, Data, Length);
+}
+
+static void LogFuncStream(LogEntryEnum Entry, const void *Data, uint8_t Length) {
+    if ((LogMemLeft < (Length + LOG_HEADER_MAX_SIZE + LOG_TIME_ENTRY_MAX_SIZE)) && !LogStreamStore()) {
+        LogSetModeById(LOG_MODE_OFF);
+        LEDHook(LED_LOG_MEM_FULL, LED_ON);
+        return;
+    }
+
+    LogFuncMemory(Entry, Data, Length);
+}
+
 static void LogFuncLive(LogEntryEnum Entry, const void *Data, uint8_t Length) {
     uint16_t SysTick = SystemGetSysTick();
-    AtomicAppendLogBlock(Entry, SysTick, Data, Length);
+    uint8_t Header[LIVE_LOG_SEQUENCE_SIZE + LOG_HEADER_MAX_SIZE];
+    uint8_t HeaderLength;
+
+    Header[0] = (uint8_t)(LiveLogSequence >> 8);
+    Header[1] = (uint8_t)(LiveLogSequence >> 0);
+    LiveLogSequence++;
+
+    HeaderLength = LIVE_LOG_SEQUENCE_SIZE +
+                   LogEncodeHeader(&Header[LIVE_LOG_SEQUENCE_SIZE], Entry, Length, SysTick, LiveLogLastSysTick);
+
+    if (LiveLogAppend(Header, HeaderLength, Data, Length))
+        LiveLogLastSysTick = SysTick;
+}
+
+/* Returns false if the capture is done */
+static bool LogTriggerPutEntry(LogEntryEnum Entry, const void *Data, uint8_t Length, uint16_t SysTick, uint32_t Time) {
+    uint8_t Header[LOG_HEADER_MAX_SIZE];
+    uint8_t HeaderLength = LogEncodeHeader(Header, Entry, Length, SysTick, LogMemLast.SysTick);
+
+    while (LOG_TRIGGER_RING_ROOM - LogTriggerUsed() < Length + HeaderLength) {
+        if (LogTriggerState == LOG_TRIGGER_ARMED) {
+            LogTriggerDropOldest();
+        } else {
+            /* Do not wait for the next tick, the capture must not lose entries */
+            LogTriggerCommit(false);
+
+            if (LogTriggerState == LOG_TRIGGER_DONE)
+                return false;
+        }
+    }
+
+    LogTriggerPut(Header, HeaderLength);
+    LogTriggerPut(Data, Length);
+    LogTriggerEntries++;
+    LogMemLast.Time = Time;
+    LogMemLast.SysTick = SysTick;
+
+    return true;
+}
+
+static void LogFuncTrigger(LogEntryEnum Entry, const void *Data, uint8_t Length) {
+    const LogTriggerType *Trigger = &GlobalSettings.LogTrigger;
+
+    if (LogTriggerState == LOG_TRIGGER_DONE)
+        return;
+
+    bool Match = (LogTriggerState == LOG_TRIGGER_ARMED) && (Entry == Trigger->Entry) &&
+                 (!Trigger->MatchCommand || ((Length > 0) && (*(const uint8_t *) Data == Trigger->Command)));
+
+    if ((LogTriggerState == LOG_TRIGGER_ARMED) && !Match) {
+        if (Trigger->PreCount == 0)
+            return;
+
+        while (LogTriggerEntries >= Trigger->PreCount) {
+            LogTriggerDropOldest();
+        }
+    }
+
+    uint16_t SysTick = SystemGetSysTick();
+    uint32_t Time = LogGetTime(SysTick);
+
+    if (LogMemNeedsTime(Time)) {
+        uint8_t TimeData[LOG_TIME_SIZE];
+
+        LogEncodeTime(TimeData, Time);
+
+        if (!LogTriggerPutEntry(LOG_INFO_LOG_TIME, TimeData, sizeof(TimeData), SysTick, Time))
+            return;
+
+        LogMemLastValid = true;
+    }
+
+    if (!LogTriggerPutEntry(Entry, Data, Length, SysTick, Time))
+        return;
+
+    if (Match) {
+        LogTriggerPostLeft = Trigger->PostCount;
+        LogTriggerState = (LogTriggerPostLeft > 0) ? LOG_TRIGGER_TRIGGERED : LOG_TRIGGER_DONE;
+    } else if (LogTriggerState == LOG_TRIGGER_TRIGGERED) {
+        if (--LogTriggerPostLeft == 0)
+            LogTriggerState = LOG_TRIGGER_DONE;
+    }
+}
+
+/* Not subject to the filter, the host needs it to decode the log */
+static void LogFormatEntry(void) {
+    uint8_t Data[] = { LOG_FORMAT_VERSION, GlobalSettings.LogFormat };
+
+    CurrentLogFunc(LOG_INFO_LOG_FORMAT, Data, sizeof(Data));
+}
+
+/* Lets the host check the loss it sees against the device's accounting.
+ * Only sent while entries are produced, so an idle live log stays silent. */
+static void LogStatsEntry(void) {
+    uint16_t Produced = LiveLogSequence;
+    uint16_t Flushed = LiveLogFlushed;
+    uint8_t Data[] = {
+        (uint8_t)(Produced >> 8), (uint8_t)(Produced >> 0),
+        (uint8_t)(LiveLogDropped >> 8), (uint8_t)(LiveLogDropped >> 0),
+        (uint8_t)(Flushed >> 8), (uint8_t)(Flushed >> 0),
+        (uint8_t)(LiveLogPeak >> 8), (uint8_t)(LiveLogPeak >> 0)
+    };
+
+    if (Produced == LiveLogStatsSequence)
+        return;
+
+    CurrentLogFunc(LOG_INFO_STATS, Data, sizeof(Data));
+    LiveLogStatsSequence = LiveLogSequence;
+}
+
+static void LogUpdateFilterMask(void) {
+    LogFilterMask = (CurrentLogFunc == LogFuncOff) ? 0 : GlobalSettings.ActiveSettingPtr->LogFilter;
 }
 
 void LogInit(void) {
-    LogSetModeById(GlobalSettings.ActiveSettingPtr->LogMode);
+    if (GlobalSettings.LogFormat > LOG_FORMAT_TIMESTAMP)
+        GlobalSettings.LogFormat = LOG_FORMAT_STANDARD;
+
     LogMemPtr = LogMem;
     LogMemLeft = sizeof(LogMem);
 
     uint8_t result;
     ReadEEPBlock((uint16_t) &LogFRAMAddrValid, &result, 1);
     memset(LogMemPtr, LOG_EMPTY, LOG_SIZE);
-    if (result) {
+    if (result == LOG_FRAM_LAYOUT) {
         MemoryReadBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
-    } else {
+        MemoryReadBlock(&LogFRAMHead, FRAM_LOG_HEAD_ADDR, 2);
+    }
+
+    if ((result != LOG_FRAM_LAYOUT) ||
+            (LogFRAMAddr < FRAM_LOG_START_ADDR) || (LogFRAMAddr >= FRAM_LOG_START_ADDR + FRAM_LOG_SIZE) ||
+            (LogFRAMHead < FRAM_LOG_START_ADDR) || (LogFRAMHead >= FRAM_LOG_START_ADDR + FRAM_LOG_SIZE)) {
         LogFRAMAddr = FRAM_LOG_START_ADDR;
+        LogFRAMHead = FRAM_LOG_START_ADDR;
         MemoryWriteBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
-        result = true;
+        MemoryWriteBlock(&LogFRAMHead, FRAM_LOG_HEAD_ADDR, 2);
+        result = LOG_FRAM_LAYOUT;
         WriteEEPBlock((uint16_t) &LogFRAMAddrValid, &result, 1);
     }
 
+    LogFRAMReadHead = LogFRAMHead;
+
+    /* Rebuild the index from the entries kept in FRAM */
+    LogIndexReset();
+    LogIndexUpdate(true);
+
+    /* Go on from the newest entry, the first one after boot sets the time */
+    LogClock = LogIndexTail.Last.Time;
+    LogClockSysTick = SystemGetSysTick();
+    LogMemLastValid = false;
+
+    /* After LogMem has been set up, the stream mode splits it */
+    LogSetModeById(GlobalSettings.ActiveSettingPtr->LogMode);
+
     LogEntry(LOG_INFO_SYSTEM_BOOT, NULL, 0);
 }
 
+#ifdef LOG_COMPRESSION
+/* Entries in SRAM that LogSRAMToFRAM() would store */
+static uint16_t LogSRAMUsed(void) {
+    if (CurrentLogFunc == LogFuncTrigger)
+        return (LogTriggerState != LOG_TRIGGER_ARMED) ? LogTriggerUsed() : 0;
+
+    return LOG_SIZE - LogMemLeft;
+}
+#endif
+
 void LogTick(void) {
+    /* Keep the log time going while nothing is logged */
+    LogGetTime(SystemGetSysTick());
+
     // The logging functionality slows down the timings of data exchanges between
     // Chameleon emulated tags and readers, so schedule the logging writes to
     // happen only on intervals that will be outside of timing windows for individual xfers
     // initiated from PICC <--> PCD (e.g., currently approximately every 600ms):
     if ((++LiveLogModePostTickCount % LIVE_LOGGER_POST_TICKS) == 0) {
-        if (GlobalSettings.ActiveSettingPtr->LogMode == LOG_MODE_LIVE)
-            AtomicLiveLogTick();
         if (EnableLogSRAMtoFRAM)
             LogSRAMToFRAM();
+        else if (CurrentLogFunc == LogFuncStream)
+            LogStreamStore(); /* Does not wait for the write */
         LiveLogModePostTickCount = 0;
+#ifdef LOG_COMPRESSION
+    } else if (EnableLogSRAMtoFRAM && (LogSRAMUsed() > LOG_SIZE / 2)) {
+        /* Compress here before the codec path has to store the entries as they are */
+        LogSRAMToFRAM();
+#endif
+    }
+
+    if ((CurrentLogFunc == LogFuncLive) && (++LiveLogStatsTickCount >= LIVE_LOG_STATS_TICKS)) {
+        LogStatsEntry();
+        LiveLogStatsTickCount = 0;
     }
 }
 
 void LogTask(void) {
+    if (CurrentLogFunc == LogFuncLive)
+        LiveLogTask();
+    else if (CurrentLogFunc == LogFuncStream)
+        LogStreamPoll();
 
+    LogIndexUpdate(false);
 }
 
-bool LogMemLoadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
-    if (BlockAddress < sizeof(LogMem) + (LogFRAMAddr - FRAM_LOG_START_ADDR)) {
-        bool overflow = false;
-        uint16_t remainderByteCount = 0;
-        uint16_t SizeInFRAMStored = LogFRAMAddr - FRAM_LOG_START_ADDR;
-        // prevent buffer overflows:
-        if ((BlockAddress + ByteCount) >= sizeof(LogMem) + SizeInFRAMStored) {
-            overflow = true;
-            uint16_t tmp = sizeof(LogMem) + SizeInFRAMStored - BlockAddress;
-            remainderByteCount = ByteCount - tmp;
-            ByteCount = tmp;
-        }
+/* The log is downloaded as a LOG_INFO_LOG_FORMAT entry in the standard format,
+ * followed by the entries in FRAM and SRAM in the active format */
+#define LOG_FORMAT_HEADER_SIZE	6
+
+/* A download of a part of the FRAM log starts with a LOG_INFO_LOG_TIME entry in
+ * the standard format, which holds the time and systick of the entry before
+ * the range, the base for the first one. Its LOG_INFO_LOG_FORMAT entry holds
+ * the number of entries before the requested one as well, 16 bit big endian,
+ * which share its block with LOG_COMPRESSION. */
+#define LOG_RANGE_TIME_SIZE	(4 + LOG_TIME_SIZE)
+#define LOG_RANGE_HEADER_SIZE	(LOG_RANGE_TIME_SIZE + LOG_FORMAT_HEADER_SIZE + 2)
+
+static uint8_t LogRangeHeader[LOG_RANGE_HEADER_SIZE];
+/* Size of a download of a part of the FRAM log starting at LogFRAMReadHead */
+static uint16_t LogRangeSize = 0;
+
+static bool LogLoadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount, const uint8_t *Header, uint8_t HeaderSize,
+                         uint16_t SizeInFRAMStored, uint16_t SizeOfSRAM) {
+    uint8_t *BufferPtr = (uint8_t *) Buffer;
+    uint32_t FRAMEnd = HeaderSize + SizeInFRAMStored;
+    uint32_t SRAMEnd = FRAMEnd + SizeOfSRAM;
+
+    if (BlockAddress >= SRAMEnd)
+        return false;
+
+    while (ByteCount > 0) {
+        uint16_t Chunk;
 
-        /*
-         * 1. case: The whole block is in FRAM.
-         * 2. case: The block wraps from FRAM to SRAM
-         * 3. case: The whole block is in SRAM.
-         */
-        if (BlockAddress < SizeInFRAMStored && (BlockAddress + ByteCount) < SizeInFRAMStored) {
-            MemoryReadBlock(Buffer, BlockAddress + FRAM_LOG_START_ADDR, ByteCount);
-        } else if (BlockAddress < SizeInFRAMStored) {
-            uint16_t FramByteCount = SizeInFRAMStored - BlockAddress;
-            MemoryReadBlock(Buffer, BlockAddress + FRAM_LOG_START_ADDR, FramByteCount);
-            memcpy(Buffer + FramByteCount, LogMem, ByteCount - FramByteCount);
+        if (BlockAddress < HeaderSize) {
+            Chunk = MIN(ByteCount, HeaderSize - BlockAddress);
+            memcpy(BufferPtr, &Header[BlockAddress], Chunk);
+        } else if (BlockAddress < FRAMEnd) {
+            uint16_t Offset = BlockAddress - HeaderSize;
+            Chunk = MIN(ByteCount, SizeInFRAMStored - Offset);
+            LogFRAMRead(BufferPtr, LogFRAMAdvance(LogFRAMReadHead, Offset), Chunk);
+        } else if (BlockAddress < SRAMEnd) {
+            /* Only LogMem up to LogMemPtr holds entries, the live and trigger rings are no log */
+            uint16_t Offset = BlockAddress - FRAMEnd;
+            uint16_t SizeInSRAMStored = LOG_SIZE - LogMemLeft;
+
+            if (Offset < SizeInSRAMStored) {
+                Chunk = MIN(ByteCount, SizeInSRAMStored - Offset);
+                memcpy(BufferPtr, &LogMem[Offset], Chunk);
+            } else {
+                Chunk = MIN(ByteCount, SizeOfSRAM - Offset);
+                memset(BufferPtr, LOG_EMPTY, Chunk);
+            }
         } else {
-            memcpy(Buffer, LogMem + BlockAddress - SizeInFRAMStored, ByteCount);
+            // prevent reading beyond the end of the log
+            Chunk = ByteCount;
+            memset(BufferPtr, 0x00, Chunk);
         }
 
-        if (overflow) {
-            while (remainderByteCount--)
-                ((uint8_t *) Buffer)[ByteCount + remainderByteCount] = 0x00;
-        }
+        BufferPtr += Chunk;
+        BlockAddress += Chunk;
+        ByteCount -= Chunk;
+    }
 
-        return true;
+    return true;
+}
+
+bool LogMemLoadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
+    uint8_t FormatHeader[LOG_FORMAT_HEADER_SIZE] = {
+        LOG_INFO_LOG_FORMAT, 2, 0, 0, LOG_FORMAT_VERSION, GlobalSettings.LogFormat | LOG_DOWNLOAD_FLAGS
+    };
+    static uint16_t SizeInFRAMStored;
+    static uint16_t SizeOfSRAM;
+
+    if (BlockAddress == 0) {
+        /* Only FRAM holds blocks with LOG_COMPRESSION, and the stream chunks
+         * are no linear log, so store the entries in SRAM first */
+        if ((LOG_DOWNLOAD_SRAM_SIZE == 0) || (CurrentLogFunc == LogFuncStream))
+            LogSRAMToFRAM();
+
+        /* Keep the offsets of this download stable while the ring moves on
+         * or the stream keeps adding entries */
+        LogFRAMReadHead = LogFRAMHead;
+        SizeInFRAMStored = LogFRAMDistance(LogFRAMReadHead, LogFRAMAddr);
+        SizeOfSRAM = (CurrentLogFunc == LogFuncStream) ? 0 : LOG_DOWNLOAD_SRAM_SIZE;
+    }
+
+    return LogLoadBlock(Buffer, BlockAddress, ByteCount, FormatHeader, sizeof(FormatHeader), SizeInFRAMStored, SizeOfSRAM);
+}
+
+bool LogMemLoadRangeBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
+    return LogLoadBlock(Buffer, BlockAddress, ByteCount, LogRangeHeader, sizeof(LogRangeHeader), LogRangeSize, 0);
+}
+
+void LogMemSetRange(bool ByTime, uint32_t From, uint32_t To) {
+    LogIndexPointType Start;
+    LogIndexPointType End;
+    uint16_t Skip = 0;
+
+    /* The range covers the entries up to now */
+    LogSRAMToFRAM();
+    LogIndexUpdate(true);
+
+    if (ByTime) {
+        LogIndexSeekTime(&Start, From);
+        LogIndexSeekTime(&End, To);
     } else {
-        return false;
+        LogIndexSeekEntry(&Start, From);
+        LogIndexSeekEntry(&End, To);
     }
+
+#ifdef LOG_COMPRESSION
+    /* End is at the start of the block holding To, which may hold earlier entries as well */
+    if (ByTime || (End.Entry < To))
+        LogIndexStep(&End, LogIndexTail.Address);
+#endif
+
+    if (End.Entry < Start.Entry)
+        End = Start;
+
+    /* Only the block of an entry can be told by its number, not by its time */
+    if (!ByTime && (Start.Entry < From))
+        Skip = MIN(From - Start.Entry, 0xFFFF);
+
+    LogRangeHeader[0] = LOG_INFO_LOG_TIME;
+    LogRangeHeader[1] = LOG_TIME_SIZE;
+    LogRangeHeader[2] = (uint8_t)(Start.Last.SysTick >> 8);
+    LogRangeHeader[3] = (uint8_t)(Start.Last.SysTick >> 0);
+    LogEncodeTime(&LogRangeHeader[4], Start.Last.Time);
+
+    uint8_t *FormatHeader = &LogRangeHeader[LOG_RANGE_TIME_SIZE];
+    FormatHeader[0] = LOG_INFO_LOG_FORMAT;
+    FormatHeader[1] = 4;
+    FormatHeader[2] = 0;
+    FormatHeader[3] = 0;
+    FormatHeader[4] = LOG_FORMAT_VERSION;
+    FormatHeader[5] = GlobalSettings.LogFormat | LOG_DOWNLOAD_FLAGS;
+    FormatHeader[6] = (uint8_t)(Skip >> 8);
+    FormatHeader[7] = (uint8_t)(Skip >> 0);
+
+    LogFRAMReadHead = Start.Address;
+    LogRangeSize = LogFRAMDistance(Start.Address, End.Address);
+}
+
+void LogMemGetRange(uint32_t *FirstEntry, uint32_t *EndEntry, uint32_t *FirstTime, uint32_t *LastTime) {
+    LogIndexPointType First;
+
+    LogSRAMToFRAM();
+    LogIndexUpdate(true);
+
+    /* Step over the oldest entry for its time */
+    First = LogIndexHead;
+    LogIndexStep(&First, LogIndexTail.Address);
+
+    *FirstEntry = LogIndexHead.Entry;
+    *EndEntry = LogIndexTail.Entry;
+    *FirstTime = First.Last.Time;
+    *LastTime = LogIndexTail.Last.Time;
+}
+
+bool LogMemIsEmpty(void) {
+    /* A trigger capture not yet committed to FRAM counts as well */
+    bool CaptureEmpty = (LogTriggerState == LOG_TRIGGER_ARMED) || (LogTriggerUsed() == 0);
+    bool SRAMEmpty = (CurrentLogFunc == LogFuncStream) ?
+                     (LogStreamUsed() == LOG_BLOCK_OVERHEAD) && (LogStreamWrite.Size == 0) : (LogMemLeft == LOG_SIZE);
+
+    return SRAMEmpty && (LogFRAMUsed() == 0) && CaptureEmpty;
 }
 
 INLINE void LogSRAMClear(void) {
@@ -149,14 +1272,26 @@ INLINE void LogSRAMClear(void) {
 }
 
 void LogMemClear(void) {
+    /* Let a chunk being written complete before the log is reset below it */
+    LogStreamWait();
     LogSRAMClear();
     LogFRAMAddr = FRAM_LOG_START_ADDR;
+    LogFRAMHead = FRAM_LOG_START_ADDR;
+    LogFRAMReadHead = FRAM_LOG_START_ADDR;
     MemoryWriteBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
+    MemoryWriteBlock(&LogFRAMHead, FRAM_LOG_HEAD_ADDR, 2);
+    LogIndexReset();
+    LogMemLastValid = false;
+    LiveLogDropped = 0;
+
+    if (CurrentLogFunc == LogFuncStream)
+        LogStreamReset();
+
     LEDHook(LED_LOG_MEM_FULL, LED_OFF);
 }
 
 uint16_t LogMemFree(void) {
-    return LogMemLeft + FRAM_LOG_SIZE - LogFRAMAddr + FRAM_LOG_START_ADDR;
+    return LogMemLeft + LogFRAMFree();
 }
 
 
@@ -168,6 +1303,28 @@ void LogSetModeById(LogModeEnum Mode) {
     }
 #endif
     GlobalSettings.ActiveSettingPtr->LogMode = Mode;
+
+    if ((CurrentLogFunc == LogFuncTrigger) && (Mode != LOG_MODE_TRIGGER)) {
+        /* Store a capture in progress */
+        LogSRAMToFRAM();
+        LogTriggerReset();
+    }
+
+    if ((CurrentLogFunc == LogFuncStream) && (Mode != LOG_MODE_STREAM)) {
+        /* Store the current chunk, entries which do not fit anymore are lost */
+        LogSRAMToFRAM();
+    }
+
+    if (((CurrentLogFunc == LogFuncLive) && (Mode != LOG_MODE_LIVE)) ||
+            ((CurrentLogFunc == LogFuncTrigger) && (Mode != LOG_MODE_TRIGGER)) ||
+            ((CurrentLogFunc == LogFuncStream) && (Mode != LOG_MODE_STREAM))) {
+        /* The live logging and trigger rings and the stream chunks leave no valid entries in LogMem */
+        memset(LogMem, LOG_EMPTY, LOG_SIZE);
+        LogMemPtr = LogMem;
+        LogMemLeft = LOG_SIZE;
+        LogMemLastValid = false;
+    }
+
     switch (Mode) {
         case LOG_MODE_OFF:
             EnableLogSRAMtoFRAM = false;
@@ -181,13 +1338,54 @@ void LogSetModeById(LogModeEnum Mode) {
 
         case LOG_MODE_LIVE:
             EnableLogSRAMtoFRAM = false;
-            CurrentLogFunc = LogFuncLive;
+            if (CurrentLogFunc != LogFuncLive) {
+                /* LogMem becomes the ring, entries not yet stored to FRAM are lost */
+                LogMemPtr = LogMem;
+                LogMemLeft = LOG_SIZE;
+                LiveLogReset();
+                CurrentLogFunc = LogFuncLive;
+                /* Let the host know how to decode the stream */
+                LogFormatEntry();
+            }
+            break;
+
+        case LOG_MODE_RING:
+            EnableLogSRAMtoFRAM = true;
+            CurrentLogFunc = LogFuncRing;
+            break;
+
+        case LOG_MODE_TRIGGER:
+            EnableLogSRAMtoFRAM = true;
+            if (CurrentLogFunc != LogFuncTrigger) {
+                /* LogMem becomes the ring, store the entries of the memory modes first */
+                if ((CurrentLogFunc == LogFuncMemory) || (CurrentLogFunc == LogFuncRing))
+                    LogSRAMToFRAM();
+
+                LogMemPtr = LogMem;
+                LogMemLeft = LOG_SIZE;
+                LogTriggerReset();
+                CurrentLogFunc = LogFuncTrigger;
+            }
+            break;
+
+        case LOG_MODE_STREAM:
+            /* Chunks are stored as soon as they are full, LogTick() only stores partial ones */
+            EnableLogSRAMtoFRAM = false;
+            if (CurrentLogFunc != LogFuncStream) {
+                /* LogMem is split into the chunks, store the entries of the memory modes first */
+                if ((CurrentLogFunc == LogFuncMemory) || (CurrentLogFunc == LogFuncRing))
+                    LogSRAMToFRAM();
+
+                LogStreamReset();
+                CurrentLogFunc = LogFuncStream;
+            }
             break;
 
         default:
             break;
     }
 
+    LogUpdateFilterMask();
 }
 
 bool LogSetModeByName(const char *Mode) {
@@ -210,26 +1408,109 @@ void LogGetModeList(char *List, uint16_t BufferSize) {
     MapToString(LogModeMap, ARRAY_COUNT(LogModeMap), List, BufferSize);
 }
 
-void LogSRAMToFRAM(void) {
-    if (LogMemLeft < LOG_SIZE) {
-        uint16_t FRAM_Free = FRAM_LOG_SIZE - (LogFRAMAddr - FRAM_LOG_START_ADDR);
+void LogSetFilter(uint16_t Filter) {
+#ifdef LOG_SETTING_GLOBAL
+    /* Write Log settings globally */
+    for (uint8_t i = 0; i < SETTINGS_COUNT; i++) {
+        GlobalSettings.Settings[i].LogFilter = Filter;
+    }
+#endif
+    GlobalSettings.ActiveSettingPtr->LogFilter = Filter;
+    LogUpdateFilterMask();
+}
+
+uint16_t LogGetFilter(void) {
+    return GlobalSettings.ActiveSettingPtr->LogFilter;
+}
+
+void LogSetFormatById(LogFormatEnum Format) {
+    uint8_t Data[] = { LOG_FORMAT_VERSION, Format };
+
+    if ((CurrentLogFunc == LogFuncLive) && (Format != GlobalSettings.LogFormat)) {
+        /* Announce the switch while the host still decodes the old format */
+        CurrentLogFunc(LOG_INFO_LOG_FORMAT, Data, sizeof(Data));
+    }
+
+    if ((CurrentLogFunc == LogFuncTrigger) && (LogTriggerState == LOG_TRIGGER_ARMED)) {
+        /* The entries waiting for the trigger are in the old format */
+        LogTriggerReset();
+    }
+
+    GlobalSettings.LogFormat = Format;
+}
 
-        if (FRAM_Free >= LOG_SIZE - LogMemLeft) {
-            MemoryWriteBlock(LogMem, LogFRAMAddr, LOG_SIZE - LogMemLeft);
-            LogFRAMAddr += LOG_SIZE - LogMemLeft;
+bool LogSetFormatByName(const char *Format) {
+    MapIdType Id;
+
+    if (MapTextToId(LogFormatMap, ARRAY_COUNT(LogFormatMap), Format, &Id)) {
+        LogSetFormatById(Id);
+        return true;
+    }
+
+    return false;
+}
+
+void LogGetFormatByName(char *Format, uint16_t BufferSize) {
+    MapIdToText(LogFormatMap, ARRAY_COUNT(LogFormatMap), GlobalSettings.LogFormat, Format, BufferSize);
+}
+
+void LogGetFormatList(char *List, uint16_t BufferSize) {
+    MapToString(LogFormatMap, ARRAY_COUNT(LogFormatMap), List, BufferSize);
+}
+
+void LogSetTrigger(const LogTriggerType *Trigger) {
+    GlobalSettings.LogTrigger = *Trigger;
+}
+
+void LogGetTrigger(LogTriggerType *Trigger) {
+    *Trigger = GlobalSettings.LogTrigger;
+}
+
+void LogTriggerArm(void) {
+    /* Store the previous capture before waiting for the next one */
+    LogSRAMToFRAM();
+    LogTriggerReset();
+}
+
+void LogGetTriggerStateByName(char *State, uint16_t BufferSize) {
+    MapIdToText(LogTriggerStateMap, ARRAY_COUNT(LogTriggerStateMap), LogTriggerState, State, BufferSize);
+}
+
+/* Compressing takes too long for the codec path, which stores with Pack unset */
+static void LogSRAMStore(bool Pack) {
+    if (CurrentLogFunc == LogFuncTrigger) {
+        /* Only a capture goes to FRAM, not the entries waiting for the trigger */
+        if (LogTriggerState != LOG_TRIGGER_ARMED)
+            LogTriggerCommit(Pack);
+    } else if (CurrentLogFunc == LogFuncStream) {
+        if (!LogStreamStore())
+            LEDHook(LED_LOG_MEM_FULL, LED_ON);
+
+        /* Everything logged so far is in FRAM afterwards */
+        LogStreamWait();
+    } else if (LogMemLeft < LOG_SIZE) {
+        if (GlobalSettings.ActiveSettingPtr->LogMode == LOG_MODE_RING)
+            LogFRAMDropOldest(LOG_SIZE - LogMemLeft + LOG_BLOCK_OVERHEAD);
+
+        uint16_t FRAM_Free = LogFRAMFree();
+
+        if (LogFRAMStore(LogMem, LOG_SIZE - LogMemLeft, Pack)) {
             LogSRAMClear();
-            MemoryWriteBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
+#ifndef LOG_COMPRESSION
         } else if (FRAM_Free > 0) {
             // not everything fits in FRAM, simply write as much as possible to FRAM
-            MemoryWriteBlock(LogMem, LogFRAMAddr, FRAM_Free);
+            LogFRAMAppend(LogMem, FRAM_Free);
             memmove(LogMem, LogMem + FRAM_Free, LOG_SIZE - FRAM_Free); // FRAM_Free is < LOG_SIZE - LogMemLeft and thus also < LOG_SIZE
 
             LogMemPtr -= FRAM_Free;
             LogMemLeft += FRAM_Free;
-            LogFRAMAddr += FRAM_Free;
-            MemoryWriteBlock(&LogFRAMAddr, FRAM_LOG_ADDR_ADDR, 2);
+#endif
         } else {
-            // TODO handle the case in which the FRAM is full
+            // FRAM is full, the entries stay in SRAM. LOG_MODE_RING drops old entries instead.
         }
     }
 }
+
+void LogSRAMToFRAM(void) {
+    LogSRAMStore(true);
+}
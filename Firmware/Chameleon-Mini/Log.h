@@ -4,9 +4,10 @@
 #include "Common.h"
 
 #define LOG_SIZE	2048
-#define FRAM_LOG_ADDR_ADDR	0x4000 // start of the second half of FRAM
-#define FRAM_LOG_START_ADDR	0x4002 // directly after the address
-#define FRAM_LOG_SIZE		0x3FFE // the whole second half (minus the 2 Bytes of Address)
+#define FRAM_LOG_ADDR_ADDR	0x4000 // start of the second half of FRAM, end of the newest entry
+#define FRAM_LOG_HEAD_ADDR	0x4002 // start of the oldest entry, only moves in ring mode
+#define FRAM_LOG_START_ADDR	0x4004 // directly after the addresses
+#define FRAM_LOG_SIZE		0x3FFC // the whole second half (minus the 4 Bytes of Addresses)
 
 extern uint8_t LogMem[LOG_SIZE];
 extern uint8_t *LogMemPtr;
@@ -19,6 +20,9 @@ typedef enum {
     LOG_INFO_CONFIG_SET			              = 0x11, ///< Configuration change.
     LOG_INFO_SETTING_SET		                   = 0x12, ///< Setting change.
     LOG_INFO_UID_SET			              = 0x13, ///< UID change.
+    LOG_INFO_LOG_FORMAT			              = 0x14, ///< Format of the following entries. Data is the format version and the \ref LogFormatEnum.
+    LOG_INFO_STATS			              = 0x15, ///< Live logging counters. Data is the produced, dropped and flushed entries and the peak buffer fill in bytes, each 16 bit big endian.
+    LOG_INFO_LOG_TIME			              = 0x16, ///< Log time in ms, 32 bit big endian. Precedes entries whose time cannot be told from the one before.
     LOG_INFO_RESET_APP			              = 0x20, ///< Application reset.
 
     /* Codec */
@@ -61,12 +65,56 @@ typedef enum {
 typedef enum {
     LOG_MODE_OFF,
     LOG_MODE_MEMORY,
-    LOG_MODE_LIVE
+    LOG_MODE_LIVE,
+    LOG_MODE_RING,
+    LOG_MODE_TRIGGER,
+    LOG_MODE_STREAM
 } LogModeEnum;
 
+/** Trigger of \ref LOG_MODE_TRIGGER. */
+typedef struct {
+    uint8_t Entry; ///< Entry type which triggers the capture, see \ref LogEntryEnum.
+    bool MatchCommand; ///< Only trigger if the first data byte of the entry equals Command.
+    uint8_t Command; ///< First data byte, e.g. the command byte of a `CODEC RX` entry.
+    uint8_t PreCount; ///< Number of entries kept from before the trigger.
+    uint8_t PostCount; ///< Number of entries logged after the trigger.
+} LogTriggerType;
+
+typedef enum {
+    LOG_TRIGGER_ARMED,	///< Waiting for the trigger, keeping the latest entries in SRAM.
+    LOG_TRIGGER_TRIGGERED,	///< Logging the entries after the trigger.
+    LOG_TRIGGER_DONE	///< Capture is complete, nothing is logged until armed again.
+} LogTriggerStateEnum;
+
+#define LOG_TRIGGER_DEFAULT_ENTRY	LOG_ERR_APP_AUTH_FAIL
+#define LOG_TRIGGER_DEFAULT_PRE		16
+#define LOG_TRIGGER_DEFAULT_POST	16
+
+/** Encoding of the log entries. \note Every format has a specific integer value, which is written to the log. */
+typedef enum {
+    LOG_FORMAT_STANDARD			= 0x00, ///< Entry type, data length and 16 bit systick in front of every entry.
+    LOG_FORMAT_COMPACT			= 0x01, ///< Short headers with the time since the previous entry as varint.
+    LOG_FORMAT_TIMESTAMP		= 0x02  ///< Standard header followed by a 32 bit timestamp in carrier cycles.
+} LogFormatEnum;
+
+/** Flag in the format of the `LOG FORMAT` entry at the start of a download: the following log consists of blocks, see LOG_COMPRESSION */
+#define LOG_FORMAT_COMPRESSED	0x80
+
+/** Timestamp of entries without a high resolution timestamp in \ref LOG_FORMAT_TIMESTAMP */
+#define LOG_TIMESTAMP_INVALID	0xFFFFFFFFUL
+
+#define LOG_FORMAT_VERSION	1
+
 typedef void (*LogFuncType)(LogEntryEnum Entry, const void *Data, uint8_t Length);
 
+/* Log entries are enabled in classes of 16 entry types. Bit n of a filter
+ * enables the types 0xn0 to 0xnF. */
+#define LOG_FILTER_CLASS(Entry)	(1U << ((uint8_t) (Entry) >> 4))
+#define LOG_FILTER_ALL		0xFFFF
+
 extern LogFuncType CurrentLogFunc;
+extern uint16_t LogFilterMask;
+extern uint32_t LogFrameTimestamp;
 
 void LogInit(void);
 void LogTick(void);
@@ -76,14 +124,47 @@ void LogMemClear(void);
 uint16_t LogMemFree(void);
 /* XModem callback */
 bool LogMemLoadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount);
+/* XModem callback for the part of the FRAM log selected by LogMemSetRange().
+ * Entries are numbered from the oldest one after LOGCLEAR or boot, times are
+ * the log time in ms, which goes on across reboots. To is exclusive. The download
+ * starts with a LOG_INFO_LOG_TIME entry as time base, and its LOG_INFO_LOG_FORMAT
+ * entry holds the number of entries before From as well. */
+bool LogMemLoadRangeBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount);
+void LogMemSetRange(bool ByTime, uint32_t From, uint32_t To);
+void LogMemGetRange(uint32_t *FirstEntry, uint32_t *EndEntry, uint32_t *FirstTime, uint32_t *LastTime);
+bool LogMemIsEmpty(void);
 
 void LogSetModeById(LogModeEnum Mode);
 bool LogSetModeByName(const char *Mode);
 void LogGetModeByName(char *Mode, uint16_t BufferSize);
 void LogGetModeList(char *List, uint16_t BufferSize);
+void LogSetFilter(uint16_t Filter);
+uint16_t LogGetFilter(void);
+void LogSetFormatById(LogFormatEnum Format);
+bool LogSetFormatByName(const char *Format);
+void LogGetFormatByName(char *Format, uint16_t BufferSize);
+void LogGetFormatList(char *List, uint16_t BufferSize);
+void LogSetTrigger(const LogTriggerType *Trigger);
+void LogGetTrigger(LogTriggerType *Trigger);
+void LogTriggerArm(void);
+void LogGetTriggerStateByName(char *State, uint16_t BufferSize);
 void LogSRAMToFRAM(void);
 
-/* Wrapper function to call current logging function */
-INLINE void LogEntry(LogEntryEnum Entry, const void *Data, uint8_t Length) { CurrentLogFunc(Entry, Data, Length); }
+/* Wrapper function to call current logging function. Entry is constant at
+ * the call sites, so filtered entries cost a single bit test. */
+INLINE void LogEntry(LogEntryEnum Entry, const void *Data, uint8_t Length) {
+    if (LogFilterMask & LOG_FILTER_CLASS(Entry))
+        CurrentLogFunc(Entry, Data, Length);
+}
+
+/* Like LogEntry(), with the timestamp the codec latched for the frame instead
+ * of the time of logging */
+INLINE void LogEntryTimestamped(LogEntryEnum Entry, const void *Data, uint8_t Length, uint32_t Timestamp) {
+    if (LogFilterMask & LOG_FILTER_CLASS(Entry)) {
+        LogFrameTimestamp = Timestamp;
+        CurrentLogFunc(Entry, Data, Length);
+        LogFrameTimestamp = LOG_TIMESTAMP_INVALID;
+    }
+}
 
 #endif /* LOG_H_ */
@@ -0,0 +1,160 @@
+/*
+ * LogPack.c
+ *
+ * Encoder of the compressed log. Matches only refer to the data being
+ * encoded, so the entries in SRAM serve as window and nothing is kept between
+ * blocks.
+ */
+
+#include "LogPack.h"
+
+#include <string.h>
+
+#ifdef LOG_COMPRESSION
+#define LOG_LZ_LITERAL_MAX	32
+#define LOG_LZ_MATCH_MIN	3
+#define LOG_LZ_MATCH_MAX	(7 + 0xFF + 2)
+#define LOG_LZ_HASH_SIZE	128
+
+/* Output of the encoder, handed to Write in small pieces */
+static struct {
+    LogPackWriteType Write;
+    uint16_t Length;
+    uint16_t Limit;
+    uint8_t Count;
+    uint8_t Buffer[32];
+} LogPacker;
+
+/* Position + 1 of the latest occurrence of every hash of LOG_LZ_MATCH_MIN bytes */
+static uint16_t LogPackerTable[LOG_LZ_HASH_SIZE];
+
+static void LogPackFlush(void) {
+    LogPacker.Write(LogPacker.Buffer, LogPacker.Count);
+    LogPacker.Count = 0;
+}
+
+static bool LogPackBytes(const uint8_t *Data, uint8_t ByteCount) {
+    if (LogPacker.Length + ByteCount > LogPacker.Limit)
+        return false;
+
+    LogPacker.Length += ByteCount;
+
+    while (ByteCount-- > 0) {
+        LogPacker.Buffer[LogPacker.Count++] = *Data++;
+
+        if (LogPacker.Count == sizeof(LogPacker.Buffer))
+            LogPackFlush();
+    }
+
+    return true;
+}
+
+static bool LogPackLiterals(const uint8_t *Data, uint16_t ByteCount) {
+    while (ByteCount > 0) {
+        uint8_t Count = (ByteCount < LOG_LZ_LITERAL_MAX) ? ByteCount : LOG_LZ_LITERAL_MAX;
+        uint8_t Control = Count - 1;
+
+        if (!LogPackBytes(&Control, 1) || !LogPackBytes(Data, Count))
+            return false;
+
+        Data += Count;
+        ByteCount -= Count;
+    }
+
+    return true;
+}
+
+static bool LogPackMatch(uint16_t Length, uint16_t Distance) {
+    uint8_t Code[3];
+    uint8_t Size = 0;
+
+    Length -= 2;
+
+    if (Length < 7) {
+        Code[Size++] = (Length << 5) | (Distance >> 8);
+    } else {
+        Code[Size++] = (7 << 5) | (Distance >> 8);
+        Code[Size++] = Length - 7;
+    }
+
+    Code[Size++] = Distance & 0xFF;
+
+    return LogPackBytes(Code, Size);
+}
+
+static inline uint8_t LogPackHash(const uint8_t *Data) {
+    return ((Data[0] << 2) ^ (Data[1] << 1) ^ Data[2] ^ (Data[0] >> 4)) & (LOG_LZ_HASH_SIZE - 1);
+}
+
+uint16_t LogPack(const uint8_t *Data, uint16_t ByteCount, uint16_t Limit, LogPackWriteType Write) {
+    uint16_t Literal = 0;
+    uint16_t i = 0;
+
+    LogPacker.Write = Write;
+    LogPacker.Length = 0;
+    LogPacker.Limit = Limit;
+    LogPacker.Count = 0;
+    memset(LogPackerTable, 0, sizeof(LogPackerTable));
+
+    while (i + LOG_LZ_MATCH_MIN <= ByteCount) {
+        uint8_t Hash = LogPackHash(&Data[i]);
+        uint16_t Ref = LogPackerTable[Hash];
+
+        LogPackerTable[Hash] = i + 1;
+
+        if ((Ref > 0) && (memcmp(&Data[Ref - 1], &Data[i], LOG_LZ_MATCH_MIN) == 0)) {
+            uint16_t MaxLength = ByteCount - i;
+            uint16_t Length = LOG_LZ_MATCH_MIN;
+
+            if (MaxLength > LOG_LZ_MATCH_MAX)
+                MaxLength = LOG_LZ_MATCH_MAX;
+
+            while ((Length < MaxLength) && (Data[Ref - 1 + Length] == Data[i + Length]))
+                Length++;
+
+            if (!LogPackLiterals(&Data[Literal], i - Literal) || !LogPackMatch(Length, i - Ref))
+                return 0;
+
+            i += Length;
+            Literal = i;
+        } else {
+            i++;
+        }
+    }
+
+    if (!LogPackLiterals(&Data[Literal], ByteCount - Literal))
+        return 0;
+
+    LogPackFlush();
+
+    return LogPacker.Length;
+}
+
+void LogPackDeltaSysTicks(uint8_t *Data, uint16_t ByteCount, uint8_t HeaderSize, bool Encode) {
+    uint16_t LastSysTick = 0;
+    uint16_t Offset = 0;
+    bool First = true;
+
+    while (Offset + HeaderSize <= ByteCount) {
+        uint8_t *Field = &Data[Offset + 2];
+        uint16_t Value = ((uint16_t) Field[0] << 8) | Field[1];
+        uint16_t SysTick = (Encode || First) ? Value : LastSysTick + Value;
+
+        /* Empty entries are a single byte */
+        if (Data[Offset] == 0x00) {
+            Offset++;
+            continue;
+        }
+
+        if (!First) {
+            Value = Encode ? SysTick - LastSysTick : SysTick;
+            Field[0] = (uint8_t)(Value >> 8);
+            Field[1] = (uint8_t)(Value >> 0);
+        }
+
+        LastSysTick = SysTick;
+        First = false;
+        Offset += HeaderSize + Data[Offset + 1];
+    }
+}
+#endif /* LOG_COMPRESSION */
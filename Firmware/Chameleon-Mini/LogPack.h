@@ -0,0 +1,32 @@
+/*
+ * LogPack.h
+ *
+ * Encoder of the compressed log, see LOG_COMPRESSION in Log.c. It only needs
+ * the C library, so that "make host-test" checks it and its compression ratio
+ * on the host.
+ */
+
+#ifndef LOG_PACK_H_
+#define LOG_PACK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Receives the encoded bytes in order, in pieces of up to 32 bytes */
+typedef void (*LogPackWriteType)(const uint8_t *Data, uint8_t ByteCount);
+
+/* Encode ByteCount bytes of Data like LZF: a control byte below 0x20 is
+ * followed by (control + 1) literal bytes. Otherwise, bits 7..5 hold the match
+ * length minus 2, where 7 means that the next byte adds to it, and bits 4..0
+ * and the next byte the distance of the match minus 1. Returns the encoded
+ * size, or 0 if that would exceed Limit. Part of it may have been written
+ * then. */
+uint16_t LogPack(const uint8_t *Data, uint16_t ByteCount, uint16_t Limit, LogPackWriteType Write);
+
+/* Turn the systick of every entry but the first into the difference to the
+ * entry before (Encode set) and back, for entries of the STANDARD and
+ * TIMESTAMP formats with HeaderSize bytes of header. The differences repeat
+ * far more often than the systicks, so that matches span whole entries. */
+void LogPackDeltaSysTicks(uint8_t *Data, uint16_t ByteCount, uint8_t HeaderSize, bool Encode);
+
+#endif /* LOG_PACK_H_ */
@@ -6,531 +6,1185 @@
  */
 
 #include "Memory.h"
-#include "Configuration.h"
-#include "Common.h"
-#include "Settings.h"
-#include "LEDHook.h"
-#include "System.h"
-
-#define USE_DMA
-#define RECV_DMA DMA.CH0
-#define SEND_DMA DMA.CH1
-
-/* Convert defines from Makefile */
-#define FLASH_DATA_START		FLASH_DATA_ADDR
-#define FLASH_DATA_END			(FLASH_DATA_ADDR + FLASH_DATA_SIZE - 1)
-
-/* Definitions for FRAM */
-#define FRAM_USART	USARTD0
-#define FRAM_PORT	PORTD
-#define FRAM_CS		PIN4_bm
-#define FRAM_MOSI	PIN3_bm
-#define FRAM_MISO	PIN2_bm
-#define FRAM_SCK	PIN1_bm
-
-/* Declarations from assembler file */
-uint16_t FlashReadWord(uint32_t Address);
-void FlashEraseApplicationPage(uint32_t Address);
-void FlashLoadFlashWord(uint16_t Address, uint16_t Data);
-void FlashEraseWriteApplicationPage(uint32_t Address);
-void FlashEraseFlashBuffer(void);
-void FlashWaitForSPM(void);
-
-static uint8_t ScrapBuffer[] = {0};
-
-INLINE uint8_t SPITransferByte(uint8_t Data) {
-    FRAM_USART.DATA = Data;
-
-    while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
-
-    return FRAM_USART.DATA;
-}
-
-#ifdef USE_DMA
-INLINE void SPIReadBlock(void *Buffer, uint16_t ByteCount) {
-    /* Set up read and write transfers */
-    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc;
-    RECV_DMA.DESTADDR0 = ((uintptr_t) Buffer >> 0) & 0xFF;
-    RECV_DMA.DESTADDR1 = ((uintptr_t) Buffer >> 8) & 0xFF;
-    RECV_DMA.TRFCNT = ByteCount;
-    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
-    SEND_DMA.SRCADDR0 = ((uintptr_t) ScrapBuffer >> 0) & 0xFF;
-    SEND_DMA.SRCADDR1 = ((uintptr_t) ScrapBuffer >> 8) & 0xFF;
-    SEND_DMA.TRFCNT = ByteCount;
-
-
-    /* Enable read and write transfers */
-    RECV_DMA.CTRLA |= DMA_CH_ENABLE_bm;
-    SEND_DMA.CTRLA |= DMA_CH_ENABLE_bm;
-
-    /* Wait for DMA to finish */
-    while (RECV_DMA.CTRLA & DMA_CH_ENABLE_bm)
-        ;
-
-    /* Clear Interrupt flag */
-    RECV_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
-    SEND_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
+#include "MemoryBackend.h"
+
+#include <string.h>
+
+#ifndef MEMORY_BACKEND_HOST
+/* The FRAM and flash primitives are inlined into the paths below */
+#include "MemoryBackendXMEGAInclude.c"
+#endif
+
+/* Dirty page tracking. The active setting is mirrored into FRAM starting at
+ * address 0. Every flash page of this working copy that has been written since
+ * the last store or recall is flagged here, such that MemoryStore() only has to
+ * reprogram the pages that actually changed. */
+#define MEMORY_PAGE_SIZE		MEMORY_FLASH_PAGE_SIZE
+#define MEMORY_PAGE_COUNT		(MEMORY_SIZE_PER_SETTING / MEMORY_PAGE_SIZE)
+
+static uint8_t DirtyPageMap[(MEMORY_PAGE_COUNT + 7) / 8];
+
+/* State of the incremental background store. The set of pages to program is
+ * taken from the dirty page map when the store is started. A pending page that
+ * gets written in the meantime is first copied to CopyBuffer (copy-on-write),
+ * so that flash always receives the contents from the moment the store began. */
+#define MEMORY_PAGE_NONE		0xFF
+#define MEMORY_SLOT_NONE		0xFF
+
+static struct {
+    bool Active;
+    uint32_t SettingAddress;
+    uint8_t PageMap[(MEMORY_PAGE_COUNT + 7) / 8];
+    uint8_t PagesTotal;
+    uint8_t PagesDone;
+    uint8_t CopyPage;
+} StoreAsync = { .Active = false };
+
+static uint8_t CopyBuffer[MEMORY_PAGE_SIZE];
+
+/* Page buffers for overlapping flash accesses with FRAM DMA transfers in the
+ * backend, and scratch space for clearing and compressing the working copy */
+static MemoryPageBufferType MemoryPageBuffer;
+
+MemoryStatsType MemoryStats = { 0 };
+
+/* Set-associative SRAM cache in front of the working copy in FRAM. Lines are
+ * allocated on read misses (and on write misses when writing back), replacing
+ * the least recently used way of a set that is not pinned. Transfers larger
+ * than a few lines bypass the cache in order not to flush it. */
+#ifdef MEMORY_CACHE
+#define CACHE_MAX_ACCESS		(4 * MEMORY_CACHE_LINE_SIZE)
+
+#define CACHE_LINE_VALID		(1 << 0)
+#define CACHE_LINE_DIRTY		(1 << 1)
+#define CACHE_LINE_PINNED		(1 << 2)
+
+typedef struct {
+    uint16_t Tag; /* FRAM address divided by the line size */
+    uint8_t Flags;
+    uint8_t Age; /* 0 for the most recently used way of a set */
+    uint8_t Data[MEMORY_CACHE_LINE_SIZE];
+} CacheLineType;
+
+static CacheLineType Cache[MEMORY_CACHE_SETS][MEMORY_CACHE_WAYS];
+#endif
+
+MemoryCacheStatsType MemoryCacheStats = { 0 };
+
+#ifdef MEMORY_CACHE
+INLINE bool CacheLineOverlaps(CacheLineType *Line, uint16_t Address, uint16_t ByteCount) {
+    uint32_t LineAddress = (uint32_t) Line->Tag * MEMORY_CACHE_LINE_SIZE;
+
+    return (Line->Flags & CACHE_LINE_VALID) && (LineAddress < (uint32_t) Address + ByteCount)
+           && (LineAddress + MEMORY_CACHE_LINE_SIZE > Address);
+}
+
+INLINE bool CacheIsCacheable(uint16_t Address, uint16_t ByteCount) {
+    return (ByteCount <= CACHE_MAX_ACCESS) && ((uint32_t) Address + ByteCount <= MEMORY_SIZE_PER_SETTING);
 }
-#else
-INLINE void SPIReadBlock(void *Buffer, uint16_t ByteCount) {
-    uint8_t *ByteBuffer = (uint8_t *) Buffer;
 
-    while (ByteCount-- > 0) {
-        FRAM_USART.DATA = 0;
-        while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
+static CacheLineType *CacheFind(uint16_t Tag) {
+    CacheLineType *Set = Cache[Tag % MEMORY_CACHE_SETS];
 
-        *ByteBuffer++ = FRAM_USART.DATA;
+    for (uint8_t Way = 0; Way < MEMORY_CACHE_WAYS; Way++) {
+        if ((Set[Way].Flags & CACHE_LINE_VALID) && (Set[Way].Tag == Tag))
+            return &Set[Way];
     }
+
+    return NULL;
 }
 
-#endif
+static void CacheTouch(CacheLineType *Line) {
+    CacheLineType *Set = Cache[Line->Tag % MEMORY_CACHE_SETS];
+
+    for (uint8_t Way = 0; Way < MEMORY_CACHE_WAYS; Way++) {
+        if (Set[Way].Age < Line->Age)
+            Set[Way].Age++;
+    }
+
+    Line->Age = 0;
+}
+
+static void CacheWriteBackLine(CacheLineType *Line) {
+    if (Line->Flags & CACHE_LINE_DIRTY) {
+        FRAMWrite(Line->Data, Line->Tag * MEMORY_CACHE_LINE_SIZE, MEMORY_CACHE_LINE_SIZE);
+        Line->Flags &= ~CACHE_LINE_DIRTY;
+    }
+}
+
+static CacheLineType *CacheAllocate(uint16_t Tag, bool Fill) {
+    CacheLineType *Set = Cache[Tag % MEMORY_CACHE_SETS];
+    CacheLineType *Victim = NULL;
+
+    for (uint8_t Way = 0; Way < MEMORY_CACHE_WAYS; Way++) {
+        if (Set[Way].Flags & CACHE_LINE_PINNED)
+            continue;
+
+        if (!(Set[Way].Flags & CACHE_LINE_VALID)) {
+            Victim = &Set[Way];
+            break;
+        }
+
+        if ((Victim == NULL) || (Set[Way].Age > Victim->Age))
+            Victim = &Set[Way];
+    }
+
+    if (Victim == NULL) {
+        /* Every way of this set is pinned */
+        return NULL;
+    }
+
+    if (Victim->Flags & CACHE_LINE_VALID) {
+        CacheWriteBackLine(Victim);
+        MemoryCacheStats.Evictions++;
+    }
+
+    Victim->Tag = Tag;
+    Victim->Flags = CACHE_LINE_VALID;
+
+    if (Fill)
+        FRAMRead(Victim->Data, Tag * MEMORY_CACHE_LINE_SIZE, MEMORY_CACHE_LINE_SIZE);
+
+    return Victim;
+}
+
+static void CacheWriteBack(uint16_t Address, uint16_t ByteCount) {
+    /* Make the FRAM contents of the given range up to date */
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        CacheLineType *Line = &Cache[0][0] + i;
+
+        if (CacheLineOverlaps(Line, Address, ByteCount))
+            CacheWriteBackLine(Line);
+    }
+}
+
+static void CacheUpdate(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    /* Copy data that has been written to FRAM directly into the cached lines */
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        CacheLineType *Line = &Cache[0][0] + i;
+
+        if (CacheLineOverlaps(Line, Address, ByteCount)) {
+            uint16_t LineAddress = Line->Tag * MEMORY_CACHE_LINE_SIZE;
+            uint16_t First = MAX(LineAddress, Address);
+            uint16_t Last = MIN((uint32_t) LineAddress + MEMORY_CACHE_LINE_SIZE, (uint32_t) Address + ByteCount);
+
+            memcpy(&Line->Data[First - LineAddress], (const uint8_t *) Buffer + (First - Address), Last - First);
+        }
+    }
+}
+
+static bool CacheReadHit(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    /* Serve a read only if it is completely held by the cache */
+    uint16_t LastTag = ((uint32_t) Address + ByteCount - 1) / MEMORY_CACHE_LINE_SIZE;
+
+    if (!CacheIsCacheable(Address, ByteCount))
+        return false;
+
+    for (uint16_t Tag = Address / MEMORY_CACHE_LINE_SIZE; Tag <= LastTag; Tag++) {
+        if (CacheFind(Tag) == NULL)
+            return false;
+    }
+
+    for (uint16_t Tag = Address / MEMORY_CACHE_LINE_SIZE; Tag <= LastTag; Tag++) {
+        CacheLineType *Line = CacheFind(Tag);
+        uint16_t First = MAX(Tag * MEMORY_CACHE_LINE_SIZE, Address);
+        uint16_t Last = MIN((uint32_t) (Tag + 1) * MEMORY_CACHE_LINE_SIZE, (uint32_t) Address + ByteCount);
+
+        memcpy((uint8_t *) Buffer + (First - Address), &Line->Data[First % MEMORY_CACHE_LINE_SIZE], Last - First);
+        CacheTouch(Line);
+        MemoryCacheStats.Hits++;
+    }
 
-#ifdef USE_DMA
-INLINE void SPIWriteBlock(const void *Buffer, uint16_t ByteCount) {
-    /* Set up read and write transfers */
-    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
-    RECV_DMA.DESTADDR0 = ((uintptr_t) ScrapBuffer >> 0) & 0xFF;
-    RECV_DMA.DESTADDR1 = ((uintptr_t) ScrapBuffer >> 8) & 0xFF;
-    RECV_DMA.TRFCNT = ByteCount;
-    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
-    SEND_DMA.SRCADDR0 = ((uintptr_t) Buffer >> 0) & 0xFF;
-    SEND_DMA.SRCADDR1 = ((uintptr_t) Buffer >> 8) & 0xFF;
-    SEND_DMA.TRFCNT = ByteCount;
-
-    /* Enable read and write transfers */
-    RECV_DMA.CTRLA |= DMA_CH_ENABLE_bm;
-    SEND_DMA.CTRLA |= DMA_CH_ENABLE_bm;
-
-    /* Wait for DMA to finish */
-    while (RECV_DMA.CTRLA & DMA_CH_ENABLE_bm)
-        ;
-
-    /* Clear Interrupt flag */
-    RECV_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
-    SEND_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
+    return true;
+}
+
+static void CacheFlush(void) {
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        CacheWriteBackLine(&Cache[0][0] + i);
+    }
+}
+
+static void CacheInvalidate(void) {
+    /* The working copy has been replaced in FRAM. Pinned lines are reloaded,
+     * all others are dropped without being written back. */
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        CacheLineType *Line = &Cache[0][0] + i;
+
+        if (Line->Flags & CACHE_LINE_PINNED) {
+            FRAMRead(Line->Data, Line->Tag * MEMORY_CACHE_LINE_SIZE, MEMORY_CACHE_LINE_SIZE);
+            Line->Flags = CACHE_LINE_VALID | CACHE_LINE_PINNED;
+        } else {
+            Line->Flags = 0;
+        }
+    }
+}
+
+static void CacheInit(void) {
+    for (uint8_t Set = 0; Set < MEMORY_CACHE_SETS; Set++) {
+        for (uint8_t Way = 0; Way < MEMORY_CACHE_WAYS; Way++) {
+            Cache[Set][Way].Flags = 0;
+            Cache[Set][Way].Age = Way;
+        }
+    }
 }
 #else
-INLINE void SPIWriteBlock(const void *Buffer, uint16_t ByteCount) {
-    uint8_t *ByteBuffer = (uint8_t *) Buffer;
+INLINE void CacheWriteBack(uint16_t Address, uint16_t ByteCount) { }
+INLINE void CacheUpdate(const void *Buffer, uint16_t Address, uint16_t ByteCount) { }
+INLINE bool CacheReadHit(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    return false;
+}
+INLINE void CacheFlush(void) { }
+INLINE void CacheInvalidate(void) { }
+INLINE void CacheInit(void) { }
+#endif
+
+static void CachedRead(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+#ifdef MEMORY_CACHE
+    uint8_t *BufPtr = (uint8_t *) Buffer;
 
-    while (ByteCount-- > 0) {
-        FRAM_USART.DATA = *ByteBuffer++;
-        while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
+    if (CacheIsCacheable(Address, ByteCount)) {
+        while (ByteCount > 0) {
+            uint8_t Offset = Address % MEMORY_CACHE_LINE_SIZE;
+            uint8_t Count = MIN(ByteCount, MEMORY_CACHE_LINE_SIZE - Offset);
+            CacheLineType *Line = CacheFind(Address / MEMORY_CACHE_LINE_SIZE);
+
+            if (Line != NULL) {
+                MemoryCacheStats.Hits++;
+            } else {
+                MemoryCacheStats.Misses++;
+                Line = CacheAllocate(Address / MEMORY_CACHE_LINE_SIZE, true);
+            }
+
+            if (Line != NULL) {
+                memcpy(BufPtr, &Line->Data[Offset], Count);
+                CacheTouch(Line);
+            } else {
+                FRAMRead(BufPtr, Address, Count);
+            }
+
+            BufPtr += Count;
+            Address += Count;
+            ByteCount -= Count;
+        }
 
-        FRAM_USART.DATA; /* Flush Buffer */
+        return;
     }
+
+    CacheWriteBack(Address, ByteCount);
+#endif
+    FRAMRead(Buffer, Address, ByteCount);
 }
+
+static void CachedWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+#if defined(MEMORY_CACHE) && defined(MEMORY_CACHE_WRITE_BACK)
+    const uint8_t *BufPtr = (const uint8_t *) Buffer;
+
+    if (CacheIsCacheable(Address, ByteCount)) {
+        while (ByteCount > 0) {
+            uint8_t Offset = Address % MEMORY_CACHE_LINE_SIZE;
+            uint8_t Count = MIN(ByteCount, MEMORY_CACHE_LINE_SIZE - Offset);
+            CacheLineType *Line = CacheFind(Address / MEMORY_CACHE_LINE_SIZE);
+
+            if (Line != NULL) {
+                MemoryCacheStats.Hits++;
+            } else {
+                /* Partially written lines have to be filled first */
+                MemoryCacheStats.Misses++;
+                Line = CacheAllocate(Address / MEMORY_CACHE_LINE_SIZE, Count < MEMORY_CACHE_LINE_SIZE);
+            }
+
+            if (Line != NULL) {
+                memcpy(&Line->Data[Offset], BufPtr, Count);
+                Line->Flags |= CACHE_LINE_DIRTY;
+                CacheTouch(Line);
+            } else {
+                FRAMWrite(BufPtr, Address, Count);
+            }
+
+            BufPtr += Count;
+            Address += Count;
+            ByteCount -= Count;
+        }
+
+        return;
+    }
 #endif
+    /* Write through */
+    FRAMWrite(Buffer, Address, ByteCount);
+    CacheUpdate(Buffer, Address, ByteCount);
+}
 
-INLINE void FRAMRead(void *Buffer, uint16_t Address, uint16_t ByteCount) {
-    FRAM_PORT.OUTCLR = FRAM_CS;
+INLINE void MarkPagesDirty(uint16_t Address, uint16_t ByteCount) {
+    /* Only writes into the working copy of the active setting are relevant */
+    if ((ByteCount == 0) || (Address >= MEMORY_SIZE_PER_SETTING))
+        return;
 
-    SPITransferByte(0x03); /* Read command */
-    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
-    SPITransferByte((Address >> 0) & 0xFF);
+    uint16_t LastAddress = MIN((uint32_t) Address + ByteCount, MEMORY_SIZE_PER_SETTING) - 1;
 
-    SPIReadBlock(Buffer, ByteCount);
+    for (uint8_t Page = Address / MEMORY_PAGE_SIZE; Page <= LastAddress / MEMORY_PAGE_SIZE; Page++) {
+        DirtyPageMap[Page / 8] |= (1 << (Page % 8));
+    }
+}
 
-    FRAM_PORT.OUTSET = FRAM_CS;
+INLINE bool PageIsDirty(uint8_t Page) {
+    return DirtyPageMap[Page / 8] & (1 << (Page % 8));
 }
 
-INLINE void FRAMWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
-    FRAM_PORT.OUTCLR = FRAM_CS;
-    SPITransferByte(0x06); /* Write Enable */
-    FRAM_PORT.OUTSET = FRAM_CS;
+INLINE void ClearDirtyPages(void) {
+    memset(DirtyPageMap, 0x00, sizeof(DirtyPageMap));
+}
 
-    asm volatile("nop");
-    asm volatile("nop");
+/* A change of the slot of the active setting is kept here until SlotCommit()
+ * takes it into the table, once the flash holds the contents in the new
+ * layout. Until then the table keeps describing the flash, also for anything
+ * that saves the settings in between. */
+static MemorySlotType SlotPending;
+static uint8_t SlotPendingIdx = MEMORY_SLOT_NONE;
 
-    FRAM_PORT.OUTCLR = FRAM_CS;
+INLINE bool SlotIsPending(void) {
+    return SlotPendingIdx == SlotActiveIdx();
+}
 
-    SPITransferByte(0x02); /* Write command */
-    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
-    SPITransferByte((Address >> 0) & 0xFF);
+/* Flash slot of the active setting, see the allocation table of the backend */
+INLINE MemorySlotType *SlotActive(void) {
+    return SlotIsPending() ? &SlotPending : &SlotTable()[SlotActiveIdx()];
+}
 
-    SPIWriteBlock(Buffer, ByteCount);
+INLINE uint32_t SlotAddress(void) {
+    return SlotActive()->Offset;
+}
 
-    FRAM_PORT.OUTSET = FRAM_CS;
+INLINE uint16_t SlotSize(void) {
+    return SlotActive()->Size;
 }
 
-INLINE void FlashRead(void *Buffer, uint32_t Address, uint16_t ByteCount) {
-    uint8_t *BufPtr = (uint8_t *) Buffer;
+INLINE uint16_t SlotFlashSize(void) {
+    return SlotActive()->FlashSize;
+}
+
+INLINE uint8_t SlotPageCount(void) {
+    return SlotSize() / MEMORY_PAGE_SIZE;
+}
 
-    /* We assume that ByteCount is a multiple of 2 */
-    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+static bool SlotIsFree(uint8_t SettingIdx, uint32_t Offset, uint16_t FlashSize) {
+    /* Check that the given area does not overlap any slot of another setting */
+    if (Offset + FlashSize > MEMORY_SIZE)
+        return false;
+
+    for (uint8_t i = 0; i < MEMORY_SLOT_COUNT; i++) {
+        const MemorySlotType *Slot = &SlotTable()[i];
 
-    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
-        /* Sanity check to limit access to the allocated area */
-        while (ByteCount > 1) {
-            uint16_t Word = FlashReadWord(PhysicalAddress);
+        if ((i != SettingIdx) && (Slot->FlashSize > 0) &&
+                (Offset < (uint32_t) Slot->Offset + Slot->FlashSize) && (Slot->Offset < Offset + FlashSize))
+            return false;
+    }
+
+    return true;
+}
 
-            *BufPtr++ = (Word >> 0) & 0xFF;
-            *BufPtr++ = (Word >> 8) & 0xFF;
+static bool SlotFindSpace(uint16_t FlashSize, uint32_t *Offset) {
+    /* For the active setting, the only one whose slot changes */
+    uint8_t SettingIdx = SlotActiveIdx();
+    const MemorySlotType *Slot = SlotActive();
+    uint8_t i = 0;
 
-            PhysicalAddress += 2;
-            ByteCount -= 2;
+    if ((Slot->FlashSize > 0) && SlotIsFree(SettingIdx, Slot->Offset, FlashSize)) {
+        /* Shrink or grow in place */
+        *Offset = Slot->Offset;
+        return true;
+    }
+
+    /* Search the first gap that is large enough */
+    *Offset = 0;
+
+    while (i < MEMORY_SLOT_COUNT) {
+        const MemorySlotType *Other = &SlotTable()[i];
+
+        if ((i != SettingIdx) && (Other->FlashSize > 0) &&
+                (*Offset < (uint32_t) Other->Offset + Other->FlashSize) && (Other->Offset < *Offset + FlashSize)) {
+            /* Overlap, continue behind this slot */
+            *Offset = (uint32_t) Other->Offset + Other->FlashSize;
+            i = 0;
+        } else {
+            i++;
         }
     }
+
+    return (*Offset + FlashSize <= MEMORY_SIZE);
+}
+
+static MemorySlotType *SlotChange(void) {
+    if (!SlotIsPending()) {
+        /* A change left by another setting has never been stored, drop it */
+        SlotPending = SlotTable()[SlotActiveIdx()];
+        SlotPendingIdx = SlotActiveIdx();
+    }
+
+    return &SlotPending;
 }
 
-INLINE void FlashWrite(const void *Buffer, uint32_t Address, uint16_t ByteCount) {
-    const uint8_t *BufPtr = (uint8_t *) Buffer;
+static bool SlotResize(uint16_t FlashSize) {
+    /* Change the flash memory occupied by the active setting, e.g. when
+     * switching between compressed and uncompressed storage. The new table
+     * entry is only persisted by SlotCommit() once the pages are written, so
+     * that an interrupted store does not leave it pointing at partial data. */
+    MemorySlotType *Slot;
+    uint32_t Offset;
 
-    /* We assume that FlashWrite is always called for write actions that are
-     * aligned to APP_SECTION_PAGE_SIZE and a multiple of APP_SECTION_PAGE_SIZE.
-     * Thus only full pages are written into the flash. */
-    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
-    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+    if (FlashSize == SlotFlashSize())
+        return true;
+
+    if (!SlotFindSpace(FlashSize, &Offset))
+        return false;
+
+    /* Flash contents are no longer valid in the new layout */
+    memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+
+    Slot = SlotChange();
+    Slot->Offset = Offset;
+    Slot->FlashSize = FlashSize;
 
-    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
-        /* Sanity check to limit access to the allocated area */
+    return true;
+}
 
-        while (PageCount-- > 0) {
-            /* For each page to program, wait for NVM to get ready,
-             * erase the flash page buffer, program all data to the
-             * flash page buffer and write buffer to flash using
-             * the atomic erase and write operation. */
+static void SlotCommit(void) {
+    if (SlotIsPending()) {
+        SlotTable()[SlotPendingIdx] = SlotPending;
+        SlotTableSave(SlotPendingIdx, 1);
+        SlotPendingIdx = MEMORY_SLOT_NONE;
+    }
+}
 
-            FlashWaitForSPM();
+static void CheckSlotTable(void) {
+    /* The EEPROM image leaves the table zeroed, as does firmware from before
+     * the table existed. Take a table without a single slot as missing. At
+     * worst, settings without memory get the fixed layout until activated. */
+    bool Valid = false;
 
-            FlashEraseFlashBuffer();
-            FlashWaitForSPM();
+    for (uint8_t i = 0; i < MEMORY_SLOT_COUNT; i++) {
+        if (SlotTable()[i].FlashSize > 0)
+            Valid = true;
+    }
 
-            for (uint16_t i = 0; i < APP_SECTION_PAGE_SIZE; i += 2) {
-                uint16_t Word = 0;
+    for (uint8_t i = 0; i < MEMORY_SLOT_COUNT; i++) {
+        const MemorySlotType *Slot = &SlotTable()[i];
 
-                Word |= ((uint16_t) * BufPtr++ << 0);
-                Word |= ((uint16_t) * BufPtr++ << 8);
+        if ((Slot->Size % MEMORY_PAGE_SIZE) || (Slot->FlashSize % MEMORY_PAGE_SIZE) || (Slot->Offset % MEMORY_PAGE_SIZE) ||
+                (Slot->Size > MEMORY_SIZE_PER_SETTING) || (Slot->FlashSize > Slot->Size) || ((Slot->FlashSize == 0) != (Slot->Size == 0)) ||
+                !SlotIsFree(i, Slot->Offset, Slot->FlashSize))
+            Valid = false;
+    }
 
-                FlashLoadFlashWord(i, Word);
-                FlashWaitForSPM();
+    if (!Valid) {
+        /* Table is missing or damaged. Fall back to the fixed layout of one
+         * MEMORY_SIZE_PER_SETTING sized slot per setting, as long as they fit. */
+        for (uint8_t i = 0; i < MEMORY_SLOT_COUNT; i++) {
+            if (i < MEMORY_SIZE / MEMORY_SIZE_PER_SETTING) {
+                SlotTable()[i].Offset = (uint16_t) i * MEMORY_SIZE_PER_SETTING;
+                SlotTable()[i].Size = MEMORY_SIZE_PER_SETTING;
+                SlotTable()[i].FlashSize = MEMORY_SIZE_PER_SETTING;
+            } else {
+                SlotTable()[i].Offset = 0;
+                SlotTable()[i].Size = 0;
+                SlotTable()[i].FlashSize = 0;
             }
+        }
 
-            FlashEraseWriteApplicationPage(PhysicalAddress);
-            FlashWaitForSPM();
+        SlotTableSave(0, MEMORY_SLOT_COUNT);
+    }
+}
 
-            PhysicalAddress += APP_SECTION_PAGE_SIZE;
+/* Compressed slots. Each page of the working copy is encoded separately with
+ * a run-length code: a control byte below RLE_RUN_FLAG is followed by
+ * (control + 1) literal bytes, a control byte with RLE_RUN_FLAG set is followed
+ * by a single byte to be repeated (control - RLE_RUN_FLAG + RLE_RUN_MIN) times.
+ * The slot begins with an index of 16 bit offsets to every encoded page. */
+#define RLE_RUN_FLAG			0x80
+#define RLE_RUN_MIN				3
+#define RLE_RUN_MAX				(RLE_RUN_MIN + 0x7F)
+#define RLE_LITERAL_MAX			0x80
+
+static void UnpackPage(uint8_t *Page, uint32_t FlashAddress) {
+    uint16_t i = 0;
+
+    while (i < MEMORY_PAGE_SIZE) {
+        uint8_t Control = FlashReadByte(FlashAddress++);
+
+        if (Control & RLE_RUN_FLAG) {
+            uint8_t Byte = FlashReadByte(FlashAddress++);
+            uint16_t Count = MIN(Control - RLE_RUN_FLAG + RLE_RUN_MIN, MEMORY_PAGE_SIZE - i);
+
+            memset(&Page[i], Byte, Count);
+            i += Count;
+        } else {
+            uint16_t Count = MIN(Control + 1, MEMORY_PAGE_SIZE - i);
+
+            while (Count-- > 0) {
+                Page[i++] = FlashReadByte(FlashAddress++);
+            }
         }
     }
 }
 
-INLINE void FlashErase(uint32_t Address, uint16_t ByteCount) {
-    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
-    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+static void CompressedRecall(const MemorySlotType *Slot) {
+    uint32_t FlashAddress = Slot->Offset;
 
-    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
-        /* Sanity check to limit access to the allocated area */
-        while (PageCount-- > 0) {
-            FlashWaitForSPM();
+    for (uint8_t Page = 0; Page < Slot->Size / MEMORY_PAGE_SIZE; Page++) {
+        uint16_t Offset = FlashReadByte(FlashAddress + 2 * Page) | ((uint16_t) FlashReadByte(FlashAddress + 2 * Page + 1) << 8);
 
-            FlashEraseApplicationPage(PhysicalAddress);
-            FlashWaitForSPM();
+        UnpackPage(MemoryPageBuffer[0], FlashAddress + Offset);
+        FRAMWrite(MemoryPageBuffer[0], Page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+    }
+}
 
-            PhysicalAddress += APP_SECTION_PAGE_SIZE;
-        }
+#ifdef MEMORY_COMPRESSION
+/* Output of the encoder. Without Write set, only the length is determined. */
+static struct {
+    bool Write;
+    uint16_t Length;
+    uint16_t Count;
+    uint32_t FlashAddress;
+} Packer;
+
+static void PackFlush(void) {
+    /* Only program flash pages whose contents actually change */
+    bool Equal = true;
+
+    for (uint16_t i = 0; (i < MEMORY_PAGE_SIZE) && Equal; i++) {
+        Equal = (MemoryPageBuffer[1][i] == FlashReadByte(Packer.FlashAddress + i));
     }
+
+    if (Equal) {
+        MemoryStats.PagesSkipped++;
+    } else {
+        FlashWrite(MemoryPageBuffer[1], Packer.FlashAddress, MEMORY_PAGE_SIZE);
+        MemoryStats.PagesWritten++;
+    }
+
+    Packer.FlashAddress += MEMORY_PAGE_SIZE;
+    Packer.Count = 0;
 }
 
-INLINE void FlashToFRAM(uint32_t Address, uint16_t ByteCount) {
-    /* We assume that ByteCount is a multiple of 2 */
-    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+static void PackByte(uint8_t Byte) {
+    if (Packer.Write) {
+        MemoryPageBuffer[1][Packer.Count++] = Byte;
 
-    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
-        /* Sanity check to limit access to the allocated area.
-         * Set up FRAM memory for writing. */
-        FRAM_PORT.OUTCLR = FRAM_CS;
-        SPITransferByte(0x06); /* Write Enable */
-        FRAM_PORT.OUTSET = FRAM_CS;
+        if (Packer.Count == MEMORY_PAGE_SIZE)
+            PackFlush();
+    }
+
+    Packer.Length++;
+}
 
-        asm volatile("nop");
-        asm volatile("nop");
+static void PackPage(const uint8_t *Page) {
+    uint16_t i = 0;
 
-        FRAM_PORT.OUTCLR = FRAM_CS;
+    while (i < MEMORY_PAGE_SIZE) {
+        uint16_t Run = 1;
 
-        SPITransferByte(0x02); /* Write command */
-        SPITransferByte(0); /* Address hi and lo byte */
-        SPITransferByte(0);
+        while ((i + Run < MEMORY_PAGE_SIZE) && (Run < RLE_RUN_MAX) && (Page[i + Run] == Page[i]))
+            Run++;
 
-        /* Loop through bytes, read words from flash and write
-         * double byte into FRAM. */
-        while (ByteCount > 1) {
-            uint16_t Word = FlashReadWord(PhysicalAddress);
+        if (Run >= RLE_RUN_MIN) {
+            PackByte(RLE_RUN_FLAG + Run - RLE_RUN_MIN);
+            PackByte(Page[i]);
+            i += Run;
+        } else {
+            /* Collect literals up to the start of the next run */
+            uint16_t Start = i;
+            uint8_t Count = 0;
 
-            SPITransferByte((Word >> 0) & 0xFF);
-            SPITransferByte((Word >> 8) & 0xFF);
+            do {
+                i++;
+                Count++;
+            } while ((i < MEMORY_PAGE_SIZE) && (Count < RLE_LITERAL_MAX) &&
+                     !((i + RLE_RUN_MIN <= MEMORY_PAGE_SIZE) && (Page[i] == Page[i + 1]) && (Page[i] == Page[i + 2])));
 
-            PhysicalAddress += 2;
-            ByteCount -= 2;
+            PackByte(Count - 1);
+
+            while (Start < i)
+                PackByte(Page[Start++]);
         }
+    }
+}
+
+static bool CompressedStore(void) {
+    uint8_t PageCount = SlotPageCount();
+    uint16_t Index[MEMORY_PAGE_COUNT];
+    uint16_t FlashSize;
+
+    /* First pass: Determine the encoded size of every page */
+    Packer.Write = false;
+    Packer.Length = 2 * PageCount;
 
-        /* End write procedure of FRAM */
-        FRAM_PORT.OUTSET = FRAM_CS;
+    for (uint8_t Page = 0; Page < PageCount; Page++) {
+        Index[Page] = Packer.Length;
+        FRAMRead(MemoryPageBuffer[0], Page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        PackPage(MemoryPageBuffer[0]);
     }
+
+    FlashSize = (Packer.Length + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+
+    if (FlashSize >= SlotSize()) {
+        /* Compression does not pay off, store uncompressed */
+        return false;
+    }
+
+    if (!SlotResize(FlashSize)) {
+        /* Not enough flash left at the current location */
+        return false;
+    }
+
+    /* Second pass: Write index and encoded pages */
+    Packer.Write = true;
+    Packer.Count = 0;
+    Packer.FlashAddress = SlotAddress();
+
+    for (uint8_t Page = 0; Page < PageCount; Page++) {
+        PackByte((Index[Page] >> 0) & 0xFF);
+        PackByte((Index[Page] >> 8) & 0xFF);
+    }
+
+    for (uint8_t Page = 0; Page < PageCount; Page++) {
+        FRAMRead(MemoryPageBuffer[0], Page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        PackPage(MemoryPageBuffer[0]);
+    }
+
+    while (Packer.Count > 0)
+        PackByte(0xFF);
+
+    ClearDirtyPages();
+
+    return true;
 }
+#endif
 
-INLINE void FRAMToFlash(uint32_t Address, uint16_t ByteCount) {
-    /* We assume that FlashWrite is always called for write actions that are
-     * aligned to APP_SECTION_PAGE_SIZE and a multiple of APP_SECTION_PAGE_SIZE.
-     * Thus only full pages are written into the flash. */
-    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
-    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+INLINE bool PageIsPending(uint8_t Page) {
+    return StoreAsync.PageMap[Page / 8] & (1 << (Page % 8));
+}
 
-    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
-        /* Sanity check to limit access to the allocated area and setup FRAM
-         * read. */
-        FRAM_PORT.OUTCLR = FRAM_CS;
+static void StoreAsyncProgramPage(uint8_t Page) {
+    uint32_t FlashAddress = StoreAsync.SettingAddress + (uint32_t) Page * MEMORY_PAGE_SIZE;
 
-        SPITransferByte(0x03); /* Read command */
-        SPITransferByte(0); /* Address hi and lo byte */
-        SPITransferByte(0);
+    if (Page == StoreAsync.CopyPage) {
+        /* Original contents have been preserved in SRAM */
+        FlashWrite(CopyBuffer, FlashAddress, MEMORY_PAGE_SIZE);
+        StoreAsync.CopyPage = MEMORY_PAGE_NONE;
+    } else {
+        FRAMToFlash(FlashAddress, Page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE, MemoryPageBuffer);
+    }
 
-        while (PageCount-- > 0) {
-            /* For each page to program, wait for NVM to get ready,
-             * erase the flash page buffer, program all data to the
-             * flash page buffer and write buffer to flash using
-             * the atomic erase and write operation. */
+    StoreAsync.PageMap[Page / 8] &= ~(1 << (Page % 8));
+    StoreAsync.PagesDone++;
+    MemoryStats.PagesWritten++;
 
-            FlashWaitForSPM();
+    if (StoreAsync.PagesDone == StoreAsync.PagesTotal) {
+        StoreAsync.Active = false;
+        SlotCommit();
 
-            FlashEraseFlashBuffer();
-            FlashWaitForSPM();
+        MemoryStoredHook();
+    }
+}
 
-            /* Write one page worth of data into flash buffer */
-            for (uint16_t i = 0; i < APP_SECTION_PAGE_SIZE; i += 2) {
-                uint16_t Word = 0;
+static void StoreAsyncStep(void) {
+    uint8_t Page = StoreAsync.CopyPage;
 
-                Word |= ((uint16_t) SPITransferByte(0) << 0);
-                Word |= ((uint16_t) SPITransferByte(0) << 8);
+    if (Page == MEMORY_PAGE_NONE) {
+        /* No page waiting in the copy buffer. Program the next pending one. */
+        Page = 0;
 
-                FlashLoadFlashWord(i, Word);
-                FlashWaitForSPM();
-            }
+        while ((Page < MEMORY_PAGE_COUNT) && !PageIsPending(Page))
+            Page++;
+    }
 
-            /* Program flash buffer into flash */
-            FlashEraseWriteApplicationPage(PhysicalAddress);
-            FlashWaitForSPM();
+    StoreAsyncProgramPage(Page);
+}
 
-            PhysicalAddress += APP_SECTION_PAGE_SIZE;
-        }
+INLINE void StoreAsyncFinish(void) {
+    while (StoreAsync.Active) {
+        StoreAsyncStep();
+    }
+}
 
-        /* End read procedure of FRAM */
-        FRAM_PORT.OUTSET = FRAM_CS;
+INLINE void StoreAsyncPrepareWrite(uint16_t Address, uint16_t ByteCount) {
+    /* Protect pages of a running background store from being modified before
+     * they have been programmed into flash */
+    if (!StoreAsync.Active || (ByteCount == 0) || (Address >= MEMORY_SIZE_PER_SETTING))
+        return;
+
+    uint16_t LastAddress = MIN((uint32_t) Address + ByteCount, MEMORY_SIZE_PER_SETTING) - 1;
+
+    for (uint8_t Page = Address / MEMORY_PAGE_SIZE; Page <= LastAddress / MEMORY_PAGE_SIZE; Page++) {
+        if (StoreAsync.Active && PageIsPending(Page) && (Page != StoreAsync.CopyPage)) {
+            if (StoreAsync.CopyPage == MEMORY_PAGE_NONE) {
+                FRAMRead(CopyBuffer, Page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+                StoreAsync.CopyPage = Page;
+            } else {
+                /* Copy buffer is occupied, program this page right away */
+                StoreAsyncProgramPage(Page);
+            }
+        }
     }
 }
 
 void MemoryInit(void) {
-    /* Configure FRAM_USART for SPI master mode 0 with maximum clock frequency */
-    FRAM_PORT.OUTSET = FRAM_CS;
-
-    FRAM_PORT.OUTCLR = FRAM_SCK;
-    FRAM_PORT.OUTSET = FRAM_MOSI;
-
-    FRAM_PORT.DIRSET = FRAM_SCK | FRAM_MOSI | FRAM_CS;
-
-    FRAM_USART.BAUDCTRLA = 0;
-    FRAM_USART.BAUDCTRLB = 0;
-    FRAM_USART.CTRLC = USART_CMODE_MSPI_gc;
-    FRAM_USART.CTRLB = USART_RXEN_bm | USART_TXEN_bm;
-
-    /* Init DMAs for reading and writing */
-    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
-    RECV_DMA.TRIGSRC = DMA_CH_TRIGSRC_USARTD0_RXC_gc;
-    RECV_DMA.TRFCNT = 0;
-    RECV_DMA.SRCADDR0 = ((uintptr_t) &FRAM_USART.DATA >> 0) & 0xFF;
-    RECV_DMA.SRCADDR1 = ((uintptr_t) &FRAM_USART.DATA >> 8) & 0xFF;
-    RECV_DMA.SRCADDR2 = 0;
-    RECV_DMA.DESTADDR0 = 0;
-    RECV_DMA.DESTADDR1 = 0;
-    RECV_DMA.DESTADDR2 = 0;
-    RECV_DMA.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
-
-    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
-    SEND_DMA.TRIGSRC = DMA_CH_TRIGSRC_USARTD0_DRE_gc;
-    SEND_DMA.TRFCNT = 0;
-    SEND_DMA.SRCADDR0 = 0;
-    SEND_DMA.SRCADDR1 = 0;
-    SEND_DMA.SRCADDR2 = 0;
-    SEND_DMA.DESTADDR0 = ((uintptr_t) &FRAM_USART.DATA >> 0) & 0xFF;
-    SEND_DMA.DESTADDR1 = ((uintptr_t) &FRAM_USART.DATA >> 8) & 0xFF;
-    SEND_DMA.DESTADDR2 = 0;
-    SEND_DMA.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+    MemoryBackendInit();
+
+    /* FRAM contents may have been modified without being stored before the last
+     * reset, so consider the whole working copy as changed */
+    memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+
+    CheckSlotTable();
+    CacheInit();
 }
 
 void MemoryReadBlock(void *Buffer, uint16_t Address, uint16_t ByteCount) {
     if (ByteCount == 0)
         return;
-    FRAMRead(Buffer, Address, ByteCount);
+    CachedRead(Buffer, Address, ByteCount);
+}
+
+void MemoryReadBlockAsync(void *Buffer, uint16_t Address, uint16_t ByteCount, MemoryReadCallbackType Callback) {
+    if (ByteCount == 0)
+        return;
+
+    if (CacheReadHit(Buffer, Address, ByteCount)) {
+        /* Completed right away, MemoryReadAvailable() has to tell so as well */
+        FRAMReadAsyncSetComplete(ByteCount);
+
+        if (Callback != NULL)
+            Callback(Buffer, ByteCount);
+
+        return;
+    }
+
+    CacheWriteBack(Address, ByteCount);
+    FRAMReadAsync(Buffer, Address, ByteCount, Callback);
+}
+
+bool MemoryReadPending(void) {
+    return FRAMReadAsyncPending();
+}
+
+uint16_t MemoryReadAvailable(void) {
+    return FRAMReadAsyncAvailable();
+}
+
+void MemoryReadBlockV(const MemoryIoVec *Vec, uint8_t Count) {
+    /* Make the FRAM up to date before, cache lines cannot be written back
+     * while a read transaction is open */
+    for (uint8_t i = 0; i < Count; i++) {
+        CacheWriteBack(Vec[i].Address, Vec[i].ByteCount);
+    }
+
+    FRAMReadV(Vec, Count);
 }
 
 void MemoryReadBlockInSetting(void *Buffer, uint16_t Address, uint16_t ByteCount) {
-    if (ByteCount == 0 || Address >= MEMORY_SIZE_PER_SETTING)
+    /* The active setting is mirrored at the start of the FRAM and limited to its slot */
+    if (ByteCount == 0 || Address >= SlotSize())
         return;
-    uint16_t ActualFRAMAddress = Address + GlobalSettings.ActiveSettingIdx * MEMORY_SIZE_PER_SETTING;
-    FRAMRead(Buffer, ActualFRAMAddress, ByteCount);
+    ByteCount = MIN(ByteCount, SlotSize() - Address);
+    CachedRead(Buffer, Address, ByteCount);
 }
 
 void MemoryWriteBlock(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
     if (ByteCount == 0)
         return;
-    FRAMWrite(Buffer, Address, ByteCount);
+    StoreAsyncPrepareWrite(Address, ByteCount);
+    CachedWrite(Buffer, Address, ByteCount);
+    MarkPagesDirty(Address, ByteCount);
+
+    MemoryChangedHook();
+}
+
+void MemoryWriteBlockV(const MemoryIoVec *Vec, uint8_t Count) {
+    for (uint8_t i = 0; i < Count; i++) {
+        if (Vec[i].ByteCount > 0)
+            StoreAsyncPrepareWrite(Vec[i].Address, Vec[i].ByteCount);
+    }
+
+    FRAMWriteV(Vec, Count);
+
+    for (uint8_t i = 0; i < Count; i++) {
+        if (Vec[i].ByteCount > 0) {
+            CacheUpdate(Vec[i].Buffer, Vec[i].Address, Vec[i].ByteCount);
+            MarkPagesDirty(Vec[i].Address, Vec[i].ByteCount);
+        }
+    }
+
+    MemoryChangedHook();
+}
+
+void MemoryWriteBlockAsync(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    if (ByteCount == 0)
+        return;
+
+    StoreAsyncPrepareWrite(Address, ByteCount);
+    /* Cached lines take the new data right away, the FRAM gets it by DMA */
+    CacheUpdate(Buffer, Address, ByteCount);
+    MarkPagesDirty(Address, ByteCount);
+    FRAMWriteAsync(Buffer, Address, ByteCount);
 
-    LEDHook(LED_MEMORY_CHANGED, LED_ON);
+    MemoryChangedHook();
+}
+
+bool MemoryWritePending(void) {
+    return FRAMReadAsyncPending();
 }
 
 void MemoryWriteBlockInSetting(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
-    if (ByteCount == 0 || Address >= MEMORY_SIZE_PER_SETTING)
+    if (ByteCount == 0 || Address >= SlotSize())
         return;
-    uint16_t ActualFRAMAddress = Address + GlobalSettings.ActiveSettingIdx * MEMORY_SIZE_PER_SETTING;
-    FRAMWrite(Buffer, ActualFRAMAddress, ByteCount);
-    LEDHook(LED_MEMORY_CHANGED, LED_ON);
+    ByteCount = MIN(ByteCount, SlotSize() - Address);
+    StoreAsyncPrepareWrite(Address, ByteCount);
+    CachedWrite(Buffer, Address, ByteCount);
+    MarkPagesDirty(Address, ByteCount);
+    MemoryChangedHook();
 }
 
 void MemoryClear(void) {
-    FlashErase((uint32_t) GlobalSettings.ActiveSettingIdx * MEMORY_SIZE_PER_SETTING, MEMORY_SIZE_PER_SETTING);
+    StoreAsyncFinish();
 
-    MemoryRecall();
-}
+    if (!SlotIsPending() && (SlotFlashSize() == SlotSize())) {
+        FlashErase(SlotAddress(), SlotSize());
 
-void MemoryRecall(void) {
-    /* Recall memory from permanent flash */
-    FlashToFRAM((uint32_t) GlobalSettings.ActiveSettingIdx * MEMORY_SIZE_PER_SETTING, MEMORY_SIZE_PER_SETTING);
+        MemoryRecall();
+    } else {
+        /* Fill the working copy like erased flash and store it compressed */
+        memset(MemoryPageBuffer[0], 0xFF, MEMORY_PAGE_SIZE);
 
-    SystemTickClearFlag();
+        for (uint16_t Address = 0; Address < SlotSize(); Address += MEMORY_PAGE_SIZE) {
+            FRAMWrite(MemoryPageBuffer[0], Address, MEMORY_PAGE_SIZE);
+        }
+
+        CacheInvalidate();
+        memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+        MemoryStore();
+    }
 }
 
-void MemoryStore(void) {
-    /* Store current memory into permanent flash */
-    FRAMToFlash((uint32_t) GlobalSettings.ActiveSettingIdx * MEMORY_SIZE_PER_SETTING, MEMORY_SIZE_PER_SETTING);
+void MemoryRecall(void) {
+    const MemorySlotType *Slot;
 
-    LEDHook(LED_MEMORY_CHANGED, LED_OFF);
-    LEDHook(LED_MEMORY_STORED, LED_PULSE);
+    /* A background store has to complete before the working copy is replaced */
+    StoreAsyncFinish();
 
-    SystemTickClearFlag();
-}
+    /* Recall memory from permanent flash, where the table tells */
+    Slot = &SlotTable()[SlotActiveIdx()];
 
-bool MemoryUploadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
-    if (BlockAddress >= MEMORY_SIZE_PER_SETTING) {
-        /* Prevent writing out of bounds by silently ignoring it */
-        return true;
+    if (Slot->FlashSize < Slot->Size) {
+        CompressedRecall(Slot);
     } else {
-        /* Calculate bytes left in memory and start writing */
-        uint32_t BytesLeft = MEMORY_SIZE_PER_SETTING - BlockAddress;
-        ByteCount = MIN(ByteCount, BytesLeft);
+        FlashToFRAM(Slot->Offset, Slot->Size, MemoryPageBuffer);
+    }
 
-        /* Store to local memory */
-        FRAMWrite(Buffer, BlockAddress, ByteCount);
+    if (SlotIsPending()) {
+        /* Not stored in the pending layout yet. Memory beyond the stored
+         * contents starts out cleared like a new allocation. */
+        memset(MemoryPageBuffer[0], MEMORY_INIT_VALUE, MEMORY_PAGE_SIZE);
 
-        return true;
+        for (uint16_t Address = Slot->Size; Address < SlotSize(); Address += MEMORY_PAGE_SIZE) {
+            FRAMWrite(MemoryPageBuffer[0], Address, MEMORY_PAGE_SIZE);
+        }
+
+        memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+    } else {
+        ClearDirtyPages();
     }
+
+    CacheInvalidate();
+
+    MemoryTickClearFlag();
 }
 
-bool MemoryDownloadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
-    if (BlockAddress >= MEMORY_SIZE_PER_SETTING) {
-        /* There are bytes out of bounds to be read. Notify that we are done. */
+bool MemoryStore(void) {
+    uint32_t SettingAddress;
+    uint8_t PageCount = SlotPageCount();
+    uint8_t Page = 0;
+    bool Dirty = false;
+
+    /* Complete a running background store first, it might hold older data */
+    StoreAsyncFinish();
+    CacheFlush();
+
+    for (uint8_t i = 0; i < PageCount; i++) {
+        Dirty |= PageIsDirty(i);
+    }
+
+#ifdef MEMORY_COMPRESSION
+    if (Dirty && CompressedStore()) {
+        /* All pages have been taken care of by the compressed store */
+        Page = PageCount;
+    }
+#endif
+
+    if ((Page < PageCount) && Dirty && !SlotResize(SlotSize())) {
+        /* Not enough flash left for the uncompressed contents. The pages stay
+         * dirty and the slot keeps its previous contents. */
         return false;
-    } else {
-        /* Calculate bytes left in memory and issue reading */
-        uint32_t BytesLeft = MEMORY_SIZE_PER_SETTING - BlockAddress;
-        ByteCount = MIN(ByteCount, BytesLeft);
+    }
 
-        /* Output local memory contents */
-        FRAMRead(Buffer, BlockAddress, ByteCount);
+    SettingAddress = SlotAddress();
 
-        return true;
+    /* Store current memory into permanent flash. Consecutive dirty pages are
+     * programmed in one go, clean pages are left untouched. */
+    while (Page < PageCount) {
+        if (PageIsDirty(Page)) {
+            uint8_t FirstPage = Page;
+
+            while ((Page < PageCount) && PageIsDirty(Page))
+                Page++;
+
+            FRAMToFlash(SettingAddress + (uint32_t) FirstPage * MEMORY_PAGE_SIZE,
+                        FirstPage * MEMORY_PAGE_SIZE, (Page - FirstPage) * MEMORY_PAGE_SIZE, MemoryPageBuffer);
+            MemoryStats.PagesWritten += Page - FirstPage;
+        } else {
+            MemoryStats.PagesSkipped++;
+            Page++;
+        }
     }
-}
 
-// EEPROM functions
+    ClearDirtyPages();
+    SlotCommit();
+
+    MemoryStoredHook();
 
-static inline void NVM_EXEC(void) {
-    void *z = (void *)&NVM_CTRLA;
+    MemoryTickClearFlag();
 
-    __asm__ volatile("out %[ccp], %[ioreg]"  "\n\t"
-                     "st z, %[cmdex]"
-                     :
-                     : [ccp] "I"(_SFR_IO_ADDR(CCP)),
-                     [ioreg] "d"(CCP_IOREG_gc),
-                     [cmdex] "r"(NVM_CMDEX_bm),
-                     [z] "z"(z)
-                    );
+    return true;
 }
 
-void WaitForNVM(void) {
-    while (NVM.STATUS & NVM_NVMBUSY_bm) { };
+void MemoryBenchmark(uint16_t *StoreTicks, uint16_t *RecallTicks) {
+    uint16_t StartTick;
+
+    /* Measure a full store of the working copy followed by a recall. Storing
+     * first makes sure that no modifications of the working copy are lost. */
+    StoreAsyncFinish();
+    memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+
+    StartTick = MemoryGetTick();
+    MemoryStore();
+    *StoreTicks = MemoryGetTick() - StartTick;
+
+    StartTick = MemoryGetTick();
+    MemoryRecall();
+    *RecallTicks = MemoryGetTick() - StartTick;
 }
 
-void FlushNVMBuffer(void) {
-    WaitForNVM();
+bool MemoryAllocateSetting(uint16_t ByteCount) {
+    MemorySlotType *Slot = SlotActive();
+    uint32_t Offset;
+    uint16_t Size;
+
+    if (ByteCount > MEMORY_SIZE_PER_SETTING)
+        return false;
+
+    /* Slots consist of whole flash pages */
+    Size = (ByteCount + MEMORY_PAGE_SIZE - 1) & ~(MEMORY_PAGE_SIZE - 1);
+
+    if (Size == Slot->Size)
+        return true;
+
+    StoreAsyncFinish();
+
+    if (!SlotFindSpace(Size, &Offset))
+        return false;
+
+    if (Slot->Size == 0) {
+        /* Newly allocated slots start out with cleared memory */
+        memset(MemoryPageBuffer[0], MEMORY_INIT_VALUE, MEMORY_PAGE_SIZE);
 
-    if ((NVM.STATUS & NVM_EELOAD_bm) != 0) {
-        NVM.CMD = NVM_CMD_ERASE_EEPROM_BUFFER_gc;
-        NVM_EXEC();
+        for (uint16_t Address = 0; Address < Size; Address += MEMORY_PAGE_SIZE) {
+            FRAMWrite(MemoryPageBuffer[0], Address, MEMORY_PAGE_SIZE);
+        }
+
+        CacheInvalidate();
+        memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
+    } else if ((Offset != Slot->Offset) || (Size > Slot->FlashSize) || (Slot->FlashSize != Slot->Size)) {
+        /* The working copy has to be written to the new location completely */
+        memset(DirtyPageMap, 0xFF, sizeof(DirtyPageMap));
     }
+
+    /* New allocations are uncompressed until the next store, which also
+     * commits them to the table. Until then, the flash keeps the contents of
+     * the previous allocation. */
+    Slot = SlotChange();
+    Slot->Offset = Offset;
+    Slot->Size = Size;
+    Slot->FlashSize = Size;
+
+    return true;
+}
+
+uint16_t MemoryGetSettingSize(void) {
+    return SlotSize();
 }
 
-uint16_t ReadEEPBlock(uint16_t Address, void *DestPtr, uint16_t ByteCount) {
-    uint16_t BytesRead = 0;
-    uint8_t *BytePtr = (uint8_t *) DestPtr;
-    NVM.ADDR2 = 0;
+bool MemoryCachePin(uint16_t Address, uint16_t ByteCount) {
+#ifdef MEMORY_CACHE
+    /* Keep the lines of this range in the cache until they are unpinned. At
+     * least one way of every set stays available for the remaining accesses. */
+    uint16_t LastTag;
+
+    if ((ByteCount == 0) || ((uint32_t) Address + ByteCount > MEMORY_SIZE_PER_SETTING))
+        return false;
+
+    LastTag = ((uint32_t) Address + ByteCount - 1) / MEMORY_CACHE_LINE_SIZE;
+
+    for (uint16_t Tag = Address / MEMORY_CACHE_LINE_SIZE; Tag <= LastTag; Tag++) {
+        CacheLineType *Line = CacheFind(Tag);
+        CacheLineType *Set = Cache[Tag % MEMORY_CACHE_SETS];
+        uint8_t PinnedWays = 0;
 
-    WaitForNVM();
+        if ((Line != NULL) && (Line->Flags & CACHE_LINE_PINNED))
+            continue;
 
-    while (ByteCount > 0) {
-        NVM.ADDR0 = Address & 0xFF;
-        NVM.ADDR1 = (Address >> 8) & 0x1F;
+        for (uint8_t Way = 0; Way < MEMORY_CACHE_WAYS; Way++) {
+            if (Set[Way].Flags & CACHE_LINE_PINNED)
+                PinnedWays++;
+        }
 
-        NVM.CMD = NVM_CMD_READ_EEPROM_gc;
-        NVM_EXEC();
+        if (PinnedWays >= MEMORY_CACHE_WAYS - 1)
+            return false;
 
-        *BytePtr++ = NVM.DATA0;
-        Address++;
+        if (Line == NULL)
+            Line = CacheAllocate(Tag, true);
 
-        ByteCount--;
-        BytesRead++;
+        Line->Flags |= CACHE_LINE_PINNED;
     }
 
-    return BytesRead;
+    return true;
+#else
+    return false;
+#endif
 }
 
+void MemoryCacheUnpin(uint16_t Address, uint16_t ByteCount) {
+#ifdef MEMORY_CACHE
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        CacheLineType *Line = &Cache[0][0] + i;
 
-uint16_t WriteEEPBlock(uint16_t Address, const void *SrcPtr, uint16_t ByteCount) {
-    const uint8_t *BytePtr = (const uint8_t *) SrcPtr;
-    uint8_t ByteAddress = Address % EEPROM_PAGE_SIZE;
-    uint16_t PageAddress = Address - ByteAddress;
-    uint16_t BytesWritten = 0;
-
-    FlushNVMBuffer();
-    WaitForNVM();
-    NVM.CMD = NVM_CMD_LOAD_EEPROM_BUFFER_gc;
+        if (CacheLineOverlaps(Line, Address, ByteCount))
+            Line->Flags &= ~CACHE_LINE_PINNED;
+    }
+#endif
+}
 
-    NVM.ADDR1 = 0;
-    NVM.ADDR2 = 0;
+void MemoryCacheUnpinAll(void) {
+#ifdef MEMORY_CACHE
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        (&Cache[0][0] + i)->Flags &= ~CACHE_LINE_PINNED;
+    }
+#endif
+}
 
-    while (ByteCount > 0) {
-        NVM.ADDR0 = ByteAddress;
+uint8_t MemoryCachePinnedLines(void) {
+    uint8_t PinnedLines = 0;
 
-        NVM.DATA0 = *BytePtr++;
+#ifdef MEMORY_CACHE
+    for (uint8_t i = 0; i < MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS; i++) {
+        if ((&Cache[0][0] + i)->Flags & CACHE_LINE_PINNED)
+            PinnedLines++;
+    }
+#endif
 
-        ByteAddress++;
-        ByteCount--;
+    return PinnedLines;
+}
 
-        if (ByteCount == 0 || ByteAddress >= EEPROM_PAGE_SIZE) {
-            NVM.ADDR0 = PageAddress & 0xFF;
-            NVM.ADDR1 = (PageAddress >> 8) & 0x1F;
+bool MemoryStoreAsync(void) {
+    bool Compressed = (SlotFlashSize() != SlotSize());
 
-            NVM.CMD = NVM_CMD_ERASE_WRITE_EEPROM_PAGE_gc;
-            NVM_EXEC();
+    if (StoreAsync.Active)
+        return false;
 
-            PageAddress += EEPROM_PAGE_SIZE;
-            ByteAddress = 0;
+#ifdef MEMORY_COMPRESSION
+    Compressed = true;
+#endif
 
-            WaitForNVM();
+    if (Compressed) {
+        /* Compressed slots are encoded as a whole and stored in one go */
+        return MemoryStore();
+    }
 
-            NVM.CMD = NVM_CMD_LOAD_EEPROM_BUFFER_gc;
+    /* The background store programs flash from the FRAM contents */
+    CacheFlush();
+
+    StoreAsync.SettingAddress = SlotAddress();
+    StoreAsync.PagesTotal = 0;
+    StoreAsync.PagesDone = 0;
+    StoreAsync.CopyPage = MEMORY_PAGE_NONE;
+
+    /* Take over the set of dirty pages. Pages written from now on are dirty
+     * again with respect to this store. */
+    memcpy(StoreAsync.PageMap, DirtyPageMap, sizeof(StoreAsync.PageMap));
+    ClearDirtyPages();
+
+    for (uint8_t Page = 0; Page < MEMORY_PAGE_COUNT; Page++) {
+        if (Page >= SlotPageCount()) {
+            /* Outside of the slot of this setting */
+            StoreAsync.PageMap[Page / 8] &= ~(1 << (Page % 8));
+        } else if (PageIsPending(Page)) {
+            StoreAsync.PagesTotal++;
+        } else {
+            MemoryStats.PagesSkipped++;
         }
+    }
+
+    if (StoreAsync.PagesTotal > 0) {
+        StoreAsync.Active = true;
+    } else {
+        SlotCommit();
+        MemoryStoredHook();
+    }
+
+    return true;
+}
+
+bool MemoryStoreAsyncProgress(uint8_t *PagesDone, uint8_t *PagesTotal) {
+    *PagesDone = StoreAsync.PagesDone;
+    *PagesTotal = StoreAsync.PagesTotal;
+
+    return StoreAsync.Active;
+}
+
+void MemoryTask(void) {
+    /* Program at most one flash page per call to keep the main loop running */
+    if (StoreAsync.Active) {
+        StoreAsyncStep();
+    }
+}
+
+bool MemoryUploadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
+    if (BlockAddress >= SlotSize()) {
+        /* Prevent writing out of bounds by silently ignoring it */
+        return true;
+    } else {
+        /* Calculate bytes left in memory and start writing */
+        uint32_t BytesLeft = SlotSize() - BlockAddress;
+        ByteCount = MIN(ByteCount, BytesLeft);
 
-        BytesWritten++;
+        /* Store to local memory */
+        StoreAsyncPrepareWrite(BlockAddress, ByteCount);
+        CachedWrite(Buffer, BlockAddress, ByteCount);
+        MarkPagesDirty(BlockAddress, ByteCount);
+
+        return true;
     }
+}
+
+bool MemoryDownloadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount) {
+    if (BlockAddress >= SlotSize()) {
+        /* There are bytes out of bounds to be read. Notify that we are done. */
+        return false;
+    } else {
+        /* Calculate bytes left in memory and issue reading */
+        uint32_t BytesLeft = SlotSize() - BlockAddress;
+        ByteCount = MIN(ByteCount, BytesLeft);
+
+        /* Output local memory contents */
+        CachedRead(Buffer, BlockAddress, ByteCount);
 
-    return BytesWritten;
+        return true;
+    }
 }
@@ -12,18 +12,95 @@
 #define MEMORY_INIT_VALUE			0x00
 #define MEMORY_SIZE_PER_SETTING		8192
 
+/* SRAM cache for the working copy in FRAM, enabled from the makefile */
+#ifdef MEMORY_CACHE
+#ifndef MEMORY_CACHE_SETS
+#define MEMORY_CACHE_SETS			8
+#endif
+#ifndef MEMORY_CACHE_WAYS
+#define MEMORY_CACHE_WAYS			2
+#endif
+#define MEMORY_CACHE_LINE_SIZE		16
+#endif
+
 #ifndef __ASSEMBLER__
+#ifdef MEMORY_BACKEND_HOST
+#include <stdint.h>
+#include <stdbool.h>
+#else
 #include "Common.h"
+#endif
+
+/** Location of the permanent copy of a setting's memory inside the flash data area.
+ *
+ * \note Slots are allocated in multiples of the flash page size. A size of zero means that no flash
+ * memory is reserved for this setting.
+ */
+typedef struct {
+    uint16_t Offset; /// Offset into the flash data area in bytes.
+    uint16_t Size; /// Size of the slot in bytes.
+    uint16_t FlashSize; /// Flash memory occupied by the slot in bytes. Less than Size if the contents are stored compressed.
+} MemorySlotType;
+
+typedef struct {
+    uint32_t PagesWritten; /* Flash pages reprogrammed by MemoryStore() */
+    uint32_t PagesSkipped; /* Unchanged flash pages skipped by MemoryStore() */
+} MemoryStatsType;
+
+extern MemoryStatsType MemoryStats;
+
+typedef struct {
+    uint32_t Hits; /* Cache lines accessed without FRAM transfer */
+    uint32_t Misses; /* Cache lines that had to be allocated */
+    uint32_t Evictions; /* Valid cache lines replaced by others */
+} MemoryCacheStatsType;
+
+extern MemoryCacheStatsType MemoryCacheStats;
+
+/* One range of a scatter-gather transfer. Ranges are processed in order, and
+ * consecutive ones that are adjacent in memory share a single FRAM access. */
+typedef struct {
+    void *Buffer;
+    uint16_t Address;
+    uint16_t ByteCount;
+} MemoryIoVec;
+
+/* Called as soon as an asynchronous read has completed */
+typedef void (*MemoryReadCallbackType)(void *Buffer, uint16_t ByteCount);
 
 void MemoryInit(void);
 void MemoryReadBlock(void *Buffer, uint16_t Address, uint16_t ByteCount);
 void MemoryReadBlockInSetting(void *Buffer, uint16_t Address, uint16_t ByteCount);
+void MemoryReadBlockV(const MemoryIoVec *Vec, uint8_t Count);
+void MemoryReadBlockAsync(void *Buffer, uint16_t Address, uint16_t ByteCount, MemoryReadCallbackType Callback);
+bool MemoryReadPending(void);
+uint16_t MemoryReadAvailable(void);
 void MemoryWriteBlock(const void *Buffer, uint16_t Address, uint16_t ByteCount);
 void MemoryWriteBlockInSetting(const void *Buffer, uint16_t Address, uint16_t ByteCount);
+void MemoryWriteBlockV(const MemoryIoVec *Vec, uint8_t Count);
+/* Buffer has to stay untouched while MemoryWritePending() */
+void MemoryWriteBlockAsync(const void *Buffer, uint16_t Address, uint16_t ByteCount);
+bool MemoryWritePending(void);
 void MemoryClear(void);
 
+/* Flash slot of the active setting */
+bool MemoryAllocateSetting(uint16_t ByteCount);
+uint16_t MemoryGetSettingSize(void);
+
+/* Keep regions that are accessed on nearly every command in the cache */
+bool MemoryCachePin(uint16_t Address, uint16_t ByteCount);
+void MemoryCacheUnpin(uint16_t Address, uint16_t ByteCount);
+void MemoryCacheUnpinAll(void);
+uint8_t MemoryCachePinnedLines(void);
+
 void MemoryRecall(void);
-void MemoryStore(void);
+bool MemoryStore(void); /* False if the flash has no room for the setting, which then keeps its previous contents */
+void MemoryBenchmark(uint16_t *StoreTicks, uint16_t *RecallTicks);
+
+/* Background store, programming one flash page per MemoryTask() call */
+bool MemoryStoreAsync(void);
+bool MemoryStoreAsyncProgress(uint8_t *PagesDone, uint8_t *PagesTotal);
+void MemoryTask(void);
 
 /* For use with XModem */
 bool MemoryUploadBlock(void *Buffer, uint32_t BlockAddress, uint16_t ByteCount);
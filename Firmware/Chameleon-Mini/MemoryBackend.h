@@ -0,0 +1,92 @@
+/*
+ * MemoryBackend.h
+ *
+ * Storage primitives below Memory.c. The device backend drives the FRAM over
+ * SPI/DMA and programs flash and EEPROM through the NVM controller, the host
+ * backend models all three in a memory mapped file. Everything Memory.c needs
+ * from the rest of the firmware (the slot table in the settings, the LEDs and
+ * the system tick) is reached through here as well, so that Memory.c builds
+ * on a host without any AVR headers.
+ */
+
+#ifndef MEMORY_BACKEND_H_
+#define MEMORY_BACKEND_H_
+
+#include "Memory.h"
+
+#ifdef MEMORY_BACKEND_HOST
+#define MEMORY_FLASH_PAGE_SIZE		256
+
+#ifdef SETTINGS_COUNT
+#define MEMORY_SLOT_COUNT			SETTINGS_COUNT
+#else
+#define MEMORY_SLOT_COUNT			(MEMORY_SIZE / MEMORY_SIZE_PER_SETTING)
+#endif
+
+#define INLINE						static inline
+#define MIN(x,y) ( (x) < (y) ? (x) : (y) )
+#define MAX(x,y) ( (x) > (y) ? (x) : (y) )
+
+/* Separate object, see MemoryBackendHost.c */
+#define BACKEND_INLINE
+#define BACKEND_STATIC
+#else
+#include "Settings.h"
+
+#define MEMORY_FLASH_PAGE_SIZE		APP_SECTION_PAGE_SIZE
+#define MEMORY_SLOT_COUNT			SETTINGS_COUNT
+
+/* Compiled into Memory.c, see MemoryBackendXMEGAInclude.c */
+#define BACKEND_INLINE				INLINE
+#define BACKEND_STATIC				static
+#endif
+
+/* Scratch buffers of Memory.c. Flash transfers use both of them to overlap
+ * flash accesses with FRAM DMA transfers. */
+typedef uint8_t MemoryPageBufferType[2][MEMORY_FLASH_PAGE_SIZE];
+
+BACKEND_STATIC void MemoryBackendInit(void);
+
+/* FRAM. The working copy of the active setting starts at address 0. */
+BACKEND_INLINE void FRAMRead(void *Buffer, uint16_t Address, uint16_t ByteCount);
+BACKEND_INLINE void FRAMWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount);
+BACKEND_STATIC void FRAMReadV(const MemoryIoVec *Vec, uint8_t Count);
+BACKEND_STATIC void FRAMWriteV(const MemoryIoVec *Vec, uint8_t Count);
+BACKEND_STATIC void FRAMReadAsync(void *Buffer, uint16_t Address, uint16_t ByteCount, MemoryReadCallbackType Callback);
+BACKEND_STATIC void FRAMWriteAsync(const void *Buffer, uint16_t Address, uint16_t ByteCount);
+/* Also covers FRAMWriteAsync() */
+BACKEND_STATIC bool FRAMReadAsyncPending(void);
+BACKEND_STATIC uint16_t FRAMReadAsyncAvailable(void);
+/* Ends any pending transfer and makes FRAMReadAsyncAvailable() return ByteCount,
+ * for an asynchronous read which has been served without the FRAM */
+BACKEND_STATIC void FRAMReadAsyncSetComplete(uint16_t ByteCount);
+
+/* Flash data section. Addresses are relative to its start, writes and erases
+ * cover whole pages. */
+BACKEND_INLINE void FlashRead(void *Buffer, uint32_t Address, uint16_t ByteCount);
+BACKEND_INLINE uint8_t FlashReadByte(uint32_t Address);
+BACKEND_STATIC void FlashWrite(const void *Buffer, uint32_t Address, uint16_t ByteCount);
+BACKEND_STATIC void FlashErase(uint32_t Address, uint16_t ByteCount);
+BACKEND_STATIC void FlashToFRAM(uint32_t Address, uint16_t ByteCount, MemoryPageBufferType PageBuffer);
+BACKEND_STATIC void FRAMToFlash(uint32_t Address, uint16_t FRAMAddress, uint16_t ByteCount, MemoryPageBufferType PageBuffer);
+
+/* Flash allocation table with MEMORY_SLOT_COUNT entries. SlotTableSave()
+ * makes changes to the given entries permanent. */
+BACKEND_INLINE MemorySlotType *SlotTable(void);
+BACKEND_INLINE uint8_t SlotActiveIdx(void);
+BACKEND_INLINE void SlotTableSave(uint8_t First, uint8_t Count);
+
+/* Signal modifications of the working copy and their storage to the user */
+BACKEND_INLINE void MemoryChangedHook(void);
+BACKEND_INLINE void MemoryStoredHook(void);
+
+/* System tick for benchmarks, and resynchronisation after blocking for long */
+BACKEND_INLINE uint16_t MemoryGetTick(void);
+BACKEND_INLINE void MemoryTickClearFlag(void);
+
+#ifdef MEMORY_BACKEND_HOST
+/* Switch the active slot, which is done by the settings on the device */
+void MemoryBackendSelectSlot(uint8_t SlotIdx);
+#endif
+
+#endif /* MEMORY_BACKEND_H_ */
@@ -0,0 +1,213 @@
+/*
+ * MemoryBackendHost.c
+ *
+ * Memory backend for running the memory logic on a host. FRAM, flash data
+ * section and EEPROM are modelled by one file, which is mapped into memory
+ * and thus keeps its contents between runs like the real memories do. The
+ * file is taken from CHAMELEON_MEMORY_FILE, built with -DMEMORY_BACKEND_HOST.
+ * The slot table is kept at the start of the modelled EEPROM.
+ */
+
+#ifdef MEMORY_BACKEND_HOST
+
+#include "MemoryBackend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#ifndef FLASH_DATA_SIZE
+#define FLASH_DATA_SIZE		0x10000
+#endif
+
+#define HOST_FRAM_SIZE		0x8000
+#define HOST_EEPROM_SIZE	0x800
+#define HOST_FILE_SIZE		(HOST_FRAM_SIZE + FLASH_DATA_SIZE + HOST_EEPROM_SIZE)
+#define HOST_FILE_DEFAULT	"Chameleon-Mini.mem"
+
+static uint8_t *FRAM = NULL;
+static uint8_t *Flash = NULL;
+static uint8_t *EEPROM = NULL;
+
+static uint16_t ReadAsyncByteCount = 0;
+
+static MemorySlotType Slots[MEMORY_SLOT_COUNT];
+static uint8_t ActiveSlotIdx = 0;
+
+/* Limit accesses to the modelled memories like the sanity checks of the device */
+static uint32_t Clip(uint32_t Address, uint32_t ByteCount, uint32_t Size) {
+    if (Address >= Size)
+        return 0;
+
+    return (ByteCount < Size - Address) ? ByteCount : Size - Address;
+}
+
+void MemoryBackendInit(void) {
+    const char *Path = getenv("CHAMELEON_MEMORY_FILE");
+    struct stat Stat;
+    uint8_t *Map;
+    int File;
+
+    if (FRAM != NULL)
+        return;
+
+    if (Path == NULL)
+        Path = HOST_FILE_DEFAULT;
+
+    File = open(Path, O_RDWR | O_CREAT, 0644);
+
+    if ((File < 0) || (fstat(File, &Stat) < 0) || (ftruncate(File, HOST_FILE_SIZE) < 0)) {
+        perror(Path);
+        exit(EXIT_FAILURE);
+    }
+
+    Map = mmap(NULL, HOST_FILE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, File, 0);
+    close(File);
+
+    if (Map == MAP_FAILED) {
+        perror(Path);
+        exit(EXIT_FAILURE);
+    }
+
+    FRAM = Map;
+    Flash = FRAM + HOST_FRAM_SIZE;
+    EEPROM = Flash + FLASH_DATA_SIZE;
+
+    if (Stat.st_size == 0) {
+        /* New file, start out with erased flash and EEPROM */
+        memset(Flash, 0xFF, FLASH_DATA_SIZE + HOST_EEPROM_SIZE);
+    }
+
+    memcpy(Slots, EEPROM, sizeof(Slots));
+}
+
+void FRAMRead(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    memcpy(Buffer, &FRAM[Address], Clip(Address, ByteCount, HOST_FRAM_SIZE));
+}
+
+void FRAMWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    memcpy(&FRAM[Address], Buffer, Clip(Address, ByteCount, HOST_FRAM_SIZE));
+}
+
+void FRAMReadV(const MemoryIoVec *Vec, uint8_t Count) {
+    for (uint8_t i = 0; i < Count; i++) {
+        FRAMRead(Vec[i].Buffer, Vec[i].Address, Vec[i].ByteCount);
+    }
+}
+
+void FRAMWriteV(const MemoryIoVec *Vec, uint8_t Count) {
+    for (uint8_t i = 0; i < Count; i++) {
+        FRAMWrite(Vec[i].Buffer, Vec[i].Address, Vec[i].ByteCount);
+    }
+}
+
+void FRAMReadAsync(void *Buffer, uint16_t Address, uint16_t ByteCount, MemoryReadCallbackType Callback) {
+    /* There is nothing to overlap with, complete right away */
+    FRAMRead(Buffer, Address, ByteCount);
+    ReadAsyncByteCount = ByteCount;
+
+    if (Callback != NULL)
+        Callback(Buffer, ByteCount);
+}
+
+void FRAMWriteAsync(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    /* Shares the byte count with reads like the device backend does */
+    FRAMWrite(Buffer, Address, ByteCount);
+    ReadAsyncByteCount = ByteCount;
+}
+
+bool FRAMReadAsyncPending(void) {
+    return false;
+}
+
+void FRAMReadAsyncSetComplete(uint16_t ByteCount) {
+    ReadAsyncByteCount = ByteCount;
+}
+
+uint16_t FRAMReadAsyncAvailable(void) {
+    return ReadAsyncByteCount;
+}
+
+void FlashRead(void *Buffer, uint32_t Address, uint16_t ByteCount) {
+    memcpy(Buffer, &Flash[Address], Clip(Address, ByteCount, FLASH_DATA_SIZE));
+}
+
+uint8_t FlashReadByte(uint32_t Address) {
+    return (Address < FLASH_DATA_SIZE) ? Flash[Address] : 0xFF;
+}
+
+void FlashWrite(const void *Buffer, uint32_t Address, uint16_t ByteCount) {
+    /* Only full pages are programmed, as on the device */
+    ByteCount -= ByteCount % MEMORY_FLASH_PAGE_SIZE;
+    memcpy(&Flash[Address], Buffer, Clip(Address, ByteCount, FLASH_DATA_SIZE));
+}
+
+void FlashErase(uint32_t Address, uint16_t ByteCount) {
+    ByteCount -= ByteCount % MEMORY_FLASH_PAGE_SIZE;
+    memset(&Flash[Address], 0xFF, Clip(Address, ByteCount, FLASH_DATA_SIZE));
+}
+
+void FlashToFRAM(uint32_t Address, uint16_t ByteCount, MemoryPageBufferType PageBuffer) {
+    ByteCount = Clip(Address, ByteCount, FLASH_DATA_SIZE);
+    memcpy(FRAM, &Flash[Address], Clip(0, ByteCount, HOST_FRAM_SIZE));
+}
+
+void FRAMToFlash(uint32_t Address, uint16_t FRAMAddress, uint16_t ByteCount, MemoryPageBufferType PageBuffer) {
+    ByteCount -= ByteCount % MEMORY_FLASH_PAGE_SIZE;
+    ByteCount = Clip(FRAMAddress, ByteCount, HOST_FRAM_SIZE);
+    memcpy(&Flash[Address], &FRAM[FRAMAddress], Clip(Address, ByteCount, FLASH_DATA_SIZE));
+}
+
+MemorySlotType *SlotTable(void) {
+    return Slots;
+}
+
+uint8_t SlotActiveIdx(void) {
+    return ActiveSlotIdx;
+}
+
+void SlotTableSave(uint8_t First, uint8_t Count) {
+    memcpy(&EEPROM[First * sizeof(MemorySlotType)], &Slots[First], Count * sizeof(MemorySlotType));
+}
+
+void MemoryBackendSelectSlot(uint8_t SlotIdx) {
+    ActiveSlotIdx = SlotIdx;
+}
+
+void MemoryChangedHook(void) {
+}
+
+void MemoryStoredHook(void) {
+}
+
+uint16_t MemoryGetTick(void) {
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+
+    return Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+}
+
+void MemoryTickClearFlag(void) {
+}
+
+uint16_t ReadEEPBlock(uint16_t Address, void *DestPtr, uint16_t ByteCount) {
+    ByteCount = Clip(Address, ByteCount, HOST_EEPROM_SIZE);
+    memcpy(DestPtr, &EEPROM[Address], ByteCount);
+
+    return ByteCount;
+}
+
+uint16_t WriteEEPBlock(uint16_t Address, const void *SrcPtr, uint16_t ByteCount) {
+    ByteCount = Clip(Address, ByteCount, HOST_EEPROM_SIZE);
+    memcpy(&EEPROM[Address], SrcPtr, ByteCount);
+
+    return ByteCount;
+}
+
+#endif /* MEMORY_BACKEND_HOST */
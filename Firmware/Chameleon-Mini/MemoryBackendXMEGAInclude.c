@@ -0,0 +1,724 @@
+/*
+ * MemoryBackendXMEGAInclude.c
+ *
+ * FRAM on USARTD0 in SPI master mode with DMA, flash and EEPROM of the
+ * ATxmega. Included by Memory.c instead of being built on its own, so that
+ * the FRAM and flash primitives can be inlined into their callers.
+ */
+
+#include "MemoryBackend.h"
+#include "Common.h"
+#include "Settings.h"
+#include "LEDHook.h"
+#include "System.h"
+
+#define USE_DMA
+#define RECV_DMA DMA.CH0
+#define SEND_DMA DMA.CH1
+
+/* Convert defines from Makefile */
+#define FLASH_DATA_START		FLASH_DATA_ADDR
+#define FLASH_DATA_END			(FLASH_DATA_ADDR + FLASH_DATA_SIZE - 1)
+
+/* Definitions for FRAM */
+#define FRAM_USART	USARTD0
+#define FRAM_PORT	PORTD
+#define FRAM_CS		PIN4_bm
+#define FRAM_MOSI	PIN3_bm
+#define FRAM_MISO	PIN2_bm
+#define FRAM_SCK	PIN1_bm
+
+/* Declarations from assembler file */
+uint16_t FlashReadWord(uint32_t Address);
+void FlashEraseApplicationPage(uint32_t Address);
+void FlashLoadFlashWord(uint16_t Address, uint16_t Data);
+void FlashEraseWriteApplicationPage(uint32_t Address);
+void FlashEraseFlashBuffer(void);
+void FlashWaitForSPM(void);
+
+
+static uint8_t ScrapBuffer[] = {0};
+
+INLINE uint8_t SPITransferByte(uint8_t Data) {
+    FRAM_USART.DATA = Data;
+
+    while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
+
+    return FRAM_USART.DATA;
+}
+
+#ifdef USE_DMA
+INLINE void SPIWaitBlock(void) {
+    /* Wait for DMA to finish */
+    while (RECV_DMA.CTRLA & DMA_CH_ENABLE_bm)
+        ;
+
+    /* Clear Interrupt flag */
+    RECV_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
+    SEND_DMA.CTRLB = DMA_CH_TRNIF_bm | DMA_CH_ERRIF_bm;
+}
+
+INLINE void SPIReadBlockStart(void *Buffer, uint16_t ByteCount) {
+    /* Set up read and write transfers */
+    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_INC_gc;
+    RECV_DMA.DESTADDR0 = ((uintptr_t) Buffer >> 0) & 0xFF;
+    RECV_DMA.DESTADDR1 = ((uintptr_t) Buffer >> 8) & 0xFF;
+    RECV_DMA.TRFCNT = ByteCount;
+    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    SEND_DMA.SRCADDR0 = ((uintptr_t) ScrapBuffer >> 0) & 0xFF;
+    SEND_DMA.SRCADDR1 = ((uintptr_t) ScrapBuffer >> 8) & 0xFF;
+    SEND_DMA.TRFCNT = ByteCount;
+
+
+    /* Enable read and write transfers */
+    RECV_DMA.CTRLA |= DMA_CH_ENABLE_bm;
+    SEND_DMA.CTRLA |= DMA_CH_ENABLE_bm;
+}
+
+INLINE void SPIWriteBlockStart(const void *Buffer, uint16_t ByteCount) {
+    /* Set up read and write transfers */
+    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    RECV_DMA.DESTADDR0 = ((uintptr_t) ScrapBuffer >> 0) & 0xFF;
+    RECV_DMA.DESTADDR1 = ((uintptr_t) ScrapBuffer >> 8) & 0xFF;
+    RECV_DMA.TRFCNT = ByteCount;
+    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_INC_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    SEND_DMA.SRCADDR0 = ((uintptr_t) Buffer >> 0) & 0xFF;
+    SEND_DMA.SRCADDR1 = ((uintptr_t) Buffer >> 8) & 0xFF;
+    SEND_DMA.TRFCNT = ByteCount;
+
+    /* Enable read and write transfers */
+    RECV_DMA.CTRLA |= DMA_CH_ENABLE_bm;
+    SEND_DMA.CTRLA |= DMA_CH_ENABLE_bm;
+}
+#else
+INLINE void SPIWaitBlock(void) {
+    /* Without DMA, transfers are completed as soon as they have been started */
+}
+
+INLINE void SPIReadBlockStart(void *Buffer, uint16_t ByteCount) {
+    uint8_t *ByteBuffer = (uint8_t *) Buffer;
+
+    while (ByteCount-- > 0) {
+        FRAM_USART.DATA = 0;
+        while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
+
+        *ByteBuffer++ = FRAM_USART.DATA;
+    }
+}
+
+INLINE void SPIWriteBlockStart(const void *Buffer, uint16_t ByteCount) {
+    uint8_t *ByteBuffer = (uint8_t *) Buffer;
+
+    while (ByteCount-- > 0) {
+        FRAM_USART.DATA = *ByteBuffer++;
+        while (!(FRAM_USART.STATUS & USART_RXCIF_bm));
+
+        FRAM_USART.DATA; /* Flush Buffer */
+    }
+}
+#endif
+
+INLINE void SPIReadBlock(void *Buffer, uint16_t ByteCount) {
+    SPIReadBlockStart(Buffer, ByteCount);
+    SPIWaitBlock();
+}
+
+INLINE void SPIWriteBlock(const void *Buffer, uint16_t ByteCount) {
+    SPIWriteBlockStart(Buffer, ByteCount);
+    SPIWaitBlock();
+}
+
+/* Asynchronous FRAM read or write. While the DMA is transferring, chip select
+ * has to stay asserted, so every other FRAM access waits for the transfer to
+ * complete. Writes have no callback. */
+static struct {
+    bool Pending;
+    void *Buffer;
+    uint16_t ByteCount;
+    MemoryReadCallbackType Callback;
+} ReadAsync = { .Pending = false };
+
+static void FRAMReadAsyncComplete(void) {
+    SPIWaitBlock();
+    FRAM_PORT.OUTSET = FRAM_CS;
+
+    /* Allow the callback to start the next transfer */
+    ReadAsync.Pending = false;
+
+    if (ReadAsync.Callback != NULL) {
+        ReadAsync.Callback(ReadAsync.Buffer, ReadAsync.ByteCount);
+    }
+}
+
+INLINE void FRAMReadAsyncWait(void) {
+    if (ReadAsync.Pending) {
+        FRAMReadAsyncComplete();
+    }
+}
+
+INLINE void FRAMRead(void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    FRAMReadAsyncWait();
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+
+    SPITransferByte(0x03); /* Read command */
+    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+    SPITransferByte((Address >> 0) & 0xFF);
+
+    SPIReadBlock(Buffer, ByteCount);
+
+    FRAM_PORT.OUTSET = FRAM_CS;
+}
+
+INLINE void FRAMWrite(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    FRAMReadAsyncWait();
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+    SPITransferByte(0x06); /* Write Enable */
+    FRAM_PORT.OUTSET = FRAM_CS;
+
+    asm volatile("nop");
+    asm volatile("nop");
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+
+    SPITransferByte(0x02); /* Write command */
+    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+    SPITransferByte((Address >> 0) & 0xFF);
+
+    SPIWriteBlock(Buffer, ByteCount);
+
+    FRAM_PORT.OUTSET = FRAM_CS;
+}
+
+/* Scatter-gather FRAM transfers. A range starting where the previous one
+ * ended continues the same SPI transaction, saving chip select toggles, the
+ * write enable and the command with address. Reads also clock through small
+ * gaps between ranges, as this is faster than starting a new command. */
+#define FRAM_READ_MAX_GAP		4
+
+static void FRAMReadV(const MemoryIoVec *Vec, uint8_t Count) {
+    uint8_t i = 0;
+
+    FRAMReadAsyncWait();
+
+    while (i < Count) {
+        uint16_t Address = Vec[i].Address;
+
+        if (Vec[i].ByteCount == 0) {
+            i++;
+            continue;
+        }
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+
+        SPITransferByte(0x03); /* Read command */
+        SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+        SPITransferByte((Address >> 0) & 0xFF);
+
+        while (true) {
+            SPIReadBlock(Vec[i].Buffer, Vec[i].ByteCount);
+            Address += Vec[i].ByteCount;
+
+            do {
+                i++;
+            } while ((i < Count) && (Vec[i].ByteCount == 0));
+
+            if ((i == Count) || (Vec[i].Address < Address) || (Vec[i].Address - Address > FRAM_READ_MAX_GAP))
+                break;
+
+            while (Address < Vec[i].Address) {
+                SPITransferByte(0); /* Skip gap */
+                Address++;
+            }
+        }
+
+        FRAM_PORT.OUTSET = FRAM_CS;
+    }
+}
+
+static void FRAMWriteV(const MemoryIoVec *Vec, uint8_t Count) {
+    uint8_t i = 0;
+
+    FRAMReadAsyncWait();
+
+    while (i < Count) {
+        uint16_t Address = Vec[i].Address;
+
+        if (Vec[i].ByteCount == 0) {
+            i++;
+            continue;
+        }
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+        SPITransferByte(0x06); /* Write Enable */
+        FRAM_PORT.OUTSET = FRAM_CS;
+
+        asm volatile("nop");
+        asm volatile("nop");
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+
+        SPITransferByte(0x02); /* Write command */
+        SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+        SPITransferByte((Address >> 0) & 0xFF);
+
+        do {
+            SPIWriteBlock(Vec[i].Buffer, Vec[i].ByteCount);
+            Address += Vec[i].ByteCount;
+
+            do {
+                i++;
+            } while ((i < Count) && (Vec[i].ByteCount == 0));
+        } while ((i < Count) && (Vec[i].Address == Address));
+
+        FRAM_PORT.OUTSET = FRAM_CS;
+    }
+}
+
+static void FRAMReadAsync(void *Buffer, uint16_t Address, uint16_t ByteCount, MemoryReadCallbackType Callback) {
+    FRAMReadAsyncWait();
+
+    ReadAsync.Buffer = Buffer;
+    ReadAsync.ByteCount = ByteCount;
+    ReadAsync.Callback = Callback;
+    ReadAsync.Pending = true;
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+
+    SPITransferByte(0x03); /* Read command */
+    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+    SPITransferByte((Address >> 0) & 0xFF);
+
+    /* Return without waiting, the transfer is completed by FRAMReadAsyncPending()
+     * or by the next FRAM access */
+    SPIReadBlockStart(Buffer, ByteCount);
+}
+
+static void FRAMWriteAsync(const void *Buffer, uint16_t Address, uint16_t ByteCount) {
+    FRAMReadAsyncWait();
+
+    ReadAsync.Buffer = (void *) Buffer;
+    ReadAsync.ByteCount = ByteCount;
+    ReadAsync.Callback = NULL;
+    ReadAsync.Pending = true;
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+    SPITransferByte(0x06); /* Write Enable */
+    FRAM_PORT.OUTSET = FRAM_CS;
+
+    asm volatile("nop");
+    asm volatile("nop");
+
+    FRAM_PORT.OUTCLR = FRAM_CS;
+
+    SPITransferByte(0x02); /* Write command */
+    SPITransferByte((Address >> 8) & 0xFF);   /* Address hi and lo byte */
+    SPITransferByte((Address >> 0) & 0xFF);
+
+    /* The buffer must stay untouched until FRAMReadAsyncPending() returns false */
+    SPIWriteBlockStart(Buffer, ByteCount);
+}
+
+static bool FRAMReadAsyncPending(void) {
+    if (!ReadAsync.Pending)
+        return false;
+
+#ifdef USE_DMA
+    if (RECV_DMA.CTRLA & DMA_CH_ENABLE_bm)
+        return true;
+#endif
+
+    FRAMReadAsyncComplete();
+
+    return false;
+}
+
+static void FRAMReadAsyncSetComplete(uint16_t ByteCount) {
+    FRAMReadAsyncWait();
+
+    ReadAsync.ByteCount = ByteCount;
+    ReadAsync.Callback = NULL;
+}
+
+static uint16_t FRAMReadAsyncAvailable(void) {
+    /* Number of bytes of the current asynchronous read that have already
+     * arrived in the buffer */
+#ifdef USE_DMA
+    if (ReadAsync.Pending && (RECV_DMA.CTRLA & DMA_CH_ENABLE_bm))
+        return ReadAsync.ByteCount - RECV_DMA.TRFCNT;
+#endif
+
+    return ReadAsync.ByteCount;
+}
+
+INLINE void FlashRead(void *Buffer, uint32_t Address, uint16_t ByteCount) {
+    uint8_t *BufPtr = (uint8_t *) Buffer;
+
+    /* We assume that ByteCount is a multiple of 2 */
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+
+    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
+        /* Sanity check to limit access to the allocated area */
+        while (ByteCount > 1) {
+            uint16_t Word = FlashReadWord(PhysicalAddress);
+
+            *BufPtr++ = (Word >> 0) & 0xFF;
+            *BufPtr++ = (Word >> 8) & 0xFF;
+
+            PhysicalAddress += 2;
+            ByteCount -= 2;
+        }
+    }
+}
+
+INLINE uint8_t FlashReadByte(uint32_t Address) {
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+    uint16_t Word = FlashReadWord(PhysicalAddress & ~1UL);
+
+    return (PhysicalAddress & 1) ? (Word >> 8) & 0xFF : (Word >> 0) & 0xFF;
+}
+
+static void FlashWrite(const void *Buffer, uint32_t Address, uint16_t ByteCount) {
+    const uint8_t *BufPtr = (uint8_t *) Buffer;
+
+    /* We assume that FlashWrite is always called for write actions that are
+     * aligned to APP_SECTION_PAGE_SIZE and a multiple of APP_SECTION_PAGE_SIZE.
+     * Thus only full pages are written into the flash. */
+    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+
+    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
+        /* Sanity check to limit access to the allocated area */
+
+        while (PageCount-- > 0) {
+            /* For each page to program, wait for NVM to get ready,
+             * erase the flash page buffer, program all data to the
+             * flash page buffer and write buffer to flash using
+             * the atomic erase and write operation. */
+
+            FlashWaitForSPM();
+
+            FlashEraseFlashBuffer();
+            FlashWaitForSPM();
+
+            for (uint16_t i = 0; i < APP_SECTION_PAGE_SIZE; i += 2) {
+                uint16_t Word = 0;
+
+                Word |= ((uint16_t) * BufPtr++ << 0);
+                Word |= ((uint16_t) * BufPtr++ << 8);
+
+                FlashLoadFlashWord(i, Word);
+                FlashWaitForSPM();
+            }
+
+            FlashEraseWriteApplicationPage(PhysicalAddress);
+            FlashWaitForSPM();
+
+            PhysicalAddress += APP_SECTION_PAGE_SIZE;
+        }
+    }
+}
+
+static void FlashErase(uint32_t Address, uint16_t ByteCount) {
+    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+
+    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
+        /* Sanity check to limit access to the allocated area */
+        while (PageCount-- > 0) {
+            FlashWaitForSPM();
+
+            FlashEraseApplicationPage(PhysicalAddress);
+            FlashWaitForSPM();
+
+            PhysicalAddress += APP_SECTION_PAGE_SIZE;
+        }
+    }
+}
+
+INLINE void FlashReadPage(uint8_t *Buffer, uint32_t PhysicalAddress, uint16_t ByteCount) {
+    while (ByteCount > 1) {
+        uint16_t Word = FlashReadWord(PhysicalAddress);
+
+        *Buffer++ = (Word >> 0) & 0xFF;
+        *Buffer++ = (Word >> 8) & 0xFF;
+
+        PhysicalAddress += 2;
+        ByteCount -= 2;
+    }
+}
+
+static void FlashToFRAM(uint32_t Address, uint16_t ByteCount, MemoryPageBufferType PageBuffer) {
+    /* We assume that ByteCount is a multiple of 2 */
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+
+    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END)) {
+        /* Sanity check to limit access to the allocated area.
+         * Set up FRAM memory for writing. */
+        uint8_t Buffer = 0;
+
+        FRAMReadAsyncWait();
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+        SPITransferByte(0x06); /* Write Enable */
+        FRAM_PORT.OUTSET = FRAM_CS;
+
+        asm volatile("nop");
+        asm volatile("nop");
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+
+        SPITransferByte(0x02); /* Write command */
+        SPITransferByte(0); /* Address hi and lo byte */
+        SPITransferByte(0);
+
+        /* Double buffering: While DMA shifts one page into the FRAM, the
+         * next page is read from flash into the other buffer. */
+        while (ByteCount > 1) {
+            uint16_t ChunkSize = MIN(ByteCount & ~1, MEMORY_FLASH_PAGE_SIZE);
+
+            FlashReadPage(PageBuffer[Buffer], PhysicalAddress, ChunkSize);
+
+            SPIWaitBlock();
+            SPIWriteBlockStart(PageBuffer[Buffer], ChunkSize);
+
+            Buffer ^= 1;
+            PhysicalAddress += ChunkSize;
+            ByteCount -= ChunkSize;
+        }
+
+        /* End write procedure of FRAM */
+        SPIWaitBlock();
+        FRAM_PORT.OUTSET = FRAM_CS;
+    }
+}
+
+static void FRAMToFlash(uint32_t Address, uint16_t FRAMAddress, uint16_t ByteCount, MemoryPageBufferType PageBuffer) {
+    /* We assume that FlashWrite is always called for write actions that are
+     * aligned to APP_SECTION_PAGE_SIZE and a multiple of APP_SECTION_PAGE_SIZE.
+     * Thus only full pages are written into the flash. */
+    uint16_t PageCount = ByteCount / APP_SECTION_PAGE_SIZE;
+    uint32_t PhysicalAddress = Address + FLASH_DATA_ADDR;
+
+    if ((PhysicalAddress >= FLASH_DATA_START) && (PhysicalAddress <= FLASH_DATA_END) && (PageCount > 0)) {
+        /* Sanity check to limit access to the allocated area and setup FRAM
+         * read. */
+        uint8_t Buffer = 0;
+
+        FRAMReadAsyncWait();
+
+        FRAM_PORT.OUTCLR = FRAM_CS;
+
+        SPITransferByte(0x03); /* Read command */
+        SPITransferByte((FRAMAddress >> 8) & 0xFF); /* Address hi and lo byte */
+        SPITransferByte((FRAMAddress >> 0) & 0xFF);
+
+        SPIReadBlockStart(PageBuffer[Buffer], APP_SECTION_PAGE_SIZE);
+
+        while (PageCount-- > 0) {
+            const uint8_t *BufPtr = PageBuffer[Buffer];
+
+            /* Double buffering: Fetch the next page from FRAM by DMA while
+             * the current one is being programmed into flash. */
+            SPIWaitBlock();
+
+            if (PageCount > 0) {
+                SPIReadBlockStart(PageBuffer[Buffer ^ 1], APP_SECTION_PAGE_SIZE);
+            }
+
+            /* For each page to program, wait for NVM to get ready,
+             * erase the flash page buffer, program all data to the
+             * flash page buffer and write buffer to flash using
+             * the atomic erase and write operation. */
+            FlashWaitForSPM();
+
+            FlashEraseFlashBuffer();
+            FlashWaitForSPM();
+
+            /* Write one page worth of data into flash buffer */
+            for (uint16_t i = 0; i < APP_SECTION_PAGE_SIZE; i += 2) {
+                uint16_t Word = 0;
+
+                Word |= ((uint16_t) * BufPtr++ << 0);
+                Word |= ((uint16_t) * BufPtr++ << 8);
+
+                FlashLoadFlashWord(i, Word);
+                FlashWaitForSPM();
+            }
+
+            /* Program flash buffer into flash */
+            FlashEraseWriteApplicationPage(PhysicalAddress);
+            FlashWaitForSPM();
+
+            Buffer ^= 1;
+            PhysicalAddress += APP_SECTION_PAGE_SIZE;
+        }
+
+        /* End read procedure of FRAM */
+        FRAM_PORT.OUTSET = FRAM_CS;
+    }
+}
+
+static void MemoryBackendInit(void) {
+    /* Configure FRAM_USART for SPI master mode 0 with maximum clock frequency */
+    FRAM_PORT.OUTSET = FRAM_CS;
+
+    FRAM_PORT.OUTCLR = FRAM_SCK;
+    FRAM_PORT.OUTSET = FRAM_MOSI;
+
+    FRAM_PORT.DIRSET = FRAM_SCK | FRAM_MOSI | FRAM_CS;
+
+    FRAM_USART.BAUDCTRLA = 0;
+    FRAM_USART.BAUDCTRLB = 0;
+    FRAM_USART.CTRLC = USART_CMODE_MSPI_gc;
+    FRAM_USART.CTRLB = USART_RXEN_bm | USART_TXEN_bm;
+
+    /* Init DMAs for reading and writing */
+    RECV_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    RECV_DMA.TRIGSRC = DMA_CH_TRIGSRC_USARTD0_RXC_gc;
+    RECV_DMA.TRFCNT = 0;
+    RECV_DMA.SRCADDR0 = ((uintptr_t) &FRAM_USART.DATA >> 0) & 0xFF;
+    RECV_DMA.SRCADDR1 = ((uintptr_t) &FRAM_USART.DATA >> 8) & 0xFF;
+    RECV_DMA.SRCADDR2 = 0;
+    RECV_DMA.DESTADDR0 = 0;
+    RECV_DMA.DESTADDR1 = 0;
+    RECV_DMA.DESTADDR2 = 0;
+    RECV_DMA.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+
+    SEND_DMA.ADDRCTRL = DMA_CH_SRCRELOAD_NONE_gc | DMA_CH_SRCDIR_FIXED_gc | DMA_CH_DESTRELOAD_NONE_gc | DMA_CH_DESTDIR_FIXED_gc;
+    SEND_DMA.TRIGSRC = DMA_CH_TRIGSRC_USARTD0_DRE_gc;
+    SEND_DMA.TRFCNT = 0;
+    SEND_DMA.SRCADDR0 = 0;
+    SEND_DMA.SRCADDR1 = 0;
+    SEND_DMA.SRCADDR2 = 0;
+    SEND_DMA.DESTADDR0 = ((uintptr_t) &FRAM_USART.DATA >> 0) & 0xFF;
+    SEND_DMA.DESTADDR1 = ((uintptr_t) &FRAM_USART.DATA >> 8) & 0xFF;
+    SEND_DMA.DESTADDR2 = 0;
+    SEND_DMA.CTRLA = DMA_CH_SINGLE_bm | DMA_CH_BURSTLEN_1BYTE_gc;
+}
+
+INLINE MemorySlotType *SlotTable(void) {
+    /* Kept with the settings, which are loaded before MemoryInit() */
+    return GlobalSettings.Slots;
+}
+
+INLINE uint8_t SlotActiveIdx(void) {
+    return GlobalSettings.ActiveSettingIdx;
+}
+
+INLINE void SlotTableSave(uint8_t First, uint8_t Count) {
+    SettingUpdate(&GlobalSettings.Slots[First], Count * sizeof(MemorySlotType));
+}
+
+INLINE void MemoryChangedHook(void) {
+    LEDHook(LED_MEMORY_CHANGED, LED_ON);
+}
+
+INLINE void MemoryStoredHook(void) {
+    LEDHook(LED_MEMORY_CHANGED, LED_OFF);
+    LEDHook(LED_MEMORY_STORED, LED_PULSE);
+}
+
+INLINE uint16_t MemoryGetTick(void) {
+    return SystemGetSysTick();
+}
+
+INLINE void MemoryTickClearFlag(void) {
+    SystemTickClearFlag();
+}
+
+// EEPROM functions
+
+static inline void NVM_EXEC(void) {
+    void *z = (void *)&NVM_CTRLA;
+
+    __asm__ volatile("out %[ccp], %[ioreg]"  "\n\t"
+                     "st z, %[cmdex]"
+                     :
+                     : [ccp] "I"(_SFR_IO_ADDR(CCP)),
+                     [ioreg] "d"(CCP_IOREG_gc),
+                     [cmdex] "r"(NVM_CMDEX_bm),
+                     [z] "z"(z)
+                    );
+}
+
+static void WaitForNVM(void) {
+    while (NVM.STATUS & NVM_NVMBUSY_bm) { };
+}
+
+static void FlushNVMBuffer(void) {
+    WaitForNVM();
+
+    if ((NVM.STATUS & NVM_EELOAD_bm) != 0) {
+        NVM.CMD = NVM_CMD_ERASE_EEPROM_BUFFER_gc;
+        NVM_EXEC();
+    }
+}
+
+uint16_t ReadEEPBlock(uint16_t Address, void *DestPtr, uint16_t ByteCount) {
+    uint16_t BytesRead = 0;
+    uint8_t *BytePtr = (uint8_t *) DestPtr;
+    NVM.ADDR2 = 0;
+
+    WaitForNVM();
+
+    while (ByteCount > 0) {
+        NVM.ADDR0 = Address & 0xFF;
+        NVM.ADDR1 = (Address >> 8) & 0x1F;
+
+        NVM.CMD = NVM_CMD_READ_EEPROM_gc;
+        NVM_EXEC();
+
+        *BytePtr++ = NVM.DATA0;
+        Address++;
+
+        ByteCount--;
+        BytesRead++;
+    }
+
+    return BytesRead;
+}
+
+
+uint16_t WriteEEPBlock(uint16_t Address, const void *SrcPtr, uint16_t ByteCount) {
+    const uint8_t *BytePtr = (const uint8_t *) SrcPtr;
+    uint8_t ByteAddress = Address % EEPROM_PAGE_SIZE;
+    uint16_t PageAddress = Address - ByteAddress;
+    uint16_t BytesWritten = 0;
+
+    FlushNVMBuffer();
+    WaitForNVM();
+    NVM.CMD = NVM_CMD_LOAD_EEPROM_BUFFER_gc;
+
+    NVM.ADDR1 = 0;
+    NVM.ADDR2 = 0;
+
+    while (ByteCount > 0) {
+        NVM.ADDR0 = ByteAddress;
+
+        NVM.DATA0 = *BytePtr++;
+
+        ByteAddress++;
+        ByteCount--;
+
+        if (ByteCount == 0 || ByteAddress >= EEPROM_PAGE_SIZE) {
+            NVM.ADDR0 = PageAddress & 0xFF;
+            NVM.ADDR1 = (PageAddress >> 8) & 0x1F;
+
+            NVM.CMD = NVM_CMD_ERASE_WRITE_EEPROM_PAGE_gc;
+            NVM_EXEC();
+
+            PageAddress += EEPROM_PAGE_SIZE;
+            ByteAddress = 0;
+
+            WaitForNVM();
+
+            NVM.CMD = NVM_CMD_LOAD_EEPROM_BUFFER_gc;
+        }
+
+        BytesWritten++;
+    }
+
+    return BytesWritten;
+}
@@ -27,8 +27,18 @@ SettingsType EEMEM StoredSettings = {
             .LEDRedFunction = DEFAULT_RED_LED_ACTION,
             .LEDGreenFunction = DEFAULT_GREEN_LED_ACTION,
             .PendingTaskTimeout = DEFAULT_PENDING_TASK_TIMEOUT,
-            .ReaderThreshold = DEFAULT_READER_THRESHOLD
+            .ReaderThreshold = DEFAULT_READER_THRESHOLD,
+            .LogFilter = DEFAULT_LOG_FILTER
         }
+    },
+
+    .LogFormat = DEFAULT_LOG_FORMAT,
+    .LogTrigger = {
+        .Entry = LOG_TRIGGER_DEFAULT_ENTRY,
+        .MatchCommand = false,
+        .Command = 0,
+        .PreCount = LOG_TRIGGER_DEFAULT_PRE,
+        .PostCount = LOG_TRIGGER_DEFAULT_POST
     }
 };
 
@@ -86,7 +96,7 @@ bool SettingsSetActiveById(uint8_t Setting) {
         }
 
         /* Notify LED. blink according to current setting */
-        LEDHook(LED_SETTING_CHANGE, LED_BLINK + SettingIdx);
+        LEDHook(LED_SETTING_CHANGE, LED_BLINK + MIN(SettingIdx, LED_BLINK_8X - LED_BLINK));
 
         return true;
     } else {
@@ -99,15 +109,21 @@ uint8_t SettingsGetActiveById(void) {
 }
 
 void SettingsGetActiveByName(char *SettingOut, uint16_t BufferSize) {
-    SettingOut[0] = SettingsGetActiveById() + '0';
-    SettingOut[1] = '\0';
+    snprintf_P(SettingOut, BufferSize, PSTR("%u"), SettingsGetActiveById());
 }
 
 bool SettingsSetActiveByName(const char *Setting) {
-    uint8_t SettingNr = Setting[0] - '0';
+    uint8_t SettingNr = 0;
+    uint8_t Length = 0;
 
-    if (Setting[1] == '\0') {
-        LogEntry(LOG_INFO_SETTING_SET, Setting, 1);
+    /* Setting numbers may have up to two decimal digits */
+    while ((Setting[Length] >= '0') && (Setting[Length] <= '9') && (Length < 2)) {
+        SettingNr = SettingNr * 10 + (Setting[Length] - '0');
+        Length++;
+    }
+
+    if ((Length > 0) && (Setting[Length] == '\0')) {
+        LogEntry(LOG_INFO_SETTING_SET, Setting, Length);
         return SettingsSetActiveById(SettingNr);
     } else {
         return false;
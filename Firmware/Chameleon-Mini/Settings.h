@@ -15,7 +15,9 @@
 #include "Memory.h"
 #include <avr/eeprom.h>
 
+#ifndef SETTINGS_COUNT
 #define SETTINGS_COUNT		(MEMORY_SIZE / MEMORY_SIZE_PER_SETTING)
+#endif
 #define SETTINGS_FIRST		1
 #define SETTINGS_LAST		(SETTINGS_FIRST + SETTINGS_COUNT - 1)
 
@@ -31,12 +33,16 @@ typedef struct {
     LEDHookEnum LEDGreenFunction; /// Green LED function for this setting.
     uint16_t PendingTaskTimeout; /// Timeout for timeout commands for this setting, in multiples of 100 ms.
     uint16_t ReaderThreshold; /// Reader threshold
+    uint16_t LogFilter; /// Enabled classes of log entries, see LOG_FILTER_CLASS.
 } SettingsEntryType;
 
 typedef struct {
     uint8_t ActiveSettingIdx;
     SettingsEntryType *ActiveSettingPtr;
     SettingsEntryType Settings[SETTINGS_COUNT];
+    MemorySlotType Slots[SETTINGS_COUNT]; /// Flash allocation table, one slot per setting.
+    LogFormatEnum LogFormat; /// Encoding of log entries, shared by all settings.
+    LogTriggerType LogTrigger; /// Trigger of the TRIGGER log mode, shared by all settings.
 } SettingsType;
 
 extern SettingsType GlobalSettings, StoredSettings;
@@ -9,6 +9,9 @@
 #include "Settings.h"
 #include "System.h"
 
+#include <string.h>
+#include <util/crc16.h>
+
 #define CHAR_GET_MODE   		'?'     /* <Command>? */
 #define CHAR_SET_MODE   		'='     /* <Command>=<Param> */
 #define CHAR_EXEC_MODE  		'\0'    /* <Command> */
@@ -36,6 +39,19 @@
 #define STATUS_MESSAGE_TRAILER    "\r\n"
 #define OPTIONAL_ANSWER_TRAILER    "\r\n"
 
+/* Binary frames: SOF, length (16 bit), opcode, request ID, payload, CRC16 (XModem)
+ * over everything between SOF and CRC. All values are big endian. */
+#define FRAME_SOF                   0x02
+#define FRAME_HEADER_SIZE           4
+#define FRAME_CRC_SIZE              2
+#define FRAME_ANSWER_FLAG           0x80
+#define FRAME_RECEIVE_TIMEOUT_MS    100
+
+#define FRAME_OP_COMMAND            0x01 /* Payload is a command line */
+#define FRAME_OP_COMMAND_BINARY     0x02 /* Payload is [n][command incl. delimiter (n chars)][binary parameter] */
+#define FRAME_OP_MASK               0x3F
+#define FRAME_FLAG_HEX_AS_BINARY    0x40 /* Set by the host for commands which answer in hex, sends their answer as bytes */
+
 /* Include all command functions */
 #include "Commands.h"
 
@@ -169,6 +185,41 @@ const PROGMEM CommandEntryType CommandTable[] = {
         .SetFunc    = CommandSetLogMode,
         .GetFunc    = CommandGetLogMode
     },
+    {
+        .Command    = COMMAND_LOGFILTER,
+        .ExecFunc   = NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = CommandSetLogFilter,
+        .GetFunc    = CommandGetLogFilter
+    },
+    {
+        .Command    = COMMAND_LOGFORMAT,
+        .ExecFunc   = NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = CommandSetLogFormat,
+        .GetFunc    = CommandGetLogFormat
+    },
+    {
+        .Command    = COMMAND_LOGTRIGGER,
+        .ExecFunc   = NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = CommandSetLogTrigger,
+        .GetFunc    = CommandGetLogTrigger
+    },
+    {
+        .Command    = COMMAND_LOGTRIGWINDOW,
+        .ExecFunc   = NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = CommandSetLogTriggerWindow,
+        .GetFunc    = CommandGetLogTriggerWindow
+    },
+    {
+        .Command    = COMMAND_LOGARM,
+        .ExecFunc   = CommandExecLogArm,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = NO_FUNCTION,
+        .GetFunc    = CommandGetLogArm
+    },
     {
         .Command    = COMMAND_LOGMEM,
         .ExecFunc   = NO_FUNCTION,
@@ -180,9 +231,16 @@ const PROGMEM CommandEntryType CommandTable[] = {
         .Command    = COMMAND_LOGDOWNLOAD,
         .ExecFunc   = CommandExecLogDownload,
         .ExecParamFunc = NO_FUNCTION,
-        .SetFunc    = NO_FUNCTION,
+        .SetFunc    = CommandSetLogDownload,
         .GetFunc    = NO_FUNCTION
     },
+    {
+        .Command    = COMMAND_LOGINDEX,
+        .ExecFunc   = NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc    = NO_FUNCTION,
+        .GetFunc    = CommandGetLogIndex
+    },
     {
         .Command    = COMMAND_STORELOG,
         .ExecFunc   = CommandExecStoreLog,
@@ -225,6 +283,62 @@ const PROGMEM CommandEntryType CommandTable[] = {
         .SetFunc	= NO_FUNCTION,
         .GetFunc	= NO_FUNCTION
     },
+    {
+        .Command	= COMMAND_STOREASYNC,
+        .ExecFunc	= CommandExecStoreAsync,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= CommandGetStoreAsync
+    },
+    {
+        .Command	= COMMAND_MEMBENCH,
+        .ExecFunc	= CommandExecMemBench,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= NO_FUNCTION
+    },
+    {
+        .Command	= COMMAND_CMDBENCH,
+        .ExecFunc	= CommandExecCmdBench,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= NO_FUNCTION
+    },
+    {
+        .Command	= COMMAND_USBBENCH,
+        .ExecFunc	= NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= CommandSetUsbBench,
+        .GetFunc	= NO_FUNCTION
+    },
+    {
+        .Command	= COMMAND_TXPOLICY,
+        .ExecFunc	= NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= CommandSetTxPolicy,
+        .GetFunc	= CommandGetTxPolicy
+    },
+    {
+        .Command	= COMMAND_TXSTATS,
+        .ExecFunc	= CommandExecTxStats,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= CommandGetTxStats
+    },
+    {
+        .Command	= COMMAND_MEMSTATS,
+        .ExecFunc	= NO_FUNCTION,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= CommandGetMemStats
+    },
+    {
+        .Command	= COMMAND_MEMCACHE,
+        .ExecFunc	= CommandExecMemCache,
+        .ExecParamFunc = NO_FUNCTION,
+        .SetFunc	= NO_FUNCTION,
+        .GetFunc	= CommandGetMemCache
+    },
     {
         .Command    = COMMAND_CHARGING,
         .ExecFunc   = NO_FUNCTION,
@@ -377,14 +491,51 @@ static const CommandStatusType PROGMEM StatusTable[] = {
     STATUS_TABLE_ENTRY(COMMAND_INFO_FALSE_ID, COMMAND_INFO_FALSE),
     STATUS_TABLE_ENTRY(COMMAND_INFO_TRUE_ID, COMMAND_INFO_TRUE),
     STATUS_TABLE_ENTRY(COMMAND_ERR_TIMEOUT_ID, COMMAND_ERR_TIMEOUT),
+    STATUS_TABLE_ENTRY(COMMAND_ERR_INVALID_FRAME_ID, COMMAND_ERR_INVALID_FRAME),
+    STATUS_TABLE_ENTRY(COMMAND_ERR_NO_MEMORY_ID, COMMAND_ERR_NO_MEMORY),
 };
 
+/* Table indices in order of the command names for a binary search. The table
+ * is put together from #ifdef'd entries and includes, thus it is sorted once
+ * by CommandLineInit() instead of in the source. */
+#define COMMAND_COUNT   (ARRAY_COUNT(CommandTable) - 1) /* Without COMMAND_LIST_END */
+
+_Static_assert(COMMAND_COUNT <= UINT8_MAX, "CommandIndex holds 8 bit indices");
+
+static uint8_t CommandIndex[COMMAND_COUNT];
+
+#define CMDBENCH_ROUNDS     50
+
 uint16_t TerminalBufferIdx = 0;
 
 void (*CommandLinePendingTaskTimeout)(void) = NO_FUNCTION;  // gets called on Timeout
 static bool TaskPending = false;
 static uint16_t TaskPendingSince;
 
+static struct {
+    enum {
+        FRAME_IDLE,
+        FRAME_RECEIVING,
+        FRAME_COMPLETE     /* Waits for a pending task, if there is one */
+    } State;
+    uint8_t Header[FRAME_HEADER_SIZE];
+    uint16_t Length;
+    uint16_t ByteCount;
+    uint16_t Crc;
+    uint16_t CrcReceived;
+    uint16_t LastByteSince;
+} Frame = { .State = FRAME_IDLE };
+
+/* The frame whose answer is due, while its command runs */
+static struct {
+    bool Active;
+    bool HexAsBinary;
+    uint8_t Opcode;
+    uint8_t Id;
+} FrameTask = { .Active = false };
+
+static uint16_t FrameAnswerCrc;
+
 static const char *GetStatusMessageP(CommandStatusIdType StatusId) {
     uint8_t i;
 
@@ -435,23 +586,56 @@ static CommandStatusIdType CallCommandFunc(
     return Status;
 }
 
-void CommandExecute(const char *command) {
-    uint8_t i;
+static const CommandEntryType *FindCommand(const char *Command) {
+    uint8_t Low = 0;
+    uint8_t High = COMMAND_COUNT;
 
-    for (i = 0; i < ARRAY_COUNT(CommandTable); i++) {
-        if (strcmp_P(command, CommandTable[i].Command) == 0) {
-            CallCommandFunc(&CommandTable[i], CHAR_EXEC_MODE, NULL);
-            break;
-        }
+    while (Low < High) {
+        uint8_t Middle = (Low + High) / 2;
+        const CommandEntryType *CommandEntry = &CommandTable[CommandIndex[Middle]];
+        int Result = strcmp_P(Command, CommandEntry->Command);
+
+        if (Result == 0)
+            return CommandEntry;
+        else if (Result < 0)
+            High = Middle;
+        else
+            Low = Middle + 1;
     }
+
+    return NULL;
 }
 
-static void DecodeCommand(void) {
-    uint8_t i;
-    bool CommandFound = false;
+static void SortCommands(void) {
+    char Command[MAX_COMMAND_LENGTH];
+    uint8_t i, j;
+
+    /* Insertion sort, only done once at startup */
+    for (i = 0; i < COMMAND_COUNT; i++) {
+        strncpy_P(Command, CommandTable[i].Command, sizeof(Command));
+
+        for (j = i; j > 0 && strcmp_P(Command, CommandTable[CommandIndex[j - 1]].Command) < 0; j--)
+            CommandIndex[j] = CommandIndex[j - 1];
+
+        CommandIndex[j] = i;
+    }
+}
+
+void CommandExecute(const char *command) {
+    const CommandEntryType *CommandEntry = FindCommand(command);
+
+    if (CommandEntry != NULL)
+        CallCommandFunc(CommandEntry, CHAR_EXEC_MODE, NULL);
+}
+
+/* Runs the command line in TerminalBuffer. An answer is left in there, if the
+ * command has been found. */
+static CommandStatusIdType RunCommand(bool *CommandFound) {
     CommandStatusIdType StatusId = COMMAND_ERR_UNKNOWN_CMD_ID;
     char *pTerminalBuffer = (char *) TerminalBuffer;
 
+    *CommandFound = false;
+
     /* Do some sanity check first */
     if (!IS_COMMAND_DELIMITER(pTerminalBuffer[0])) {
         char *pCommandDelimiter = pTerminalBuffer;
@@ -465,21 +649,27 @@ static void DecodeCommand(void) {
         *pCommandDelimiter = '\0';
 
         /* Search in command table */
-        for (i = 0; i < ARRAY_COUNT(CommandTable); i++) {
-            if (strcmp_P(pTerminalBuffer, CommandTable[i].Command) == 0) {
-                /* Command found. Clear buffer, and call appropriate function */
-                char *pParam = ++pCommandDelimiter;
+        const CommandEntryType *CommandEntry = FindCommand(pTerminalBuffer);
 
-                pTerminalBuffer[0] = '\0';
-                CommandFound = true;
+        if (CommandEntry != NULL) {
+            /* Command found. Clear buffer, and call appropriate function */
+            char *pParam = ++pCommandDelimiter;
 
-                StatusId = CallCommandFunc(&CommandTable[i], CommandDelimiter, pParam);
+            pTerminalBuffer[0] = '\0';
+            *CommandFound = true;
 
-                break;
-            }
+            StatusId = CallCommandFunc(CommandEntry, CommandDelimiter, pParam);
         }
     }
 
+    return StatusId;
+}
+
+static void DecodeCommand(void) {
+    bool CommandFound;
+    CommandStatusIdType StatusId = RunCommand(&CommandFound);
+    char *pTerminalBuffer = (char *) TerminalBuffer;
+
     if (StatusId == TIMEOUT_COMMAND) // it is a timeout command, so we return
         return;
 
@@ -494,12 +684,240 @@ static void DecodeCommand(void) {
     }
 }
 
+static void FrameAnswerByte(uint8_t Byte) {
+    FrameAnswerCrc = _crc_xmodem_update(FrameAnswerCrc, Byte);
+    TerminalSendByte(Byte);
+}
+
+/* Answers carry the opcode of their kind of payload with FRAME_ANSWER_FLAG set,
+ * the request ID and the status, followed by ByteCount bytes of payload */
+static void FrameAnswerStart(uint8_t Opcode, CommandStatusIdType StatusId, uint16_t ByteCount) {
+    TerminalSendByte(FRAME_SOF);
+    FrameAnswerCrc = 0;
+    FrameAnswerByte((ByteCount + 1) >> 8);
+    FrameAnswerByte((ByteCount + 1) & 0xFF);
+    FrameAnswerByte(Opcode | FRAME_ANSWER_FLAG);
+    FrameAnswerByte(FrameTask.Id);
+    FrameAnswerByte(StatusId);
+}
+
+static void FrameAnswerEnd(void) {
+    uint16_t Crc = FrameAnswerCrc;
+
+    TerminalSendByte(Crc >> 8);
+    TerminalSendByte(Crc & 0xFF);
+    FrameTask.Active = false;
+}
+
+static bool IsHexString(const char *Text, uint16_t Length) {
+    if ((Length == 0) || (Length % 2 != 0))
+        return false;
+
+    while (Length-- > 0) {
+        if (!VALID_HEXCHAR(*Text))
+            return false;
+        Text++;
+    }
+
+    return true;
+}
+
+/* Requests with FRAME_FLAG_HEX_AS_BINARY get hex answers back in binary,
+ * everything else as text. Only the host knows whether an answer is hex, an
+ * answer like "CAFE" may as well be text. */
+static void FrameAnswerText(CommandStatusIdType StatusId, const char *Text) {
+    uint16_t Length = (Text != NULL) ? strlen(Text) : 0;
+
+    if (FrameTask.HexAsBinary && IsHexString(Text, Length)) {
+        FrameAnswerStart(FRAME_OP_COMMAND_BINARY, StatusId, Length / 2);
+
+        while (Length > 0) {
+            FrameAnswerByte((HEXCHAR_TO_NIBBLE(Text[0]) << 4) | HEXCHAR_TO_NIBBLE(Text[1]));
+            Text += 2;
+            Length -= 2;
+        }
+    } else {
+        FrameAnswerStart(FRAME_OP_COMMAND, StatusId, Length);
+
+        while (Length-- > 0)
+            FrameAnswerByte(*Text++);
+    }
+
+    FrameAnswerEnd();
+}
+
+static void FrameToUpperCase(char *Text, uint16_t Length) {
+    while (Length-- > 0) {
+        if (IS_LOWERCASE(*Text))
+            *Text = TO_UPPERCASE(*Text);
+        Text++;
+    }
+}
+
+/* Turns [n][command][binary parameter] into the command line with the parameter
+ * in hex, in place. Every hex pair lands at or behind the byte it comes from. */
+static bool FrameExpandParam(uint16_t Length) {
+    uint8_t *Buffer = TerminalBuffer;
+    uint8_t CommandLength = Buffer[0];
+    uint16_t ParamLength;
+    uint16_t i;
+
+    if (CommandLength >= Length)
+        return false;
+
+    ParamLength = Length - 1 - CommandLength;
+
+    if (CommandLength + 2 * ParamLength >= TERMINAL_BUFFER_SIZE)
+        return false;
+
+    memmove(&Buffer[0], &Buffer[1], CommandLength);
+    FrameToUpperCase((char *) Buffer, CommandLength);
+
+    for (i = ParamLength; i-- > 0;) {
+        uint8_t Byte = Buffer[1 + CommandLength + i];
+
+        Buffer[CommandLength + 2 * i + 0] = NIBBLE_TO_HEXCHAR((Byte >> 4) & 0x0F);
+        Buffer[CommandLength + 2 * i + 1] = NIBBLE_TO_HEXCHAR((Byte >> 0) & 0x0F);
+    }
+
+    Buffer[CommandLength + 2 * ParamLength] = '\0';
+
+    return true;
+}
+
+static void FrameExecute(void) {
+    bool CommandFound;
+    CommandStatusIdType StatusId;
+    char *pTerminalBuffer = (char *) TerminalBuffer;
+
+    Frame.State = FRAME_IDLE;
+
+    FrameTask.Active = true;
+    FrameTask.HexAsBinary = (Frame.Header[2] & FRAME_FLAG_HEX_AS_BINARY) != 0;
+    FrameTask.Opcode = Frame.Header[2] & FRAME_OP_MASK;
+    FrameTask.Id = Frame.Header[3];
+
+    if ((Frame.Crc != Frame.CrcReceived) || (Frame.Length >= TERMINAL_BUFFER_SIZE)) {
+        FrameAnswerText(COMMAND_ERR_INVALID_FRAME_ID, NULL);
+        return;
+    }
+
+    pTerminalBuffer[Frame.Length] = '\0';
+
+    if (FrameTask.Opcode == FRAME_OP_COMMAND) {
+        FrameToUpperCase(pTerminalBuffer, Frame.Length);
+    } else if (FrameTask.Opcode == FRAME_OP_COMMAND_BINARY) {
+        if (!FrameExpandParam(Frame.Length)) {
+            FrameAnswerText(COMMAND_ERR_INVALID_FRAME_ID, NULL);
+            return;
+        }
+    } else {
+        FrameAnswerText(COMMAND_ERR_UNKNOWN_CMD_ID, NULL);
+        return;
+    }
+
+    StatusId = RunCommand(&CommandFound);
+
+    if (StatusId == TIMEOUT_COMMAND) // answered when the task is finished
+        return;
+
+    FrameAnswerText(StatusId, CommandFound ? pTerminalBuffer : NULL);
+}
+
+static bool FrameProcessByte(uint8_t Byte) {
+    if (Frame.State == FRAME_IDLE) {
+        if (Byte != FRAME_SOF)
+            return false;
+
+        /* Start of a frame, this drops a partial command line */
+        Frame.State = FRAME_RECEIVING;
+        Frame.ByteCount = 0;
+        Frame.Crc = 0;
+        Frame.LastByteSince = SystemGetSysTick();
+        TerminalBufferIdx = 0;
+
+        return true;
+    }
+
+    Frame.LastByteSince = SystemGetSysTick();
+
+    if (Frame.ByteCount < FRAME_HEADER_SIZE) {
+        Frame.Header[Frame.ByteCount] = Byte;
+        Frame.Crc = _crc_xmodem_update(Frame.Crc, Byte);
+
+        if (Frame.ByteCount == 1)
+            Frame.Length = ((uint16_t) Frame.Header[0] << 8) | Frame.Header[1];
+    } else if (Frame.ByteCount < FRAME_HEADER_SIZE + Frame.Length) {
+        uint16_t Offset = Frame.ByteCount - FRAME_HEADER_SIZE;
+
+        /* Oversized payloads are not stored but still consumed */
+        if (Offset < TERMINAL_BUFFER_SIZE)
+            TerminalBuffer[Offset] = Byte;
+
+        Frame.Crc = _crc_xmodem_update(Frame.Crc, Byte);
+    } else {
+        Frame.CrcReceived = (Frame.CrcReceived << 8) | Byte;
+    }
+
+    if (++Frame.ByteCount == FRAME_HEADER_SIZE + Frame.Length + FRAME_CRC_SIZE)
+        Frame.State = FRAME_COMPLETE;
+
+    return true;
+}
+
 void CommandLineInit(void) {
     TerminalBufferIdx = 0;
+    SortCommands();
+}
+
+void CommandLineBenchmark(uint32_t *LinearNs, uint32_t *SortedNs) {
+    char Command[MAX_COMMAND_LENGTH];
+    uint32_t Lookups = (uint32_t) COMMAND_COUNT * CMDBENCH_ROUNDS;
+    uint16_t StartTick, Ticks;
+    uint8_t Round, i, j;
+
+    /* Look up every command CMDBENCH_ROUNDS times, by scanning the table as
+     * before and by the binary search */
+    StartTick = SystemGetSysTick();
+    for (Round = 0; Round < CMDBENCH_ROUNDS; Round++) {
+        for (i = 0; i < COMMAND_COUNT; i++) {
+            strncpy_P(Command, CommandTable[i].Command, sizeof(Command));
+
+            for (j = 0; j < COMMAND_COUNT; j++) {
+                if (strcmp_P(Command, CommandTable[j].Command) == 0)
+                    break;
+            }
+        }
+    }
+    Ticks = SystemGetSysTick() - StartTick;
+    *LinearNs = (uint32_t) Ticks * 1000000UL / Lookups;
+
+    StartTick = SystemGetSysTick();
+    for (Round = 0; Round < CMDBENCH_ROUNDS; Round++) {
+        for (i = 0; i < COMMAND_COUNT; i++) {
+            strncpy_P(Command, CommandTable[i].Command, sizeof(Command));
+            FindCommand(Command);
+        }
+    }
+    Ticks = SystemGetSysTick() - StartTick;
+    *SortedNs = (uint32_t) Ticks * 1000000UL / Lookups;
+}
+
+bool CommandLineReady(void) {
+    if (Frame.State == FRAME_COMPLETE) {
+        if (TaskPending)
+            return false;
+
+        FrameExecute();
+    }
+
+    return true;
 }
 
 bool CommandLineProcessByte(uint8_t Byte) {
-    if (IS_CHARACTER(Byte)) {
+    if (FrameProcessByte(Byte)) {
+        /* Part of a binary frame */
+    } else if (IS_CHARACTER(Byte)) {
         /* Store uppercase character */
         if (IS_LOWERCASE(Byte)) {
             Byte = TO_UPPERCASE(Byte);
@@ -533,8 +951,13 @@ bool CommandLineProcessByte(uint8_t Byte) {
 
 INLINE void Timeout(void) {
     TaskPending = false;
-    TerminalSendStringP(GetStatusMessageP(COMMAND_ERR_TIMEOUT_ID));
-    TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+
+    if (FrameTask.Active) {
+        FrameAnswerText(COMMAND_ERR_TIMEOUT_ID, NULL);
+    } else {
+        TerminalSendStringP(GetStatusMessageP(COMMAND_ERR_TIMEOUT_ID));
+        TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
+    }
 
     if (CommandLinePendingTaskTimeout != NO_FUNCTION) {
         CommandLinePendingTaskTimeout(); // call the function that ends the task
@@ -543,6 +966,11 @@ INLINE void Timeout(void) {
 }
 
 void CommandLineTick(void) {
+    if (Frame.State == FRAME_RECEIVING && SYSTICK_DIFF(Frame.LastByteSince) >= FRAME_RECEIVE_TIMEOUT_MS) {
+        /* Incomplete frame, drop it and go back to text */
+        Frame.State = FRAME_IDLE;
+    }
+
     if (TaskPending &&
             GlobalSettings.ActiveSettingPtr->PendingTaskTimeout != 0 && // 0 means no timeout
             SYSTICK_DIFF_100MS(TaskPendingSince) >= GlobalSettings.ActiveSettingPtr->PendingTaskTimeout) { // timeout expired
@@ -562,6 +990,11 @@ void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char con
         return;
     TaskPending = false;
 
+    if (FrameTask.Active) {
+        FrameAnswerText(ReturnStatusID, OutMessage);
+        return;
+    }
+
     TerminalSendStringP(GetStatusMessageP(ReturnStatusID));
     TerminalSendStringP(PSTR(STATUS_MESSAGE_TRAILER));
 
@@ -571,6 +1004,25 @@ void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char con
     }
 }
 
+bool CommandLinePendingTaskBinary(void) {
+    return TaskPending && FrameTask.Active && (FrameTask.Opcode == FRAME_OP_COMMAND_BINARY);
+}
+
+void CommandLinePendingTaskFinishedData(CommandStatusIdType ReturnStatusID, void const *const Data, uint16_t ByteCount) {
+    const uint8_t *Bytes = (const uint8_t *) Data;
+
+    if (!CommandLinePendingTaskBinary())
+        return;
+    TaskPending = false;
+
+    FrameAnswerStart(FRAME_OP_COMMAND_BINARY, ReturnStatusID, ByteCount);
+
+    while (ByteCount-- > 0)
+        FrameAnswerByte(*Bytes++);
+
+    FrameAnswerEnd();
+}
+
 void CommandLineAppendData(void const *const Buffer, uint16_t Bytes) {
     char *pTerminalBuffer = (char *) TerminalBuffer;
 
@@ -13,9 +13,11 @@
 
 void CommandLineInit(void);
 bool CommandLineProcessByte(uint8_t Byte);
+bool CommandLineReady(void); // false while a received frame waits for a pending task, further input has to wait as well
 void CommandLineTick(void);
 
 void CommandExecute(const char *command);
+void CommandLineBenchmark(uint32_t *LinearNs, uint32_t *SortedNs);
 void CommandLineAppendData(void const *const Buffer, uint16_t Bytes);
 
 /* Functions for timeout commands */
@@ -23,4 +25,8 @@ void CommandLinePendingTaskFinished(CommandStatusIdType ReturnStatusID, char con
 extern void (*CommandLinePendingTaskTimeout)(void);  // gets called on timeout to end the pending task
 void CommandLinePendingTaskBreak(void); // this manually triggers a timeout
 
+/* Binary frames may get their answer without the hex conversion */
+bool CommandLinePendingTaskBinary(void); // true if the pending task came in a binary frame
+void CommandLinePendingTaskFinishedData(CommandStatusIdType ReturnStatusID, void const *const Data, uint16_t ByteCount);
+
 #endif /* COMMANDLINE_H_ */
@@ -325,7 +325,129 @@ CommandStatusIdType CommandSetLogMode(char *OutMessage, const char *InParam) {
     }
 }
 
+CommandStatusIdType CommandGetLogFilter(char *OutParam) {
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%04X"), LogGetFilter());
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLogFilter(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("Hex mask 0000 to FFFF. Bit n enables the log entry types n0 to nF, e.g. 0010 codec, 1700 application."));
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+    uint16_t tmp = 0;
+    if (sscanf_P(InParam, PSTR("%4x"), &tmp) != 1)
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    LogSetFilter(tmp);
+    SettingsSave();
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandGetLogFormat(char *OutParam) {
+    LogGetFormatByName(OutParam, TERMINAL_BUFFER_SIZE);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLogFormat(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        LogGetFormatList(OutMessage, TERMINAL_BUFFER_SIZE);
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    } else if (!LogMemIsEmpty()) {
+        /* The stored log is kept in a single format, LOGCLEAR first */
+        return COMMAND_ERR_INVALID_USAGE_ID;
+    } else if (LogSetFormatByName(InParam)) {
+        SettingsSave();
+        return COMMAND_INFO_OK_ID;
+    } else {
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    }
+}
+
+CommandStatusIdType CommandGetLogTrigger(char *OutParam) {
+    LogTriggerType Trigger;
+
+    LogGetTrigger(&Trigger);
+
+    if (Trigger.MatchCommand)
+        snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%02X,%02X"), Trigger.Entry, Trigger.Command);
+    else
+        snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%02X"), Trigger.Entry);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLogTrigger(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("Hex log entry type, optionally followed by its first data byte, e.g. C0 or 40,60"));
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+    LogTriggerType Trigger;
+    unsigned int Entry = 0;
+    unsigned int Command = 0;
+    uint8_t Count = sscanf_P(InParam, PSTR("%2x,%2x"), &Entry, &Command);
+    if ((Count < 1) || (Count > 2))
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    LogGetTrigger(&Trigger);
+    Trigger.Entry = Entry;
+    Trigger.MatchCommand = (Count == 2);
+    Trigger.Command = Command;
+    LogSetTrigger(&Trigger);
+    SettingsSave();
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandGetLogTriggerWindow(char *OutParam) {
+    LogTriggerType Trigger;
+
+    LogGetTrigger(&Trigger);
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%u,%u"), Trigger.PreCount, Trigger.PostCount);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetLogTriggerWindow(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("Entries before and after the trigger, 0 to 255 each, e.g. 16,16"));
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+    LogTriggerType Trigger;
+    unsigned int Pre = 0;
+    unsigned int Post = 0;
+    if ((sscanf_P(InParam, PSTR("%u,%u"), &Pre, &Post) != 2) || (Pre > UINT8_MAX) || (Post > UINT8_MAX))
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    LogGetTrigger(&Trigger);
+    Trigger.PreCount = Pre;
+    Trigger.PostCount = Post;
+    LogSetTrigger(&Trigger);
+    SettingsSave();
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandExecLogArm(char *OutMessage) {
+    if (GlobalSettings.ActiveSettingPtr->LogMode != LOG_MODE_TRIGGER)
+        return COMMAND_ERR_INVALID_USAGE_ID;
+
+    LogTriggerArm();
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandGetLogArm(char *OutParam) {
+    if (GlobalSettings.ActiveSettingPtr->LogMode != LOG_MODE_TRIGGER)
+        return COMMAND_ERR_INVALID_USAGE_ID;
+
+    LogGetTriggerStateByName(OutParam, TERMINAL_BUFFER_SIZE);
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
 CommandStatusIdType CommandGetLogMem(char *OutParam) {
+    if (GlobalSettings.ActiveSettingPtr->LogMode == LOG_MODE_LIVE) {
+        snprintf_P(OutParam, TERMINAL_BUFFER_SIZE,
+                   PSTR("%u (live, %u of %u entries dropped)"), LiveLogFree(), LiveLogDropped, LiveLogSequence);
+
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+
     uint16_t free = LogMemFree();
     snprintf_P(OutParam, TERMINAL_BUFFER_SIZE,
                PSTR("%u (from which %u non-volatile)"), free, (free <= LOG_SIZE) ? 0 : (free - LOG_SIZE));
@@ -340,6 +462,33 @@ CommandStatusIdType CommandExecLogDownload(char *OutMessage) {
     return COMMAND_INFO_XMODEM_WAIT_ID;
 }
 
+CommandStatusIdType CommandSetLogDownload(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("First and end entry number, or T and first and end time in ms, e.g. 100,200 or T5000"));
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+    bool ByTime = (InParam[0] == 'T');
+    unsigned long From = 0;
+    unsigned long To = UINT32_MAX;
+    if (ByTime)
+        InParam++;
+    if (sscanf_P(InParam, PSTR("%lu,%lu"), &From, &To) < 1)
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    LogMemSetRange(ByTime, From, To);
+    XModemSend(LogMemLoadRangeBlock);
+    return COMMAND_INFO_XMODEM_WAIT_ID;
+}
+
+CommandStatusIdType CommandGetLogIndex(char *OutParam) {
+    uint32_t FirstEntry, EndEntry, FirstTime, LastTime;
+
+    LogMemGetRange(&FirstEntry, &EndEntry, &FirstTime, &LastTime);
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%lu,%lu,%lu,%lu"),
+               (unsigned long) FirstEntry, (unsigned long) EndEntry, (unsigned long) FirstTime, (unsigned long) LastTime);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
 CommandStatusIdType CommandExecStoreLog(char *OutMessage) {
     LogSRAMToFRAM();
     return COMMAND_INFO_OK_ID;
@@ -369,8 +518,11 @@ CommandStatusIdType CommandExecClear(char *OutMessage) {
 }
 
 CommandStatusIdType CommandExecStore(char *OutMessage) {
-    MemoryStore();
-    return COMMAND_INFO_OK_ID;
+    if (MemoryStore()) {
+        return COMMAND_INFO_OK_ID;
+    } else {
+        return COMMAND_ERR_NO_MEMORY_ID;
+    }
 }
 
 CommandStatusIdType CommandExecRecall(char *OutMessage) {
@@ -378,6 +530,120 @@ CommandStatusIdType CommandExecRecall(char *OutMessage) {
     return COMMAND_INFO_OK_ID;
 }
 
+CommandStatusIdType CommandExecStoreAsync(char *OutMessage) {
+    uint8_t PagesDone, PagesTotal;
+
+    if (MemoryStoreAsyncProgress(&PagesDone, &PagesTotal)) {
+        /* Another background store is still running */
+        return COMMAND_ERR_INVALID_USAGE_ID;
+    } else if (MemoryStoreAsync()) {
+        return COMMAND_INFO_OK_ID;
+    } else {
+        return COMMAND_ERR_NO_MEMORY_ID;
+    }
+}
+
+CommandStatusIdType CommandGetStoreAsync(char *OutParam) {
+    uint8_t PagesDone, PagesTotal;
+
+    if (MemoryStoreAsyncProgress(&PagesDone, &PagesTotal)) {
+        snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("BUSY %u/%u pages"), PagesDone, PagesTotal);
+    } else {
+        snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("DONE %u/%u pages"), PagesDone, PagesTotal);
+    }
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandExecMemBench(char *OutMessage) {
+    uint16_t StoreTicks, RecallTicks;
+
+    MemoryBenchmark(&StoreTicks, &RecallTicks);
+
+    snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("STORE %u, RECALL %u ticks"), StoreTicks, RecallTicks);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandExecCmdBench(char *OutMessage) {
+    uint32_t LinearNs, SortedNs;
+
+    CommandLineBenchmark(&LinearNs, &SortedNs);
+
+    snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("LINEAR %lu, SORTED %lu ns per command"), LinearNs, SortedNs);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetUsbBench(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        snprintf_P(OutMessage, TERMINAL_BUFFER_SIZE, PSTR("1-%lu bytes to stream to the host and back"), (uint32_t) USBBENCH_MAX_BYTES);
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    }
+    uint32_t ByteCount = 0;
+    if (!sscanf_P(InParam, PSTR("%7lu"), &ByteCount) || ByteCount == 0 || ByteCount > USBBENCH_MAX_BYTES)
+        return COMMAND_ERR_INVALID_PARAM_ID;
+
+    TerminalBenchStart(ByteCount);
+    CommandLinePendingTaskTimeout = &TerminalBenchStop;
+    return TIMEOUT_COMMAND;
+}
+
+CommandStatusIdType CommandGetTxPolicy(char *OutParam) {
+    TerminalGetTxPolicyByName(OutParam, TERMINAL_BUFFER_SIZE);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandSetTxPolicy(char *OutMessage, const char *InParam) {
+    if (COMMAND_IS_SUGGEST_STRING(InParam)) {
+        TerminalGetTxPolicyList(OutMessage, TERMINAL_BUFFER_SIZE);
+        return COMMAND_INFO_OK_WITH_TEXT_ID;
+    } else if (TerminalSetTxPolicyByName(InParam)) {
+        return COMMAND_INFO_OK_ID;
+    } else {
+        return COMMAND_ERR_INVALID_PARAM_ID;
+    }
+}
+
+CommandStatusIdType CommandExecTxStats(char *OutMessage) {
+    memset(&TerminalTxStats, 0, sizeof(TerminalTxStats));
+
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandGetTxStats(char *OutParam) {
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%lu bytes in %lu writes dropped"),
+               TerminalTxStats.DroppedBytes, TerminalTxStats.DroppedWrites);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandGetMemStats(char *OutParam) {
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%lu pages written, %lu pages skipped"),
+               MemoryStats.PagesWritten, MemoryStats.PagesSkipped);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+}
+
+CommandStatusIdType CommandExecMemCache(char *OutMessage) {
+    memset(&MemoryCacheStats, 0, sizeof(MemoryCacheStats));
+
+    return COMMAND_INFO_OK_ID;
+}
+
+CommandStatusIdType CommandGetMemCache(char *OutParam) {
+#ifdef MEMORY_CACHE
+    snprintf_P(OutParam, TERMINAL_BUFFER_SIZE, PSTR("%lu hits, %lu misses, %lu evictions, %u of %u lines pinned"),
+               MemoryCacheStats.Hits, MemoryCacheStats.Misses, MemoryCacheStats.Evictions,
+               MemoryCachePinnedLines(), MEMORY_CACHE_SETS * MEMORY_CACHE_WAYS);
+
+    return COMMAND_INFO_OK_WITH_TEXT_ID;
+#else
+    return COMMAND_ERR_INVALID_USAGE_ID;
+#endif
+}
+
 CommandStatusIdType CommandGetCharging(char *OutMessage) {
     if (BatteryIsCharging()) {
         return COMMAND_INFO_TRUE_ID;
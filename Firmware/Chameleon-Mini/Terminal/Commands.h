@@ -27,6 +27,10 @@
 #define COMMAND_ERR_INVALID_PARAM       "INVALID PARAMETER"
 #define COMMAND_ERR_TIMEOUT_ID			203
 #define COMMAND_ERR_TIMEOUT				"TIMEOUT"
+#define COMMAND_ERR_INVALID_FRAME_ID	204
+#define COMMAND_ERR_INVALID_FRAME		"INVALID FRAME"
+#define COMMAND_ERR_NO_MEMORY_ID		205
+#define COMMAND_ERR_NO_MEMORY			"NOT ENOUGH MEMORY"
 #define TIMEOUT_COMMAND					255 // this is just for the CommandLine module to know that this is a timeout command
 
 
@@ -121,11 +125,35 @@ CommandStatusIdType CommandSetPin(char *OutMessage, const char *InParam);
 CommandStatusIdType CommandGetLogMode(char *OutParam);
 CommandStatusIdType CommandSetLogMode(char *OutMessage, const char *InParam);
 
+#define COMMAND_LOGFILTER   "LOGFILTER"
+CommandStatusIdType CommandGetLogFilter(char *OutParam);
+CommandStatusIdType CommandSetLogFilter(char *OutMessage, const char *InParam);
+
+#define COMMAND_LOGFORMAT   "LOGFORMAT"
+CommandStatusIdType CommandGetLogFormat(char *OutParam);
+CommandStatusIdType CommandSetLogFormat(char *OutMessage, const char *InParam);
+
+#define COMMAND_LOGTRIGGER  "LOGTRIGGER"
+CommandStatusIdType CommandGetLogTrigger(char *OutParam);
+CommandStatusIdType CommandSetLogTrigger(char *OutMessage, const char *InParam);
+
+#define COMMAND_LOGTRIGWINDOW "LOGTRIGWINDOW"
+CommandStatusIdType CommandGetLogTriggerWindow(char *OutParam);
+CommandStatusIdType CommandSetLogTriggerWindow(char *OutMessage, const char *InParam);
+
+#define COMMAND_LOGARM      "LOGARM"
+CommandStatusIdType CommandExecLogArm(char *OutMessage);
+CommandStatusIdType CommandGetLogArm(char *OutParam);
+
 #define COMMAND_LOGMEM      "LOGMEM"
 CommandStatusIdType CommandGetLogMem(char *OutParam);
 
 #define COMMAND_LOGDOWNLOAD	"LOGDOWNLOAD"
 CommandStatusIdType CommandExecLogDownload(char *OutMessage);
+CommandStatusIdType CommandSetLogDownload(char *OutMessage, const char *InParam);
+
+#define COMMAND_LOGINDEX	"LOGINDEX"
+CommandStatusIdType CommandGetLogIndex(char *OutParam);
 
 #define COMMAND_STORELOG	"LOGSTORE"
 CommandStatusIdType CommandExecStoreLog(char *OutMessage);
@@ -146,6 +174,35 @@ CommandStatusIdType CommandExecStore(char *OutMessage);
 #define COMMAND_RECALL		"RECALL"
 CommandStatusIdType CommandExecRecall(char *OutMessage);
 
+#define COMMAND_STOREASYNC	"STOREASYNC"
+CommandStatusIdType CommandExecStoreAsync(char *OutMessage);
+CommandStatusIdType CommandGetStoreAsync(char *OutParam);
+
+#define COMMAND_MEMBENCH	"MEMBENCH"
+CommandStatusIdType CommandExecMemBench(char *OutMessage);
+
+#define COMMAND_CMDBENCH	"CMDBENCH"
+CommandStatusIdType CommandExecCmdBench(char *OutMessage);
+
+#define COMMAND_USBBENCH	"USBBENCH"
+#define USBBENCH_MAX_BYTES	0x100000
+CommandStatusIdType CommandSetUsbBench(char *OutMessage, const char *InParam);
+
+#define COMMAND_TXPOLICY	"TXPOLICY"
+CommandStatusIdType CommandGetTxPolicy(char *OutParam);
+CommandStatusIdType CommandSetTxPolicy(char *OutMessage, const char *InParam);
+
+#define COMMAND_TXSTATS		"TXSTATS"
+CommandStatusIdType CommandExecTxStats(char *OutMessage);
+CommandStatusIdType CommandGetTxStats(char *OutParam);
+
+#define COMMAND_MEMSTATS	"MEMSTATS"
+CommandStatusIdType CommandGetMemStats(char *OutParam);
+
+#define COMMAND_MEMCACHE	"MEMCACHE"
+CommandStatusIdType CommandExecMemCache(char *OutMessage);
+CommandStatusIdType CommandGetMemCache(char *OutParam);
+
 #define COMMAND_CHARGING 	"CHARGING"
 CommandStatusIdType CommandGetCharging(char *OutParam);
 
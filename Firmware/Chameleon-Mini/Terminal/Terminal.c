@@ -4,9 +4,18 @@
 #include "../LEDHook.h"
 
 #include "../LUFADescriptors.h"
+#include "../Map.h"
+
+#include <string.h>
 
 #define INIT_DELAY		(2000 / SYSTEM_TICK_MS)
 
+#define TX_RING_MASK		(TERMINAL_TX_BUFFER_SIZE - 1)
+#define TX_STALL_MS			10 /* Without a packet taken, the host counts as stalled */
+#define BENCH_DRAIN_TIMEOUT_MS	100 /* Without a byte received, the host has given up sending the pattern */
+
+_Static_assert((TERMINAL_TX_BUFFER_SIZE & TX_RING_MASK) == 0, "TERMINAL_TX_BUFFER_SIZE must be a power of two");
+
 
 USB_ClassInfo_CDC_Device_t TerminalHandle = {
     .Config = {
@@ -31,16 +40,185 @@ uint8_t TerminalBuffer[TERMINAL_BUFFER_SIZE] = { 0x00 };
 TerminalStateEnum TerminalState = TERMINAL_UNINITIALIZED;
 static uint8_t TerminalInitDelay = INIT_DELAY;
 
+static const MapEntryType PROGMEM TxPolicyMap[] = {
+    { .Id = TERMINAL_TX_DROP,		.Text = "DROP"		},
+    { .Id = TERMINAL_TX_BLOCK,		.Text = "BLOCK"		},
+    { .Id = TERMINAL_TX_TRUNCATE,	.Text = "TRUNCATE"	}
+};
+
+/* Output waits here until TerminalTask or a later write hands it to the IN endpoint */
+static uint8_t TxRing[TERMINAL_TX_BUFFER_SIZE];
+static uint16_t TxHead = 0;
+static uint16_t TxTail = 0;
+static bool TxStalled = false;
+static bool TxPacketFull = false;
+static TerminalTxPolicyEnum TxPolicy = DEFAULT_TERMINAL_TX_POLICY;
+
+TerminalTxStatsType TerminalTxStats = { 0 };
+
+static struct {
+    enum {
+        BENCH_OFF,
+        BENCH_IN, /* Pattern is streamed to the host */
+        BENCH_OUT, /* Pattern is expected from the host */
+        BENCH_DRAIN /* Timed out, the rest of the pattern is ignored */
+    } State;
+    uint32_t ByteCount;
+    uint32_t Position;
+    uint32_t Errors;
+    uint32_t Ticks; /* Of the current direction, the systick wraps after 65 s */
+    uint32_t InTicks;
+    uint16_t LastTick;
+} Bench = { .State = BENCH_OFF };
+
+static bool TxConnected(void) {
+    return (USB_DeviceState == DEVICE_STATE_Configured) && TerminalHandle.State.LineEncoding.BaudRateBPS;
+}
+
+static uint16_t TxFree(void) {
+    return (TxTail - TxHead - 1) & TX_RING_MASK;
+}
+
+/* Hands the next packet to the IN endpoint if the host has taken the last
+ * one. Returns whether anything was sent. */
+static bool TxDrain(void) {
+    if (!TxConnected())
+        return false;
+
+    Endpoint_SelectEndpoint(TerminalHandle.Config.DataINEndpoint.Address);
+
+    if (!Endpoint_IsINReady())
+        return false;
+
+    TxStalled = false;
+
+    if (TxHead == TxTail) {
+        if (TxPacketFull) {
+            /* Zero length packet to end the transfer after a full one */
+            Endpoint_ClearIN();
+            TxPacketFull = false;
+            return true;
+        }
+
+        return false;
+    }
+
+    while ((TxHead != TxTail) && Endpoint_IsReadWriteAllowed()) {
+        Endpoint_Write_8(TxRing[TxTail]);
+        TxTail = (TxTail + 1) & TX_RING_MASK;
+    }
+
+    TxPacketFull = !Endpoint_IsReadWriteAllowed();
+    Endpoint_ClearIN();
+
+    return true;
+}
+
+/* Room for the next up to ByteCount bytes of a write, waiting for the host
+ * only as long as the policy permits */
+static uint16_t TxRoom(uint16_t ByteCount, TerminalTxPolicyEnum Policy) {
+    uint16_t Wanted = MIN(ByteCount, TX_RING_MASK);
+    uint16_t Timeout = (Policy == TERMINAL_TX_BLOCK) ? USB_STREAM_TIMEOUT_MS : TX_STALL_MS;
+    uint16_t Since = SystemGetSysTick();
+
+    while (TxFree() < Wanted) {
+        if (TxDrain()) {
+            Since = SystemGetSysTick();
+        } else if ((TxStalled && Policy != TERMINAL_TX_BLOCK) || SYSTICK_DIFF(Since) >= Timeout) {
+            /* Do not wait again until the host reads */
+            TxStalled = true;
+            return (Policy == TERMINAL_TX_DROP) ? 0 : TxFree();
+        }
+    }
+
+    return Wanted;
+}
+
+static void TxDrop(uint16_t ByteCount) {
+    TerminalTxStats.DroppedBytes += ByteCount;
+    TerminalTxStats.DroppedWrites++;
+}
+
+/* Returns the number of bytes put into the ring. With Partial set, the caller
+ * keeps what is not taken, so that it is neither dropped as a whole nor
+ * counted as dropped. */
+static uint16_t TxWrite(const uint8_t *Data, uint16_t ByteCount, bool Progmem, bool Partial) {
+    TerminalTxPolicyEnum Policy = (Partial && TxPolicy == TERMINAL_TX_DROP) ? TERMINAL_TX_TRUNCATE : TxPolicy;
+    uint16_t Accepted = 0;
+
+    if (!TxConnected()) {
+        /* Nobody listens, discard output and anything still queued */
+        TxTail = TxHead;
+        TxPacketFull = false;
+        return 0;
+    }
+
+    if ((Policy == TERMINAL_TX_DROP) && TxStalled) {
+        /* Without the host reading, only a write which fits as a whole is taken */
+        TxDrain();
+
+        if (TxStalled && (ByteCount > TxFree())) {
+            TxDrop(ByteCount);
+            return 0;
+        }
+    }
+
+    while (ByteCount > 0) {
+        uint16_t Room = TxRoom(ByteCount, Policy);
+
+        if (Room == 0) {
+            if (!Partial)
+                TxDrop(ByteCount);
+
+            return Accepted;
+        }
+
+        ByteCount -= Room;
+        Accepted += Room;
+
+        while (Room-- > 0) {
+            TxRing[TxHead] = Progmem ? pgm_read_byte(Data) : *Data;
+            TxHead = (TxHead + 1) & TX_RING_MASK;
+            Data++;
+        }
+    }
+
+    return Accepted;
+}
+
+void TerminalSendByte(uint8_t Byte) {
+    TxWrite(&Byte, 1, false, false);
+}
+
 void TerminalSendString(const char *s) {
-    CDC_Device_SendString(&TerminalHandle, s);
+    TxWrite((const uint8_t *) s, strlen(s), false, false);
 }
 
 void TerminalSendStringP(const char *s) {
-    char c;
+    TxWrite((const uint8_t *) s, strlen_P(s), true, false);
+}
+
+void TerminalFlush(void) {
+    TxDrain();
+}
 
-    while ((c = pgm_read_byte(s++)) != '\0') {
-        TerminalSendChar(c);
+bool TerminalSetTxPolicyByName(const char *Policy) {
+    MapIdType Id;
+
+    if (MapTextToId(TxPolicyMap, ARRAY_COUNT(TxPolicyMap), Policy, &Id)) {
+        TxPolicy = Id;
+        return true;
     }
+
+    return false;
+}
+
+void TerminalGetTxPolicyByName(char *Policy, uint16_t BufferSize) {
+    MapIdToText(TxPolicyMap, ARRAY_COUNT(TxPolicyMap), TxPolicy, Policy, BufferSize);
+}
+
+void TerminalGetTxPolicyList(char *List, uint16_t BufferSize) {
+    MapToString(TxPolicyMap, ARRAY_COUNT(TxPolicyMap), List, BufferSize);
 }
 
 /*
@@ -56,19 +234,120 @@ void TerminalSendHex(void* Buffer, uint16_t ByteCount)
 */
 
 
-void TerminalSendBlock(const void *Buffer, uint16_t ByteCount) {
-    CDC_Device_SendData(&TerminalHandle, Buffer, ByteCount);
+uint16_t TerminalSendBlock(const void *Buffer, uint16_t ByteCount) {
+    return TxWrite(Buffer, ByteCount, false, false);
+}
+
+uint16_t TerminalSendBlockPartial(const void *Buffer, uint16_t ByteCount) {
+    return TxWrite(Buffer, ByteCount, false, true);
+}
+
+
+/* Known pattern of the USB benchmark, which does not repeat every 256 bytes */
+static uint8_t BenchPattern(uint32_t Position) {
+    return (uint8_t)(Position + (Position >> 8));
+}
+
+static void BenchUpdateTicks(void) {
+    uint16_t Now = SystemGetSysTick();
+
+    Bench.Ticks += (uint16_t)(Now - Bench.LastTick);
+    Bench.LastTick = Now;
+}
+
+static void BenchSend(void) {
+    uint16_t ChunkSize = MIN(Bench.ByteCount - Bench.Position, TERMINAL_BUFFER_SIZE);
+
+    for (uint16_t i = 0; i < ChunkSize; i++)
+        TerminalBuffer[i] = BenchPattern(Bench.Position + i);
+
+    /* Whatever the policy, pattern bytes the ring does not take are sent
+     * again on the next call instead of being lost */
+    Bench.Position += TerminalSendBlockPartial(TerminalBuffer, ChunkSize);
+
+    if (Bench.Position == Bench.ByteCount) {
+        TerminalFlush();
+
+        if ((TxHead != TxTail) || TxPacketFull) {
+            /* Time the delivery to the host, not the acceptance by the ring */
+            return;
+        }
+
+        BenchUpdateTicks();
+        Bench.InTicks = Bench.Ticks;
+
+        /* Now the host sends the same pattern back */
+        Bench.State = BENCH_OUT;
+        Bench.Position = 0;
+        Bench.Ticks = 0;
+    }
 }
 
+static void BenchReceive(uint8_t Byte) {
+    if (Byte != BenchPattern(Bench.Position))
+        Bench.Errors++;
+
+    if (++Bench.Position == Bench.ByteCount) {
+        char *pTerminalBuffer = (char *) TerminalBuffer;
+
+        BenchUpdateTicks();
+        Bench.State = BENCH_OFF;
 
-static void ProcessByte(void) {
-    int16_t Byte = CDC_Device_ReceiveByte(&TerminalHandle);
+        snprintf_P(pTerminalBuffer, TERMINAL_BUFFER_SIZE, PSTR("IN %lu ms, OUT %lu ms, %lu errors"),
+                   Bench.InTicks, Bench.Ticks, Bench.Errors);
+        CommandLinePendingTaskFinished(COMMAND_INFO_OK_WITH_TEXT_ID, pTerminalBuffer);
+    }
+}
+
+void TerminalBenchStart(uint32_t ByteCount) {
+    Bench.ByteCount = ByteCount;
+    Bench.Position = 0;
+    Bench.Errors = 0;
+    Bench.Ticks = 0;
+    Bench.LastTick = SystemGetSysTick();
+    Bench.State = BENCH_IN;
+}
+
+void TerminalBenchStop(void) {
+    if (Bench.State == BENCH_OUT) {
+        /* The host is still sending, keep its bytes away from the command line */
+        Bench.State = BENCH_DRAIN;
+        Bench.LastTick = SystemGetSysTick();
+    } else {
+        Bench.State = BENCH_OFF;
+    }
+}
+
+/* Ignores the rest of the pattern, up to its end or until the host stops sending */
+static void BenchDrain(void) {
+    Bench.LastTick = SystemGetSysTick();
+
+    if (++Bench.Position == Bench.ByteCount)
+        Bench.State = BENCH_OFF;
+}
+
+static void ProcessBytes(void) {
+    /* Work through up to a whole packet per call instead of a single byte */
+    for (uint8_t i = 0; i < CDC_TXRX_EPSIZE; i++) {
+        if (Bench.State != BENCH_OUT && Bench.State != BENCH_DRAIN && !CommandLineReady()) {
+            /* Pipelined frames stay in the USB buffer until the pending task is done */
+            return;
+        }
+
+        int16_t Byte = CDC_Device_ReceiveByte(&TerminalHandle);
+
+        if (Byte < 0) {
+            /* Nothing more received */
+            return;
+        }
 
-    if (Byte >= 0) {
-        /* Byte received */
         LEDHook(LED_TERMINAL_RXTX, LED_PULSE);
 
-        if (XModemProcessByte(Byte)) {
+        if (Bench.State == BENCH_OUT) {
+            BenchReceive(Byte);
+        } else if (Bench.State == BENCH_DRAIN) {
+            BenchDrain();
+        } else if (XModemProcessByte(Byte)) {
             /* XModem handled the byte */
         } else if (CommandLineProcessByte(Byte)) {
             /* CommandLine handled the byte */
@@ -117,14 +396,24 @@ static void SenseVBus(void) {
 
 void TerminalInit(void) {
     TERMINAL_VBUS_PORT.DIRCLR = TERMINAL_VBUS_MASK;
+    CommandLineInit();
 }
 
 void TerminalTask(void) {
     if (TerminalState == TERMINAL_INITIALIZED) {
+        TxDrain();
         CDC_Device_USBTask(&TerminalHandle);
         USB_USBTask();
 
-        ProcessByte();
+        if (Bench.State == BENCH_IN || Bench.State == BENCH_OUT)
+            BenchUpdateTicks();
+
+        if (Bench.State == BENCH_IN)
+            BenchSend();
+        else if (Bench.State == BENCH_DRAIN && SYSTICK_DIFF(Bench.LastTick) >= BENCH_DRAIN_TIMEOUT_MS)
+            Bench.State = BENCH_OFF;
+
+        ProcessBytes();
     }
 }
 
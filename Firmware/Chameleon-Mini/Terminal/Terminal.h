@@ -18,6 +18,27 @@
 
 #define TERMINAL_BUFFER_SIZE	512
 
+#ifndef TERMINAL_TX_BUFFER_SIZE
+#define TERMINAL_TX_BUFFER_SIZE	256
+#endif
+
+#ifndef DEFAULT_TERMINAL_TX_POLICY
+#define DEFAULT_TERMINAL_TX_POLICY	TERMINAL_TX_DROP
+#endif
+
+/* What happens to output that does not fit into the TX ring once the host
+ * has stopped reading */
+typedef enum {
+    TERMINAL_TX_DROP, /* Drop writes that do not fit as a whole */
+    TERMINAL_TX_BLOCK, /* Wait for the host like LUFA does, up to USB_STREAM_TIMEOUT_MS */
+    TERMINAL_TX_TRUNCATE /* Keep the part of a write that fits */
+} TerminalTxPolicyEnum;
+
+typedef struct {
+    uint32_t DroppedBytes;
+    uint32_t DroppedWrites;
+} TerminalTxStatsType;
+
 typedef enum {
     TERMINAL_UNINITIALIZED,
     TERMINAL_INITIALIZING,
@@ -29,30 +50,43 @@ extern uint8_t TerminalBuffer[TERMINAL_BUFFER_SIZE];
 extern uint16_t TerminalBufferIdx;
 extern USB_ClassInfo_CDC_Device_t TerminalHandle;
 extern TerminalStateEnum TerminalState;
+extern TerminalTxStatsType TerminalTxStats;
 
 void TerminalInit(void);
 void TerminalTask(void);
 void TerminalTick(void);
 
 /*void TerminalSendHex(void* Buffer, uint16_t ByteCount);*/
-INLINE void TerminalSendByte(uint8_t Byte);
+void TerminalSendByte(uint8_t Byte);
 INLINE void TerminalFlushBuffer(void);
-void TerminalSendBlock(const void *Buffer, uint16_t ByteCount);
+/* Returns the number of bytes taken, less than ByteCount if the rest was dropped */
+uint16_t TerminalSendBlock(const void *Buffer, uint16_t ByteCount);
+/* Takes as much as fits, also under the DROP policy. The rest stays with the
+ * caller, e.g. to be offered again, and does not count as dropped. */
+uint16_t TerminalSendBlockPartial(const void *Buffer, uint16_t ByteCount);
+void TerminalFlush(void);
 
 INLINE void TerminalSendChar(char c);
 void TerminalSendString(const char *s);
 void TerminalSendStringP(const char *s);
 
+/* USB throughput benchmark, see the USBBENCH command */
+void TerminalBenchStart(uint32_t ByteCount);
+void TerminalBenchStop(void);
+
+bool TerminalSetTxPolicyByName(const char *Policy);
+void TerminalGetTxPolicyByName(char *Policy, uint16_t BufferSize);
+void TerminalGetTxPolicyList(char *List, uint16_t BufferSize);
+
 void EVENT_USB_Device_Connect(void);
 void EVENT_USB_Device_Disconnect(void);
 void EVENT_USB_Device_ConfigurationChanged(void);
 void EVENT_USB_Device_ControlRequest(void);
 
-INLINE void TerminalSendChar(char c) { CDC_Device_SendByte(&TerminalHandle, c); }
-INLINE void TerminalSendByte(uint8_t Byte) { CDC_Device_SendByte(&TerminalHandle, Byte); }
+INLINE void TerminalSendChar(char c) { TerminalSendByte(c); }
 
 INLINE void TerminalFlushBuffer(void) {
-    CDC_Device_Flush(&TerminalHandle);
+    TerminalFlush();
     TerminalBufferIdx = 0;
     TerminalBuffer[TerminalBufferIdx] = '\0';
 }
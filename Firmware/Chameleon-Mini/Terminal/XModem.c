@@ -1,22 +1,35 @@
 #include "XModem.h"
 #include "Terminal.h"
 
+#include <string.h>
+#include <util/crc16.h>
+
 #define BYTE_NAK        0x15
 #define BYTE_SOH        0x01
+#define BYTE_STX        0x02
 #define BYTE_ACK        0x06
 #define BYTE_CAN        0x18
 #define BYTE_EOF        0x1A
 #define BYTE_EOT        0x04
 #define BYTE_ESC		0x1B
+#define BYTE_CRC        'C' /* Receiver asks for CRC16 and 1K blocks */
+#define BYTE_WINDOW     'W' /* As 'C', and the sender does not wait for every ACK */
 
 #define XMODEM_BLOCK_SIZE   128
+#define XMODEM_1K_BLOCK_SIZE    1024
+#define XMODEM_WINDOW       4   /* Blocks in flight with BYTE_WINDOW */
+#define XMODEM_CHUNK_SIZE   MIN(TERMINAL_BUFFER_SIZE, XMODEM_1K_BLOCK_SIZE)
+#define XMODEM_PAD_BYTE     0x00 /* Fills up a 1K block after the end of the data */
+#define XMODEM_STAGE_SIZE   (XMODEM_1K_BLOCK_SIZE - XMODEM_CHUNK_SIZE)
 
 #define RECV_INIT_TIMEOUT   5  /* #Ticks between sending of NAKs to the sender */
 #define RECV_INIT_COUNT     60 /* #Timeouts until receive failure */
+#define RECV_CRC_COUNT      3  /* #Requests for CRC until falling back to NAK */
 #define SEND_INIT_TIMEOUT   300 /* #Ticks waiting for NAKs from the receiver before failure */
 
 #define FIRST_FRAME_NUMBER  1
 #define CHECKSUM_INIT_VALUE 0
+#define CRC_INIT_VALUE      0
 
 static enum {
     STATE_OFF,
@@ -25,6 +38,7 @@ static enum {
     STATE_RECEIVE_FRAMENUM1,
     STATE_RECEIVE_FRAMENUM2,
     STATE_RECEIVE_DATA,
+    STATE_RECEIVE_CRC,
     STATE_RECEIVE_PROCESS,
     STATE_SEND_INIT,
     STATE_SEND_WAIT,
@@ -34,13 +48,29 @@ static enum {
 static uint8_t CurrentFrameNumber;
 static uint8_t ReceivedFrameNumber;
 static uint8_t Checksum;
+static uint16_t Crc;
+static uint8_t CrcHigh;
+static uint16_t BlockSize;
+static uint16_t StageSize;
+static bool UseCrc;
 static uint8_t RetryCount;
 static uint16_t RetryTimeout;
 static uint16_t BufferIdx;
 static uint32_t BlockAddress;
 
+/* Sending: blocks from BlockAddress on are not yet acknowledged,
+ * BlocksInFlight of them have already been sent */
+static uint8_t Window;
+static uint8_t BlocksInFlight;
+static bool SendDone;
+
 static XModemCallbackType CallbackFunc;
 
+/* Receiving: the part of a 1K block which does not fit into TerminalBuffer.
+ * Nothing is passed to the callback before the checksum of the whole block
+ * has been verified. */
+static uint8_t StageBuffer[XMODEM_STAGE_SIZE];
+
 static uint8_t CalcChecksum(const void *Buffer, uint16_t ByteCount) {
     uint8_t Checksum = CHECKSUM_INIT_VALUE;
     uint8_t *DataPtr = (uint8_t *) Buffer;
@@ -52,12 +82,23 @@ static uint8_t CalcChecksum(const void *Buffer, uint16_t ByteCount) {
     return Checksum;
 }
 
+static uint16_t CalcCrc(uint16_t Crc, const void *Buffer, uint16_t ByteCount) {
+    uint8_t *DataPtr = (uint8_t *) Buffer;
+
+    while (ByteCount--) {
+        Crc = _crc_xmodem_update(Crc, *DataPtr++);
+    }
+
+    return Crc;
+}
+
 void XModemReceive(XModemCallbackType TheCallbackFunc) {
     State = STATE_RECEIVE_INIT;
     CurrentFrameNumber = FIRST_FRAME_NUMBER;
     RetryCount = RECV_INIT_COUNT;
     RetryTimeout = RECV_INIT_TIMEOUT;
     BlockAddress = 0;
+    UseCrc = true;
 
     CallbackFunc = TheCallbackFunc;
 }
@@ -70,14 +111,98 @@ void XModemSend(XModemCallbackType TheCallbackFunc) {
     CallbackFunc = TheCallbackFunc;
 }
 
+/* Fetches and sends the block after those in flight. A 1K block is fetched and
+ * sent in chunks through TerminalBuffer, resending calls the callback again. */
+static bool SendBlock(void) {
+    uint32_t Address = BlockAddress + (uint32_t) BlocksInFlight * BlockSize;
+    uint8_t FrameNumber = CurrentFrameNumber + BlocksInFlight;
+    uint16_t ChunkSize = MIN(BlockSize, XMODEM_CHUNK_SIZE);
+    uint16_t Offset;
+
+    Checksum = CHECKSUM_INIT_VALUE;
+    Crc = CRC_INIT_VALUE;
+
+    for (Offset = 0; Offset < BlockSize; Offset += ChunkSize) {
+        if (!CallbackFunc(TerminalBuffer, Address + Offset, ChunkSize)) {
+            if (Offset == 0)
+                return false;
+
+            /* The data ends within this block */
+            memset(TerminalBuffer, XMODEM_PAD_BYTE, ChunkSize);
+        }
+
+        if (Offset == 0) {
+            TerminalSendByte((BlockSize == XMODEM_1K_BLOCK_SIZE) ? BYTE_STX : BYTE_SOH);
+            TerminalSendByte(FrameNumber);
+            TerminalSendByte(255 - FrameNumber);
+        }
+
+        TerminalSendBlock(TerminalBuffer, ChunkSize);
+
+        if (UseCrc)
+            Crc = CalcCrc(Crc, TerminalBuffer, ChunkSize);
+        else
+            Checksum += CalcChecksum(TerminalBuffer, ChunkSize);
+    }
+
+    if (UseCrc) {
+        TerminalSendByte(Crc >> 8);
+        TerminalSendByte(Crc & 0xFF);
+    } else {
+        TerminalSendByte(Checksum);
+    }
+
+    return true;
+}
+
+/* Keeps up to Window blocks in flight, and ends the transfer after the last one
+ * has been acknowledged */
+static void SendFillWindow(void) {
+    while (!SendDone && (BlocksInFlight < Window)) {
+        if (SendBlock())
+            BlocksInFlight++;
+        else
+            SendDone = true;
+    }
+
+    if (SendDone && (BlocksInFlight == 0)) {
+        TerminalSendByte(BYTE_EOT);
+        State = STATE_SEND_EOT;
+    } else {
+        State = STATE_SEND_WAIT;
+    }
+}
+
+static void SendStart(uint16_t TheBlockSize, bool TheUseCrc, uint8_t TheWindow) {
+    CurrentFrameNumber = FIRST_FRAME_NUMBER;
+    BlockSize = TheBlockSize;
+    UseCrc = TheUseCrc;
+    Window = TheWindow;
+    BlocksInFlight = 0;
+    SendDone = false;
+
+    SendFillWindow();
+}
+
+/* Passes the verified block to the callback, the first StageSize bytes from StageBuffer */
+static bool ReceiveBlock(void) {
+    if ((StageSize > 0) && !CallbackFunc(StageBuffer, BlockAddress, StageSize))
+        return false;
+
+    return CallbackFunc(TerminalBuffer, BlockAddress + StageSize, BlockSize - StageSize);
+}
+
 bool XModemProcessByte(uint8_t Byte) {
     switch (State) {
         case STATE_RECEIVE_INIT:
         case STATE_RECEIVE_WAIT:
-            if (Byte == BYTE_SOH) {
+            if ((Byte == BYTE_SOH) || (Byte == BYTE_STX)) {
                 /* Next frame incoming */
+                BlockSize = (Byte == BYTE_STX) ? XMODEM_1K_BLOCK_SIZE : XMODEM_BLOCK_SIZE;
+                StageSize = (BlockSize > XMODEM_CHUNK_SIZE) ? BlockSize - XMODEM_CHUNK_SIZE : 0;
                 BufferIdx = 0;
                 Checksum = CHECKSUM_INIT_VALUE;
+                Crc = CRC_INIT_VALUE;
                 State = STATE_RECEIVE_FRAMENUM1;
             } else if (Byte == BYTE_EOT) {
                 /* Transmission finished */
@@ -100,7 +225,7 @@ bool XModemProcessByte(uint8_t Byte) {
 
         case STATE_RECEIVE_FRAMENUM2:
             if (Byte == (255 - ReceivedFrameNumber)) {
-                /* frame-number check passed. */
+                /* frame-number check passed. Receive data */
                 State = STATE_RECEIVE_DATA;
             } else {
                 /* Something went wrong. Try to recover by sending NAK */
@@ -112,25 +237,42 @@ bool XModemProcessByte(uint8_t Byte) {
 
         case STATE_RECEIVE_DATA:
             /* Process byte and update checksum */
-            TerminalBuffer[BufferIdx++] = Byte;
+            if (BufferIdx < StageSize)
+                StageBuffer[BufferIdx] = Byte;
+            else
+                TerminalBuffer[BufferIdx - StageSize] = Byte;
+
+            BufferIdx++;
 
-            if (BufferIdx == XMODEM_BLOCK_SIZE) {
+            if (UseCrc)
+                Crc = _crc_xmodem_update(Crc, Byte);
+            else
+                Checksum += Byte;
+
+            if (BufferIdx == BlockSize) {
                 /* Block full */
-                State = STATE_RECEIVE_PROCESS;
+                State = UseCrc ? STATE_RECEIVE_CRC : STATE_RECEIVE_PROCESS;
             }
 
             break;
 
+        case STATE_RECEIVE_CRC:
+            /* High byte of the CRC */
+            CrcHigh = Byte;
+            State = STATE_RECEIVE_PROCESS;
+            break;
+
         case STATE_RECEIVE_PROCESS:
             if (ReceivedFrameNumber == CurrentFrameNumber) {
-                /* This is the expected frame. Calculate and verify checksum */
+                /* This is the expected frame. Verify checksum */
+                bool Valid = UseCrc ? ((((uint16_t) CrcHigh << 8) | Byte) == Crc) : (Checksum == Byte);
 
-                if (CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE) == Byte) {
+                if (Valid) {
                     /* Checksum is valid. Pass received data to callback function */
-                    if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
+                    if (ReceiveBlock()) {
                         /* Proceed to next frame and send ACK */
                         CurrentFrameNumber++;
-                        BlockAddress += XMODEM_BLOCK_SIZE;
+                        BlockAddress += BlockSize;
                         TerminalSendChar(BYTE_ACK);
                         State = STATE_RECEIVE_WAIT;
                     } else {
@@ -157,15 +299,21 @@ bool XModemProcessByte(uint8_t Byte) {
             break;
 
         case STATE_SEND_INIT:
-            /* Start sending on NAK */
+            /* Start sending on NAK, or with CRC and 1K blocks on request */
             if (Byte == BYTE_NAK) {
-                CurrentFrameNumber = FIRST_FRAME_NUMBER - 1;
-                Byte = BYTE_ACK;
+                SendStart(XMODEM_BLOCK_SIZE, false, 1);
+            } else if (Byte == BYTE_CRC) {
+                SendStart(XMODEM_1K_BLOCK_SIZE, true, 1);
+            } else if (Byte == BYTE_WINDOW) {
+                SendStart(XMODEM_1K_BLOCK_SIZE, true, XMODEM_WINDOW);
+            } else if (Byte == BYTE_CAN) {
+                TerminalSendByte(BYTE_ACK);
+                State = STATE_OFF;
             } else if (Byte == BYTE_ESC) {
                 State = STATE_OFF;
             }
 
-        /* Fallthrough */
+            break;
 
         case STATE_SEND_WAIT:
             if (Byte == BYTE_CAN) {
@@ -173,28 +321,19 @@ bool XModemProcessByte(uint8_t Byte) {
                 TerminalSendByte(BYTE_ACK);
                 State = STATE_OFF;
             } else if (Byte == BYTE_ACK) {
-                /* Acknowledge. Proceed to next frame, get data and calc checksum */
-                CurrentFrameNumber++;
-
-                if (CallbackFunc(TerminalBuffer, BlockAddress, XMODEM_BLOCK_SIZE)) {
-                    TerminalSendByte(BYTE_SOH);
-                    TerminalSendByte(CurrentFrameNumber);
-                    TerminalSendByte(255 - CurrentFrameNumber);
-                    TerminalSendBlock(TerminalBuffer, XMODEM_BLOCK_SIZE);
-                    TerminalSendByte(CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE));
-
-                    BlockAddress += XMODEM_BLOCK_SIZE;
-                } else {
-                    TerminalSendByte(BYTE_EOT);
-                    State = STATE_SEND_EOT;
+                /* Acknowledge. Proceed to next frame */
+                if (BlocksInFlight > 0) {
+                    BlocksInFlight--;
+                    CurrentFrameNumber++;
+                    BlockAddress += BlockSize;
                 }
+
+                SendFillWindow();
             } else if (Byte == BYTE_NAK) {
-                /* Resend frame */
-                TerminalSendByte(BYTE_SOH);
-                TerminalSendByte(CurrentFrameNumber);
-                TerminalSendByte(255 - CurrentFrameNumber);
-                TerminalSendBlock(TerminalBuffer, XMODEM_BLOCK_SIZE);
-                TerminalSendByte(CalcChecksum(TerminalBuffer, XMODEM_BLOCK_SIZE));
+                /* Resend from the first frame not acknowledged */
+                BlocksInFlight = 0;
+                SendDone = false;
+                SendFillWindow();
             } else {
                 /* Ignore other chars */
             }
@@ -220,8 +359,9 @@ void XModemTick(void) {
         case STATE_RECEIVE_INIT:
             if (RetryTimeout-- == 0) {
                 if (RetryCount-- > 0) {
-                    /* Put out communication request */
-                    TerminalSendChar(BYTE_NAK);
+                    /* Put out communication request, asking for CRC first */
+                    UseCrc = (RetryCount >= RECV_INIT_COUNT - RECV_CRC_COUNT);
+                    TerminalSendChar(UseCrc ? BYTE_CRC : BYTE_NAK);
                 } else {
                     /* Just shut off after some time. */
                     State = STATE_OFF;
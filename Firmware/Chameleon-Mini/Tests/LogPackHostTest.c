@@ -0,0 +1,273 @@
+/* LogPackHostTest.c
+ *
+ * Compression ratio of LogPack() on synthetic reader traffic, built and run
+ * by "make host-test". Every block is decoded again and compared to the
+ * entries it was made of. The ratios include the block header, and the
+ * blocks are 1024 bytes like the stores of LogTick(). The traffic is logged
+ * like Log.c does, in the STANDARD and COMPACT formats, and the systicks of
+ * the STANDARD format are turned into differences like in LogFRAMStore().
+ */
+
+#include "../LogPack.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            Failures++; \
+        } \
+    } while (0)
+
+#define BLOCK_SIZE		1024
+#define BLOCK_HEADER_SIZE	13
+#define BLOCKS_PER_TRACE	16
+
+#define FORMAT_STANDARD		0
+#define FORMAT_COMPACT		1
+
+static unsigned Failures = 0;
+
+static uint8_t Block[BLOCK_SIZE];
+static uint16_t BlockUsed;
+static uint8_t Packed[BLOCK_SIZE];
+static uint16_t PackedUsed;
+static uint8_t Unpacked[BLOCK_SIZE];
+static uint8_t Original[BLOCK_SIZE];
+
+static uint8_t Format;
+static uint16_t SysTick;
+static uint16_t LastSysTick;
+static uint32_t Seed;
+
+/* Totals of the current trace */
+static uint32_t RawBytes;
+static uint32_t StoredBytes;
+
+static uint8_t Random(void) {
+    Seed = Seed * 1103515245 + 12345;
+    return (uint8_t)(Seed >> 16);
+}
+
+static void PackedWrite(const uint8_t *Data, uint8_t ByteCount) {
+    memcpy(&Packed[PackedUsed], Data, ByteCount);
+    PackedUsed += ByteCount;
+}
+
+/* Decoder of chamlog, see lzDecompress() in Log.py */
+static uint16_t Unpack(const uint8_t *Data, uint16_t ByteCount, uint8_t *Output) {
+    uint16_t In = 0;
+    uint16_t Out = 0;
+
+    while (In < ByteCount) {
+        uint8_t Control = Data[In++];
+
+        if (Control < 0x20) {
+            memcpy(&Output[Out], &Data[In], Control + 1);
+            In += Control + 1;
+            Out += Control + 1;
+        } else {
+            uint16_t Length = Control >> 5;
+            uint16_t Ref;
+
+            if (Length == 7)
+                Length += Data[In++];
+
+            Ref = Out - (((Control & 0x1F) << 8) | Data[In++]) - 1;
+
+            for (Length += 2; Length > 0; Length--)
+                Output[Out++] = Output[Ref++];
+        }
+    }
+
+    return Out;
+}
+
+static void StoreBlock(void) {
+    uint16_t Size;
+
+    if (BlockUsed == 0)
+        return;
+
+    /* Like LogFRAMStore() */
+    memcpy(Original, Block, BlockUsed);
+
+    if (Format == FORMAT_STANDARD)
+        LogPackDeltaSysTicks(Block, BlockUsed, 4, true);
+
+    PackedUsed = 0;
+    Size = LogPack(Block, BlockUsed, BlockUsed - 1, PackedWrite);
+
+    if (Size > 0) {
+        CHECK(Size == PackedUsed);
+        CHECK(Unpack(Packed, Size, Unpacked) == BlockUsed);
+
+        if (Format == FORMAT_STANDARD)
+            LogPackDeltaSysTicks(Unpacked, BlockUsed, 4, false);
+
+        CHECK(memcmp(Unpacked, Original, BlockUsed) == 0);
+    } else {
+        /* Stored as it is */
+        Size = BlockUsed;
+    }
+
+    RawBytes += BlockUsed;
+    StoredBytes += BLOCK_HEADER_SIZE + Size;
+    BlockUsed = 0;
+}
+
+/* Same layout as LogEncodeHeader() */
+static uint8_t EncodeHeader(uint8_t *Header, uint8_t Entry, uint8_t Length) {
+    static const uint8_t ShortEntries[] = { 0x40, 0x41, 0x44, 0x47 };
+    uint16_t Delta = SysTick - LastSysTick;
+    uint8_t Size = 0;
+
+    if (Format == FORMAT_STANDARD) {
+        Header[0] = Entry;
+        Header[1] = Length;
+        Header[2] = (uint8_t)(SysTick >> 8);
+        Header[3] = (uint8_t)(SysTick >> 0);
+        return 4;
+    }
+
+    if (Length <= 0x1F) {
+        for (uint8_t i = 0; i < sizeof(ShortEntries); i++) {
+            if (ShortEntries[i] == Entry) {
+                Header[Size++] = 0x80 | (i << 5) | Length;
+                break;
+            }
+        }
+    }
+
+    if (Size == 0) {
+        if (Entry & 0x80)
+            Header[Size++] = 0x01;
+
+        Header[Size++] = Entry;
+        Header[Size++] = Length;
+    }
+
+    do {
+        Header[Size] = Delta & 0x7F;
+        Delta >>= 7;
+
+        if (Delta != 0)
+            Header[Size] |= 0x80;
+
+        Size++;
+    } while (Delta != 0);
+
+    return Size;
+}
+
+static void Log(uint8_t Entry, const uint8_t *Data, uint8_t Length, uint16_t Gap) {
+    uint8_t Header[8];
+    uint8_t HeaderLength;
+
+    SysTick += Gap;
+    HeaderLength = EncodeHeader(Header, Entry, Length);
+
+    if (BlockUsed + HeaderLength + Length > sizeof(Block))
+        StoreBlock();
+
+    memcpy(&Block[BlockUsed], Header, HeaderLength);
+    memcpy(&Block[BlockUsed + HeaderLength], Data, Length);
+    BlockUsed += HeaderLength + Length;
+    LastSysTick = SysTick;
+}
+
+static void LogRandom(uint8_t Entry, uint8_t Length, uint16_t Gap) {
+    uint8_t Data[32];
+
+    for (uint8_t i = 0; i < Length; i++)
+        Data[i] = Random();
+
+    Log(Entry, Data, Length, Gap);
+}
+
+/* Anticollision and select of a MIFARE Classic 1K with a fixed UID */
+static void Select(uint8_t Rx, uint8_t Tx) {
+    static const uint8_t Reqa[] = { 0x26 };
+    static const uint8_t Atqa[] = { 0x04, 0x00 };
+    static const uint8_t Anticoll[] = { 0x93, 0x20 };
+    static const uint8_t Uid[] = { 0xDE, 0xAD, 0xBE, 0xEF, 0x22 };
+    static const uint8_t Sel[] = { 0x93, 0x70, 0xDE, 0xAD, 0xBE, 0xEF, 0x22, 0x5C, 0x1B };
+    static const uint8_t Sak[] = { 0x08, 0xB6, 0xDD };
+
+    Log(Rx, Reqa, sizeof(Reqa), 20 + Random() % 80);
+    Log(Tx, Atqa, sizeof(Atqa), 1);
+    Log(Rx, Anticoll, sizeof(Anticoll), 1 + Random() % 2);
+    Log(Tx, Uid, sizeof(Uid), 1);
+    Log(Rx, Sel, sizeof(Sel), 1 + Random() % 2);
+    Log(Tx, Sak, sizeof(Sak), 1);
+}
+
+/* A reader polling for a card and halting it again */
+static void TracePolling(uint8_t Rx, uint8_t Tx) {
+    static const uint8_t Halt[] = { 0x50, 0x00, 0x57, 0xCD };
+
+    while (RawBytes < BLOCKS_PER_TRACE * BLOCK_SIZE) {
+        Select(Rx, Tx);
+        Log(Rx, Halt, sizeof(Halt), 1 + Random() % 2);
+        Log(0x91, NULL, 0, 0);
+    }
+}
+
+/* Authentication and encrypted reads of a sector, random on the air */
+static void TraceEncrypted(uint8_t Rx, uint8_t Tx) {
+    static const uint8_t Auth[] = { 0x60, 0x04, 0xD1, 0x3D };
+
+    while (RawBytes < BLOCKS_PER_TRACE * BLOCK_SIZE) {
+        Select(Rx, Tx);
+        Log(Rx, Auth, sizeof(Auth), 2);
+        Log(0x90, Auth, 2, 0);
+        LogRandom(Tx, 4, 1);
+        LogRandom(Rx, 8, 2);
+        LogRandom(Tx, 4, 1);
+
+        for (uint8_t i = 0; i < 4; i++) {
+            LogRandom(Rx, 4, 2);
+            LogRandom(Tx, 18, 1);
+        }
+    }
+}
+
+typedef void (*TraceType)(uint8_t Rx, uint8_t Tx);
+
+/* Returns the compression ratio times 100 */
+static unsigned RunTrace(TraceType Trace, uint8_t TraceFormat, uint8_t Rx, uint8_t Tx) {
+    Format = TraceFormat;
+    Seed = 1;
+    SysTick = 0;
+    LastSysTick = 0;
+    BlockUsed = 0;
+    RawBytes = 0;
+    StoredBytes = 0;
+
+    Trace(Rx, Tx);
+    StoreBlock();
+
+    return (unsigned)(RawBytes * 100 / StoredBytes);
+}
+
+static void Report(const char *Name, unsigned Ratio, unsigned MinRatio) {
+    printf("%-28s %u.%02ux\n", Name, Ratio / 100, Ratio % 100);
+    CHECK(Ratio >= MinRatio);
+}
+
+int main(void) {
+    /* The minimum ratios are a bit below the ones seen when they were set */
+    Report("polling STANDARD", RunTrace(TracePolling, FORMAT_STANDARD, 0x40, 0x41), 400);
+    Report("polling COMPACT", RunTrace(TracePolling, FORMAT_COMPACT, 0x40, 0x41), 375);
+    Report("sniffed polling STANDARD", RunTrace(TracePolling, FORMAT_STANDARD, 0x44, 0x46), 400);
+    Report("sniffed polling COMPACT", RunTrace(TracePolling, FORMAT_COMPACT, 0x44, 0x46), 375);
+    Report("encrypted STANDARD", RunTrace(TraceEncrypted, FORMAT_STANDARD, 0x40, 0x41), 100);
+    Report("encrypted COMPACT", RunTrace(TraceEncrypted, FORMAT_COMPACT, 0x40, 0x41), 100);
+
+    printf("%s: %u failures\n", Failures ? "FAILED" : "PASSED", Failures);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
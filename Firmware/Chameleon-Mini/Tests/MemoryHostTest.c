@@ -0,0 +1,185 @@
+/* MemoryHostTest.c
+ *
+ * Smoke test of Memory.c on the host backend, built and run by "make host-test"
+ * for every combination of the memory options. Each run starts from a fresh
+ * memory file, see CHAMELEON_MEMORY_FILE in MemoryBackendHost.c.
+ */
+
+#include "../Memory.h"
+#include "../MemoryBackend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHECK(x) \
+    do { \
+        if (!(x)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #x); \
+            Failures++; \
+        } \
+    } while (0)
+
+static unsigned Failures = 0;
+
+static uint8_t Expected[MEMORY_SIZE_PER_SETTING];
+static uint8_t Buffer[MEMORY_SIZE_PER_SETTING];
+
+static void FillExpected(uint8_t Seed, bool Sparse) {
+    for (uint16_t i = 0; i < sizeof(Expected); i++) {
+        if (Sparse) {
+            /* Mostly cleared like typical card images, compresses well */
+            Expected[i] = (i % 512 < 16) ? (uint8_t)(Seed + i) : 0x00;
+        } else {
+            Expected[i] = (uint8_t)(Seed + i * 7 + (i >> 8));
+        }
+    }
+}
+
+static void WriteExpected(void) {
+    /* Small writes go through the cache, large ones bypass it */
+    MemoryWriteBlock(Expected, 0, 13);
+    MemoryWriteBlock(&Expected[13], 13, sizeof(Expected) - 13);
+}
+
+static bool RecallMatches(void) {
+    /* Scribble over the working copy, then fetch it from flash again */
+    memset(Buffer, 0xA5, sizeof(Buffer));
+    MemoryWriteBlock(Buffer, 0, sizeof(Buffer));
+    MemoryRecall();
+
+    memset(Buffer, 0x00, sizeof(Buffer));
+    MemoryReadBlock(Buffer, 0, 5);
+    MemoryReadBlock(&Buffer[5], 5, sizeof(Buffer) - 5);
+
+    return memcmp(Buffer, Expected, sizeof(Buffer)) == 0;
+}
+
+static void TestStoreRecall(uint8_t SlotIdx, uint8_t Seed, bool Sparse) {
+    MemoryBackendSelectSlot(SlotIdx);
+    MemoryRecall();
+
+    FillExpected(Seed, Sparse);
+    WriteExpected();
+    CHECK(MemoryStore());
+    CHECK(RecallMatches());
+}
+
+static void TestStoreAsync(void) {
+    uint8_t PagesDone, PagesTotal;
+    uint8_t Byte = 0x5A;
+
+    MemoryBackendSelectSlot(0);
+    MemoryRecall();
+
+    FillExpected(0x42, false);
+    WriteExpected();
+    CHECK(MemoryStoreAsync());
+
+    /* Written after the store began, so flash has to keep the old contents */
+    MemoryWriteBlock(&Byte, sizeof(Expected) - 1, 1);
+
+    while (MemoryStoreAsyncProgress(&PagesDone, &PagesTotal)) {
+        MemoryTask();
+    }
+
+    CHECK(PagesDone == PagesTotal);
+    CHECK(RecallMatches());
+}
+
+static void ReadAsyncCallback(void *Buffer, uint16_t ByteCount) {
+    CHECK(ByteCount == 16);
+}
+
+static void TestReadAsync(void) {
+    uint8_t Data[16];
+
+    MemoryBackendSelectSlot(0);
+    MemoryRecall();
+
+    FillExpected(0x33, false);
+    MemoryWriteBlockAsync(Expected, 0, sizeof(Expected));
+    while (MemoryWritePending());
+
+    /* A differently sized miss after the async write */
+    MemoryReadBlockAsync(Data, 256, 6, NULL);
+    while (MemoryReadPending());
+    CHECK(MemoryReadAvailable() == 6);
+
+    /* Brings the lines into the cache, so that the async read is a hit */
+    MemoryReadBlock(Data, 64, sizeof(Data));
+#ifdef MEMORY_CACHE
+    uint32_t Hits = MemoryCacheStats.Hits;
+#endif
+
+    memset(Data, 0x00, sizeof(Data));
+    MemoryReadBlockAsync(Data, 64, sizeof(Data), ReadAsyncCallback);
+    while (MemoryReadPending());
+
+#ifdef MEMORY_CACHE
+    CHECK(MemoryCacheStats.Hits > Hits);
+#endif
+    CHECK(MemoryReadAvailable() == sizeof(Data));
+    CHECK(memcmp(Data, &Expected[64], sizeof(Data)) == 0);
+}
+
+static void TestAllocateDeferred(void) {
+    MemorySlotType Stored;
+
+    MemoryBackendSelectSlot(1);
+    MemoryRecall();
+    Stored = SlotTable()[1];
+
+    CHECK(MemoryAllocateSetting(MEMORY_SIZE_PER_SETTING / 2));
+    CHECK(MemoryGetSettingSize() == MEMORY_SIZE_PER_SETTING / 2);
+
+    /* Nothing has been stored in the new layout, so the table still
+     * describes the flash and recalls its contents */
+    CHECK(memcmp(&SlotTable()[1], &Stored, sizeof(Stored)) == 0);
+
+    MemoryRecall();
+    FillExpected(0x22, true);
+    memset(Buffer, 0x00, sizeof(Buffer));
+    MemoryReadBlock(Buffer, 0, MEMORY_SIZE_PER_SETTING / 2);
+    CHECK(memcmp(Buffer, Expected, MEMORY_SIZE_PER_SETTING / 2) == 0);
+
+    CHECK(MemoryStore());
+    CHECK(SlotTable()[1].Size == MEMORY_SIZE_PER_SETTING / 2);
+
+    /* Back to the full size, the part added starts out cleared */
+    CHECK(MemoryAllocateSetting(MEMORY_SIZE_PER_SETTING));
+    MemoryRecall();
+    CHECK(SlotTable()[1].Size == MEMORY_SIZE_PER_SETTING / 2);
+    MemoryReadBlock(Buffer, MEMORY_SIZE_PER_SETTING / 2, 16);
+    CHECK(Buffer[0] == MEMORY_INIT_VALUE && Buffer[15] == MEMORY_INIT_VALUE);
+
+    CHECK(MemoryStore());
+    CHECK(SlotTable()[1].Size == MEMORY_SIZE_PER_SETTING);
+}
+
+int main(void) {
+    MemoryInit();
+
+    /* A fresh EEPROM holds no slot table, so the fixed layout is used */
+    CHECK(MemoryGetSettingSize() == MEMORY_SIZE_PER_SETTING);
+    CHECK(SlotTable()[1].Offset == MEMORY_SIZE_PER_SETTING);
+
+    TestStoreRecall(0, 0x11, false);
+    TestStoreRecall(1, 0x22, true);
+#ifdef MEMORY_COMPRESSION
+    CHECK(SlotTable()[1].FlashSize < SlotTable()[1].Size);
+#endif
+
+    /* Other slots must be unaffected */
+    MemoryBackendSelectSlot(0);
+    FillExpected(0x11, false);
+    CHECK(RecallMatches());
+
+    TestStoreAsync();
+    TestReadAsync();
+    TestAllocateDeferred();
+
+    printf("%s: %u failures\n", Failures ? "FAILED" : "PASSED", Failures);
+
+    return Failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -5,6 +5,7 @@ import serial.tools.list_ports
 import sys
 import datetime
 import time
+import struct
 import Chameleon
 
 class Device:
@@ -18,8 +19,10 @@ class Device:
     COMMAND_DUMPMFU = "DUMP_MFU"
     COMMAND_CONFIG = "CONFIG"
     COMMAND_LOG_DOWNLOAD = "LOGDOWNLOAD"
+    COMMAND_LOG_INDEX = "LOGINDEX"
     COMMAND_LOG_CLEAR = "LOGCLEAR"
     COMMAND_LOGMODE = "LOGMODE"
+    COMMAND_LOGFORMAT = "LOGFORMAT"
     COMMAND_LBUTTON = "LBUTTON"
     COMMAND_LBUTTONLONG = "LBUTTON_LONG"
     COMMAND_RBUTTON = "RBUTTON"
@@ -29,6 +32,7 @@ class Device:
     COMMAND_THRESHOLD = "THRESHOLD"
     COMMAND_AUTOCALIBRATE = "AUTOCALIBRATE"
     COMMAND_AUTOTHRESHOLD = "AUTOTHRESHOLD"
+    COMMAND_USBBENCH = "USBBENCH"
     COMMAND_UPGRADE = "upgrade"
 
     STATUS_CODE_OK = 100
@@ -39,6 +43,9 @@ class Device:
     STATUS_CODE_UNKNOWN_COMMAND = 200
     STATUS_CODE_UNKNOWN_COMMAND_USAGE = 201
     STATUS_CODE_INVALID_PARAMETER = 202
+    STATUS_CODE_TIMEOUT = 203
+    STATUS_CODE_INVALID_FRAME = 204
+    STATUS_CODE_NO_MEMORY = 205
 
     STATUS_CODES_SUCCESS = [
         STATUS_CODE_OK,
@@ -51,7 +58,9 @@ class Device:
     STATUS_CODES_FAILURE = [
         STATUS_CODE_UNKNOWN_COMMAND,
         STATUS_CODE_UNKNOWN_COMMAND_USAGE,
-        STATUS_CODE_INVALID_PARAMETER
+        STATUS_CODE_INVALID_PARAMETER,
+        STATUS_CODE_INVALID_FRAME,
+        STATUS_CODE_NO_MEMORY
     ]
 
     LINE_ENDING = "\r"
@@ -59,11 +68,19 @@ class Device:
     SET_CHAR = "="
     GET_CHAR = "?"
 
+    FRAME_SOF = 0x02
+    FRAME_ANSWER_FLAG = 0x80
+    FRAME_OP_COMMAND = 0x01
+    FRAME_OP_COMMAND_BINARY = 0x02
+    FRAME_FLAG_HEX_AS_BINARY = 0x40
+    FRAME_WINDOW = 16
+
     def __init__(self, verboseFunc = None):
         self.verboseFunc = verboseFunc
         self.serial = serial.Serial(None, 9600, timeout=5.0)
         self.versionString = ""
         self.supportedConfs = []
+        self.frameId = 0
 
     def verboseLog(self, text):
         if (self.verboseFunc):
@@ -130,8 +147,11 @@ class Device:
         cmdLine = cmd + self.LINE_ENDING
         self.serial.write(cmdLine.encode('ascii'))
 
+        return self.readStatus(cmd)
+
+    def readStatus(self, cmd, prefix=b''):
         # Get status response
-        status = self.serial.readline().decode('ascii').rstrip()
+        status = (prefix + self.serial.readline()).decode('ascii').rstrip()
 
         if (len(status) == 0):
             self.verboseLog("Executing <{}>: Timeout".format(cmd))
@@ -182,6 +202,105 @@ class Device:
 
         return result
 
+    @staticmethod
+    def frameCrc(data):
+        # CRC16 as used by XModem
+        crc = 0
+        for byte in data:
+            crc ^= byte << 8
+            for i in range(8):
+                crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+        return crc
+
+    def writeFrame(self, cmd, param=None, hexAsBinary=False):
+        # Send a command line in a binary frame. A parameter given as bytes
+        # follows the command (including its delimiter) without hex conversion.
+        # Set hexAsBinary only for commands which answer in hex, to get their
+        # answer as bytes.
+        self.frameId = (self.frameId + 1) & 0xFF
+
+        if (param is None):
+            opcode = self.FRAME_OP_COMMAND
+            payload = cmd.encode('ascii')
+        else:
+            opcode = self.FRAME_OP_COMMAND_BINARY
+            payload = bytes([len(cmd)]) + cmd.encode('ascii') + bytes(param)
+
+        if (hexAsBinary):
+            opcode |= self.FRAME_FLAG_HEX_AS_BINARY
+
+        body = struct.pack(">HBB", len(payload), opcode, self.frameId) + payload
+        self.serial.write(bytes([self.FRAME_SOF]) + body + struct.pack(">H", Device.frameCrc(body)))
+
+        return self.frameId
+
+    def readFrame(self):
+        # Skip anything in between frames
+        while True:
+            byte = self.serial.read(1)
+            if (len(byte) == 0):
+                self.verboseLog("Reading frame: Timeout")
+                return None
+            if (byte[0] == self.FRAME_SOF):
+                break
+
+        header = self.serial.read(4)
+        if (len(header) < 4):
+            return None
+
+        length, opcode, frameId = struct.unpack(">HBB", header)
+        rest = self.serial.read(length + 2)
+        if (len(rest) < length + 2 or length == 0):
+            return None
+
+        if (struct.unpack(">H", rest[length:])[0] != Device.frameCrc(header + rest[:length])):
+            self.verboseLog("Reading frame {}: CRC error".format(frameId))
+            return None
+
+        statusCode = rest[0]
+        data = rest[1:length]
+        self.verboseLog("Frame {}: {} ({} bytes)".format(frameId, statusCode, len(data)))
+
+        result = {'id': frameId, 'statusCode': statusCode, 'response': None}
+
+        if (opcode == self.FRAME_ANSWER_FLAG | self.FRAME_OP_COMMAND_BINARY):
+            result['response'] = data
+        elif (len(data) > 0):
+            result['response'] = data.decode('ascii')
+        elif (statusCode == self.STATUS_CODE_TRUE):
+            result['response'] = True
+        elif (statusCode == self.STATUS_CODE_FALSE):
+            result['response'] = False
+
+        return result
+
+    def execFrames(self, cmds):
+        # Pipeline a list of (cmd, param[, hexAsBinary]) tuples, see
+        # writeFrame(). Up to FRAME_WINDOW frames are in flight, results are
+        # returned in order.
+        results = [None] * len(cmds)
+        inFlight = {}
+
+        for index, args in enumerate(cmds):
+            if (len(inFlight) == self.FRAME_WINDOW and not self.collectFrame(results, inFlight)):
+                return results
+
+            inFlight[self.writeFrame(*args)] = index
+
+        while (len(inFlight) > 0 and self.collectFrame(results, inFlight)):
+            pass
+
+        return results
+
+    def collectFrame(self, results, inFlight):
+        result = self.readFrame()
+        if (result is None or result['id'] not in inFlight):
+            return False
+
+        results[inFlight.pop(result['id'])] = result
+        return True
+
     def cmdUploadDump(self, dataStream):
         if (self.execCmd(self.COMMAND_UPLOAD)['statusCode'] == self.STATUS_CODE_WAITING_FOR_XMODEM):
             # XMODEM started
@@ -199,20 +318,75 @@ class Device:
         else:
             return None
 
-    def cmdDownloadLog(self, dataStream):
-        if (self.execCmd(self.COMMAND_LOG_DOWNLOAD)['statusCode'] == self.STATUS_CODE_WAITING_FOR_XMODEM):
+    def cmdDownloadLog(self, dataStream, logRange = None):
+        if (logRange is None):
+            result = self.execCmd(self.COMMAND_LOG_DOWNLOAD)
+        else:
+            result = self.getSetCmd(self.COMMAND_LOG_DOWNLOAD, logRange)
+
+        if (result['statusCode'] == self.STATUS_CODE_WAITING_FOR_XMODEM):
             # XMODEM started
             xmodem = Chameleon.XModem(self.serial, self.verboseFunc)
             return xmodem.recvData(dataStream)
         else:
             return None
 
+    @staticmethod
+    def usbBenchPattern(byteCount):
+        # Same pattern as the firmware, it does not repeat every 256 bytes
+        return bytes([(i + (i >> 8)) & 0xFF for i in range(byteCount)])
+
+    def cmdUsbBench(self, byteCount):
+        pattern = Device.usbBenchPattern(byteCount)
+        cmdLine = "{}{}{}".format(self.COMMAND_USBBENCH, self.SET_CHAR, byteCount) + self.LINE_ENDING
+
+        # Allow for at least 10 kB/s
+        self.serial.timeout = 5.0 + byteCount / 10000
+
+        # The pattern comes first, then we send it back and get the status
+        startTime = time.time()
+        self.serial.write(cmdLine.encode('ascii'))
+        data = self.serial.read(1)
+
+        if (data != pattern[:1]):
+            # Status line instead of the pattern
+            self.serial.timeout = 5.0
+            return self.readStatus(cmdLine.rstrip(), data)
+
+        data += self.serial.read(byteCount - 1)
+        inTime = time.time() - startTime
+
+        if (len(data) < byteCount):
+            # Timed out, the firmware no longer waits for the pattern
+            self.serial.timeout = 5.0
+            self.verboseLog("Executing <{}>: Timeout after {} bytes".format(cmdLine.rstrip(), len(data)))
+            return None
+
+        startTime = time.time()
+        self.serial.write(pattern)
+        result = self.readStatus(cmdLine.rstrip())
+        outTime = time.time() - startTime
+        self.serial.timeout = 5.0
+
+        if (result is not None):
+            result['inRate'] = len(data) / inTime
+            result['outRate'] = byteCount / outTime
+            result['inErrors'] = sum(1 for a, b in zip(data, pattern) if a != b) + byteCount - len(data)
+
+        return result
+
+    def cmdLogIndex(self):
+        return self.getSetCmd(self.COMMAND_LOG_INDEX)
+
     def cmdClearLog(self):
         return self.execCmd(self.COMMAND_LOG_CLEAR)
 
     def cmdLogMode(self, newLogMode):
         return self.getSetCmd(self.COMMAND_LOGMODE, newLogMode)
 
+    def cmdLogFormat(self, newLogFormat = None):
+        return self.getSetCmd(self.COMMAND_LOGFORMAT, newLogFormat)
+
     def cmdVersion(self):
         return self.getSetCmd(self.COMMAND_VERSION)
 
@@ -1,5 +1,6 @@
 #!/usr/bin/python
 
+import io
 import struct
 import binascii
 import math
@@ -54,12 +55,70 @@ def binaryParityDecoder(data):
     else:
         return binascii.hexlify(checkedData).decode()+"!"
 
+LOG_FORMAT_EVENT = 0x14
+LOG_STATS_EVENT = 0x15
+LOG_TIME_EVENT = 0x16
+LOG_FORMAT_VERSION = 1
+LOG_FORMAT_STANDARD = 0x00
+LOG_FORMAT_COMPACT = 0x01
+LOG_FORMAT_TIMESTAMP = 0x02
+
+logFormats = {
+    'STANDARD': LOG_FORMAT_STANDARD,
+    'COMPACT': LOG_FORMAT_COMPACT,
+    'TIMESTAMP': LOG_FORMAT_TIMESTAMP,
+}
+
+# Timestamp format: frame timestamps in carrier cycles
+CARRIER_FREQ = 13560000
+FRAME_TIMESTAMP_MAX = 1 << 32
+FRAME_TIMESTAMP_INVALID = 0xFFFFFFFF
+
+# Compressed log: blocks of entries after the LOG FORMAT entry of a download
+LOG_FORMAT_COMPRESSED = 0x80
+BLOCK_LZ = 0x01
+BLOCK_STORED = 0x02
+BLOCK_HEADER = '>BHHHIH'
+
+# Compact format: events with a single byte header
+COMPACT_SHORT_FLAG = 0x80
+COMPACT_SHORT_MAX_LENGTH = 0x1F
+COMPACT_ESCAPE = 0x01
+compactShortEvents = [ 0x40, 0x41, 0x44, 0x47 ]
+
+def logFormatDecoder(data):
+    if (len(data) < 2):
+        return binaryDecoder(data)
+
+    names = { value: key for key, value in logFormats.items() }
+    name = names.get(data[1] & ~LOG_FORMAT_COMPRESSED, 'UNKNOWN {}'.format(data[1]))
+
+    if (data[1] & LOG_FORMAT_COMPRESSED):
+        name += ' COMPRESSED'
+
+    return name
+
+def statsDecoder(data):
+    if (len(data) < 8):
+        return binaryDecoder(data)
+
+    return 'produced {}, dropped {}, flushed {}, peak {} bytes'.format(*struct.unpack_from('>HHHH', data))
+
+def logTimeDecoder(data):
+    if (len(data) < 4):
+        return binaryDecoder(data)
+
+    return '{} ms'.format(*struct.unpack_from('>I', data))
+
 eventTypes = {
     0x00: { 'name': 'EMPTY',          'decoder': noDecoder },
     0x10: { 'name': 'GENERIC',        'decoder': textDecoder },
     0x11: { 'name': 'CONFIG SET',     'decoder': textDecoder },
     0x12: { 'name': 'SETTING SET',    'decoder': textDecoder },
     0x13: { 'name': 'UID SET',        'decoder': binaryDecoder },
+    0x14: { 'name': 'LOG FORMAT',     'decoder': logFormatDecoder },
+    0x15: { 'name': 'STATS',          'decoder': statsDecoder },
+    0x16: { 'name': 'LOG TIME',       'decoder': logTimeDecoder },
     0x20: { 'name': 'RESET APP',      'decoder': noDecoder },
 
     0x40: { 'name': 'CODEC RX',       'decoder': binaryDecoder },
@@ -118,69 +177,336 @@ eventTypes = {
 }
 
 TIMESTAMP_MAX = 65536
+SEQUENCE_MAX = 65536
 eventTypes = { i : ({'name': f'UNKNOWN {hex(i)}', 'decoder': binaryDecoder} if i not in eventTypes.keys() else eventTypes[i]) for i in range(256) }
 
-def parseBinary(binaryStream, decoder=None):
-    log = []
-    
-    # Completely read file contents and process them byte by byte
-    # logFile = fileHandle.read()
-    # fileIdx = 0
-    lastTimestamp = 0
-    
+def lzDecompress(data):
+    # LZF: control bytes below 0x20 start literals, the others back references
+    output = bytearray()
+    i = 0
+
+    while i < len(data):
+        control = data[i]
+        i += 1
+
+        if (control < 0x20):
+            output += data[i:i + control + 1]
+            i += control + 1
+        else:
+            length = control >> 5
+
+            if (length == 7):
+                length += data[i]
+                i += 1
+
+            ref = len(output) - ((control & 0x1F) << 8) - data[i] - 1
+            i += 1
+
+            for k in range(length + 2):
+                output.append(output[ref + k])
+
+    return bytes(output)
+
+def undeltaSysTicks(data, logFormat):
+    # LZ blocks in the standard and timestamp formats hold the systick of every
+    # entry but the first as difference to the entry before
+    if (logFormat == LOG_FORMAT_COMPACT):
+        return data
+
+    headerSize = 8 if (logFormat == LOG_FORMAT_TIMESTAMP) else 4
+    output = bytearray(data)
+    lastTimestamp = None
+    i = 0
+
+    while (i + headerSize <= len(output)):
+        if (output[i] == 0x00):
+            # EMPTY event
+            i += 1
+            continue
+
+        (value,) = struct.unpack_from('>H', output, i + 2)
+
+        if (lastTimestamp is not None):
+            value = (lastTimestamp + value) % TIMESTAMP_MAX
+            struct.pack_into('>H', output, i + 2, value)
+
+        lastTimestamp = value
+        i += headerSize + output[i + 1]
+
+    return bytes(output)
+
+class BlockStream:
+    # Reads the entries of a compressed log, one block at a time
+    def __init__(self, binaryStream, logFormat):
+        self.binaryStream = binaryStream
+        self.logFormat = logFormat
+        self.buffer = b''
+
+    def nextBlock(self):
+        header = self.binaryStream.read(struct.calcsize(BLOCK_HEADER))
+
+        if (header is None or len(header) < struct.calcsize(BLOCK_HEADER)):
+            return False
+
+        (blockType, size, rawSize, entries, logTime, sysTick) = struct.unpack_from(BLOCK_HEADER, header)
+        data = self.binaryStream.read(size)
+
+        if (blockType == BLOCK_LZ):
+            data = undeltaSysTicks(lzDecompress(data)[:rawSize], self.logFormat)
+        elif (blockType != BLOCK_STORED):
+            # Padding after the last block
+            return False
+
+        self.buffer += data[:rawSize]
+        return True
+
+    def read(self, size):
+        while (len(self.buffer) < size and self.nextBlock()):
+            pass
+
+        data = self.buffer[:size]
+        self.buffer = self.buffer[size:]
+        return data
+
+def readVarint(binaryStream):
+    value = 0
+    shift = 0
+
     while True:
-        # Read log entry header from file
-        header = binaryStream.read(struct.calcsize('<BBH'))
+        byte = binaryStream.read(1)
 
-        if (header is None):
-            # No more data available
-            break
+        if (byte is None or len(byte) < 1):
+            return None
 
-        if (len(header) < struct.calcsize('<BBH')):
-            # No more data available
-            break
-        
-        (event, dataLength, timestamp) = struct.unpack_from('>BBH', header)
-    
-        # Break if there are no more events
-        if (eventTypes[event]['name'] == 'EMPTY'):
-            break
+        value |= (byte[0] & 0x7F) << shift
+        shift += 7
+
+        if (not byte[0] & 0x80):
+            return value
+
+def readHeader(binaryStream, logFormat, lastTimestamp):
+    # Returns (event, dataLength, timestamp, frameTimestamp) or None at the end of the log
+    lead = binaryStream.read(1)
+
+    if (lead is None or len(lead) < 1 or lead[0] == 0x00):
+        # No more data available or EMPTY event
+        return None
+
+    lead = lead[0]
+
+    if (logFormat == LOG_FORMAT_STANDARD):
+        header = binaryStream.read(struct.calcsize('>BH'))
 
-        # Read data from file
-        logData = binaryStream.read(dataLength)
+        if (header is None or len(header) < struct.calcsize('>BH')):
+            return None
+
+        (dataLength, timestamp) = struct.unpack_from('>BH', header)
+        return (lead, dataLength, timestamp, None)
+
+    if (logFormat == LOG_FORMAT_TIMESTAMP):
+        header = binaryStream.read(struct.calcsize('>BHI'))
+
+        if (header is None or len(header) < struct.calcsize('>BHI')):
+            return None
+
+        (dataLength, timestamp, frameTimestamp) = struct.unpack_from('>BHI', header)
+
+        if (frameTimestamp == FRAME_TIMESTAMP_INVALID):
+            frameTimestamp = None
+
+        return (lead, dataLength, timestamp, frameTimestamp)
+
+    if (lead & COMPACT_SHORT_FLAG):
+        event = compactShortEvents[(lead >> 5) & 0x03]
+        dataLength = lead & COMPACT_SHORT_MAX_LENGTH
+    else:
+        if (lead == COMPACT_ESCAPE):
+            header = binaryStream.read(2)
+        else:
+            header = bytes([lead]) + binaryStream.read(1)
+
+        if (header is None or len(header) < 2):
+            return None
+
+        (event, dataLength) = struct.unpack_from('>BB', header)
+
+    delta = readVarint(binaryStream)
+
+    if (delta is None):
+        return None
+
+    return (event, dataLength, (lastTimestamp + delta) % TIMESTAMP_MAX, None)
+
+def readEntry(binaryStream, logFormat, lastTimestamp, sequenced):
+    # Returns (sequence, event, dataLength, timestamp, frameTimestamp, data) or None
+    # if the entry is not complete
+    sequence = None
+
+    if (sequenced):
+        header = binaryStream.read(2)
+
+        if (header is None or len(header) < 2):
+            return None
+
+        (sequence,) = struct.unpack_from('>H', header)
+
+    header = readHeader(binaryStream, logFormat, lastTimestamp)
+
+    if (header is None):
+        return None
+
+    (event, dataLength, timestamp, frameTimestamp) = header
+    logData = binaryStream.read(dataLength)
+
+    if (logData is None or len(logData) < dataLength):
+        return None
+
+    return (sequence, event, dataLength, timestamp, frameTimestamp, logData)
+
+class LogParser:
+    # Decodes entries one by one, keeping the state which carries over from one
+    # entry to the next. Live entries are preceded by a sequence number.
+    def __init__(self, decoder=None, logFormat=LOG_FORMAT_STANDARD, sequenced=False):
+        self.decoder = decoder
+        self.logFormat = logFormat
+        self.sequenced = sequenced
+        self.compressed = False
+        self.lastTimestamp = 0
+        self.lastFrameTimestamp = None
+        self.nextSequence = None
+        # Entries of a range download before the requested one
+        self.skip = 0
+
+    def parseEntry(self, binaryStream):
+        # Returns the next entry, or None without changing any state if there is none
+        entry = readEntry(binaryStream, self.logFormat, self.lastTimestamp, self.sequenced)
+
+        if (entry is None):
+            return None
+
+        (sequence, event, dataLength, timestamp, frameTimestamp, logData) = entry
+
+        if (event == LOG_FORMAT_EVENT):
+            # Following entries are encoded in the given format. The header of
+            # a download is in the standard format and carries no timestamp.
+            if (self.logFormat == LOG_FORMAT_STANDARD):
+                timestamp = self.lastTimestamp
+
+            if (len(logData) >= 2 and logData[0] == LOG_FORMAT_VERSION):
+                self.logFormat = logData[1] & ~LOG_FORMAT_COMPRESSED
+                self.compressed = bool(logData[1] & LOG_FORMAT_COMPRESSED)
+
+            if (len(logData) >= 4):
+                (self.skip,) = struct.unpack_from('>H', logData, 2)
+
+            if (sequence == 0):
+                # Live logging has been (re)started
+                self.nextSequence = None
+
+        # Entries the device had to drop show up as a gap in the sequence numbers
+        lost = 0
+        if (sequence is not None):
+            if (self.nextSequence is not None):
+                lost = (sequence - self.nextSequence) % SEQUENCE_MAX
+            self.nextSequence = (sequence + 1) % SEQUENCE_MAX
 
         # Decode data
         logData = eventTypes[event]['decoder'](logData)
         
         # Calculate delta timestamp respecting 16 bit overflow
-        deltaTimestamp = timestamp - lastTimestamp
-        lastTimestamp = timestamp
+        deltaTimestamp = timestamp - self.lastTimestamp
+        self.lastTimestamp = timestamp
         
         if (deltaTimestamp < 0):
             deltaTimestamp += TIMESTAMP_MAX
 
+        # Gap to the previous frame timestamp in microseconds, respecting 32 bit overflow
+        frameGap = None
+        if (frameTimestamp is not None):
+            if (self.lastFrameTimestamp is not None):
+                frameGap = ((frameTimestamp - self.lastFrameTimestamp) % FRAME_TIMESTAMP_MAX) * 1e6 / CARRIER_FREQ
+            self.lastFrameTimestamp = frameTimestamp
+
         note = ""
         # If we need to decode the data and paritybit check success
-        if (decoder!=None and len(logData) >0 and logData[-1] != '!'):
+        if (self.decoder!=None and len(logData) >0 and logData[-1] != '!'):
             # Decode the data from Reader
             if(event == 0x44 or event == 0x45):
-                note = iso14443_3.parseReader(binascii.a2b_hex(logData), decoder)
+                note = iso14443_3.parseReader(binascii.a2b_hex(logData), self.decoder)
             elif (event == 0x46 or event == 0x47):
-                note = iso14443_3.parseCard(binascii.a2b_hex(logData), decoder)
+                note = iso14443_3.parseCard(binascii.a2b_hex(logData), self.decoder)
 
-        # Create log entry as dict and append it to event list
+        # Create log entry as dict
         logEntry = {
             'eventName': eventTypes[event]['name'],
             'dataLength': dataLength,
             'timestamp': timestamp,
             'deltaTimestamp': deltaTimestamp,
+            'frameTimestamp': frameTimestamp,
+            'frameGap': frameGap,
             'data': logData,
             'note': note
         }
-        
+
+        if (sequence is not None):
+            logEntry['sequence'] = sequence
+            logEntry['lost'] = lost
+
+        return logEntry
+
+def parseBinary(binaryStream, decoder=None, logFormat=LOG_FORMAT_STANDARD, sequenced=False, count=None):
+    # A download starts with a header up to its LOG FORMAT entry. A range download
+    # may hold entries before and after the requested ones, which share their
+    # blocks with them. Those before are skipped, count limits those after.
+    parser = LogParser(decoder, logFormat, sequenced)
+    log = []
+    header = True
+    
+    while True:
+        logEntry = parser.parseEntry(binaryStream)
+
+        if (logEntry is None):
+            # No more data available
+            break
+
+        if (parser.compressed and not isinstance(binaryStream, BlockStream)):
+            binaryStream = BlockStream(binaryStream, parser.logFormat)
+
+        if (header):
+            header = (logEntry['eventName'] != eventTypes[LOG_FORMAT_EVENT]['name'])
+        elif (parser.skip > 0):
+            parser.skip -= 1
+            continue
+        elif (count is not None):
+            if (count == 0):
+                break
+
+            count -= 1
+
         log.append(logEntry)
 
     return log
 
+class LiveLog:
+    # Parses the live log stream as it arrives. An entry may be split across
+    # reads, so incomplete data is kept until the rest of it arrives.
+    def __init__(self, decoder=None, logFormat=LOG_FORMAT_STANDARD):
+        self.parser = LogParser(decoder, logFormat, sequenced=True)
+        self.buffer = b''
 
-        
+    def feed(self, data):
+        stream = io.BytesIO(self.buffer + data)
+        log = []
+
+        while True:
+            start = stream.tell()
+            logEntry = self.parser.parseEntry(stream)
+
+            if (logEntry is None):
+                stream.seek(start)
+                break
+
+            log.append(logEntry)
+
+        self.buffer = stream.read()
+        return log
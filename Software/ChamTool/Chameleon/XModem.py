@@ -2,17 +2,31 @@
 #
 # Very lightweight implementation of XModem for Chameleon purposes
 # Because the Chameleon uses a CDC over USB, we don't expect any
-# retransmissions at all and thus don't implement it
+# retransmissions at all and thus only resend on NAK
+#
+# Besides classic XModem, XModem-1K with CRC16 is used when the other side
+# asks for it with 'C'. Receiving, we ask with 'W' instead, with which the
+# Chameleon keeps sending a few blocks ahead of our ACKs. Older firmware does
+# not answer either, then we fall back to NAK.
 
 import io
 import time
 
 class XModem:
     BYTE_SOH = b'\x01'
+    BYTE_STX = b'\x02'
     BYTE_NAK = b'\x15'
     BYTE_ACK = b'\x06'
     BYTE_EOT = b'\x04'
-    
+    BYTE_CAN = b'\x18'
+    BYTE_CRC = b'C'
+    BYTE_WINDOW = b'W'
+
+    BLOCK_SIZE = 128
+    BLOCK_SIZE_1K = 1024
+    START_TIMEOUT = 1.0
+    MAX_RETRIES = 10
+
     def __init__(self, ioStream, verboseFunc = None):
         self.ioStream = ioStream
         self.verboseFunc = verboseFunc
@@ -20,39 +34,74 @@ class XModem:
     def verboseLog(self, text):
         if (self.verboseFunc):
             self.verboseFunc(text)
-            
-    def recvData(self, dataStream):
+
+    @staticmethod
+    def calcCrc(data):
+        crc = 0
+        for byte in data:
+            crc ^= byte << 8
+            for i in range(8):
+                crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+        return crc
+
+    def startReception(self, window):
+        # Ask for CRC and 1K blocks first, classic XModem otherwise
+        timeout = self.ioStream.timeout
+        self.ioStream.timeout = self.START_TIMEOUT
+        self.ioStream.write(self.BYTE_WINDOW if window else self.BYTE_CRC)
+        pktId = self.ioStream.read(1)
+        self.ioStream.timeout = timeout
+
+        if (len(pktId) > 0):
+            return pktId, True
+
+        self.verboseLog("No answer to CRC request, falling back to checksum")
+        self.ioStream.write(self.BYTE_NAK)
+        return self.ioStream.read(1), False
+
+    def recvData(self, dataStream, window = True):
         packetCounter = 1
         bytesReceived = 0
         startTime = time.time()
-        
+
         self.verboseLog("Starting XMODEM Reception")
-            
-        # Start transmission by issuing a NAK
-        self.ioStream.write(self.BYTE_NAK)
-        
-        while True:
-            pktId = self.ioStream.read(1)
 
-            if (pktId == self.BYTE_SOH):
+        pktId, useCrc = self.startReception(window)
+
+        while True:
+            if (pktId == self.BYTE_SOH or pktId == self.BYTE_STX):
+                blockSize = self.BLOCK_SIZE_1K if (pktId == self.BYTE_STX) else self.BLOCK_SIZE
                 currentPacket = self.ioStream.read(2)
+                dataBlock = self.ioStream.read(blockSize)
+                checksum = self.ioStream.read(2 if useCrc else 1)
 
-                if (currentPacket[0] == (255 - currentPacket[1])):
-                    #frame number intact
-                    if (currentPacket[0] == packetCounter):
-                        #In order packet
-                        dataBlock = self.ioStream.read(128)
-                        checksum = self.ioStream.read(1)
-                        
-                        if (int(checksum[0]) == (sum(dataBlock) % 256)):
-                            # checksum correct
-                            dataStream.write(dataBlock)
-                            dataStream.flush()
-                            packetCounter = (packetCounter + 1) % 256
-                            bytesReceived += 128
-                            self.ioStream.write(self.BYTE_ACK)
-                        else:
-                            self.ioStream.write(self.BYTE_NAK)
+                if (useCrc):
+                    valid = (int.from_bytes(checksum, 'big') == XModem.calcCrc(dataBlock))
+                else:
+                    valid = (len(checksum) == 1 and int(checksum[0]) == (sum(dataBlock) % 256))
+
+                if (len(currentPacket) < 2 or currentPacket[0] != (255 - currentPacket[1])):
+                    # frame number damaged
+                    self.ioStream.write(self.BYTE_NAK)
+                elif (currentPacket[0] == packetCounter):
+                    #In order packet
+                    if (valid and len(dataBlock) == blockSize):
+                        # checksum correct
+                        dataStream.write(dataBlock)
+                        dataStream.flush()
+                        packetCounter = (packetCounter + 1) % 256
+                        bytesReceived += blockSize
+                        self.ioStream.write(self.BYTE_ACK)
+                    else:
+                        # The sender goes back to this packet
+                        self.ioStream.write(self.BYTE_NAK)
+                elif (currentPacket[0] == (packetCounter - 1) % 256 and not window):
+                    # Retransmission
+                    self.ioStream.write(self.BYTE_ACK)
+                else:
+                    # Sent ahead before our NAK, it comes again
+                    pass
             elif (pktId == self.BYTE_EOT):
                 # Transmission done
                 self.ioStream.write(self.BYTE_ACK)
@@ -61,53 +110,71 @@ class XModem:
                 # Unknown pktId
                 break
 
+            pktId = self.ioStream.read(1)
+
         deltaTime = time.time() - startTime
         self.verboseLog("{} Bytes received in {:.2f} sec. ({:.0f} B/s)".format(bytesReceived, deltaTime, bytesReceived/deltaTime))
-                
+
         return bytesReceived
-       
+
     def sendData(self, dataStream):
         packetCounter = 1
         bytesSent = 0
         startTime = time.time()
-        
+
         self.verboseLog("Waiting for XMODEM Connection")
-        
-        # Wait for NAK from receiver to start transmission
-        if (self.ioStream.read(1) != self.BYTE_NAK):
+
+        # Wait for NAK or CRC request from receiver to start transmission
+        request = self.ioStream.read(1)
+        if (request == self.BYTE_NAK):
+            useCrc = False
+        elif (request == self.BYTE_CRC):
+            useCrc = True
+        else:
             # Timeout or different char received
             return None
 
-        lastBlock = False
-        while True:
-            dataBlock = dataStream.read(128)
+        data = dataStream.read()
+        while (bytesSent < len(data)):
+            # 1K blocks as long as they are full, the rest in small ones
+            if (useCrc and len(data) - bytesSent >= self.BLOCK_SIZE_1K):
+                pktId, blockSize = self.BYTE_STX, self.BLOCK_SIZE_1K
+            else:
+                pktId, blockSize = self.BYTE_SOH, self.BLOCK_SIZE
 
-            if (len(dataBlock) < 128):
-                lastBlock = True
-            if (0 < len(dataBlock) < 128):
+            dataBlock = data[bytesSent:bytesSent + blockSize]
+            if (len(dataBlock) < blockSize):
                 # Last part smaller than xmodem block -> pad it
-                dataBlock += b'\x00' * (128 - len(dataBlock))
-            if (len(dataBlock) == 128):
-                # Write SOH, pktId, data and checksum
-                self.ioStream.write(self.BYTE_SOH)
-                self.ioStream.write(bytes([packetCounter]))
-                self.ioStream.write(bytes([255 - packetCounter]))
-                self.ioStream.write(dataBlock)
-                self.ioStream.write(bytes([sum(dataBlock) % 256]))
-
-                if (self.ioStream.read(1) == self.BYTE_ACK):
-                    #Proceed to next packet
-                    packetCounter = (packetCounter + 1) % 256
-                    bytesSent += 128
-            if lastBlock:
-                # Write EOT and wait for ACK
-                self.ioStream.write(self.BYTE_EOT)
-                self.ioStream.read(1)
-                break
+                dataBlock += b'\x00' * (blockSize - len(dataBlock))
+
+            if (useCrc):
+                checksum = XModem.calcCrc(dataBlock).to_bytes(2, 'big')
+            else:
+                checksum = bytes([sum(dataBlock) % 256])
+
+            for retry in range(self.MAX_RETRIES):
+                # Write SOH/STX, pktId, data and checksum
+                self.ioStream.write(pktId + bytes([packetCounter, 255 - packetCounter]) + dataBlock + checksum)
+                response = self.ioStream.read(1)
+                while (response == self.BYTE_CRC):
+                    # Further requests sent before our first block arrived
+                    response = self.ioStream.read(1)
+                if (response != self.BYTE_NAK):
+                    break
+
+            if (response != self.BYTE_ACK):
+                self.verboseLog("Transmission failed")
+                return None
+
+            #Proceed to next packet
+            packetCounter = (packetCounter + 1) % 256
+            bytesSent += len(dataBlock)
+
+        # Write EOT and wait for ACK
+        self.ioStream.write(self.BYTE_EOT)
+        self.ioStream.read(1)
 
         deltaTime = time.time() - startTime
         self.verboseLog("{} Bytes sent in {:.2f} sec. ({:.0f} B/s)".format(bytesSent, deltaTime, bytesSent/deltaTime))
-        
-        return bytesSent
-            
 
+        return bytesSent
@@ -11,6 +11,7 @@ import json
 import Chameleon
 import io
 import datetime
+import time
 from Chameleon.ISO14443 import CardTypesMap
 
 def verboseLog(text):
@@ -19,14 +20,26 @@ def verboseLog(text):
     print(formatString.format(timeString, text), file=sys.stderr)
 	
 def formatText(log):
-    formatString  = '{timestamp:0>5d} ms <{deltaTimestamp:>+6d} ms>:'
+    formatString  = '{timestamp:0>5d} ms <{deltaTimestamp:>+6d} ms>:{gap}'
     formatString += '{eventName:<28} ({dataLength:<3} bytes) [{data:<20}] ' \
                     '\033[94m {note} \x1b[0m \n'
 
     text = ''
 
     for logEntry in log:
-        text += formatString.format(**logEntry)
+        # Gap between frames from the high resolution timestamps of LOGFORMAT=TIMESTAMP
+        if (logEntry.get('frameGap') is not None):
+            gap = ' <{:>+12.1f} us>:'.format(logEntry['frameGap'])
+        elif (logEntry.get('frameTimestamp') is not None):
+            gap = ' <{:>15}>:'.format('')
+        else:
+            gap = ''
+
+        # Gaps in the sequence numbers of live entries are entries the Chameleon had to drop
+        if (logEntry.get('lost', 0) > 0):
+            text += '--- {} entries lost ---\n'.format(logEntry['lost'])
+
+        text += formatString.format(gap=gap, **logEntry)
 
     return text
 
@@ -53,6 +66,8 @@ def main():
     argParser.add_argument("-l", "--live", dest="live", action='store_true', help="Use live logging capabilities of Chameleon")
     argParser.add_argument("-c", "--clear", dest="clear", action='store_true', help="Clear Chameleon's log memory when using -p")
     argParser.add_argument("-m", "--mode", dest="mode", metavar="LOGMODE", help="Additionally set Chameleon's log mode after reading it's memory")
+    argParser.add_argument("-r", "--range", dest="range", metavar="FROM[,TO]", help="Only download the entries numbered FROM up to TO, or logged in this range of ms with T in front, e.g. T5000,9000")
+    argParser.add_argument("-F", "--follow", dest="follow", action='store_true', help="Keep downloading the entries logged since the previous download, e.g. in log mode STREAM")
     argParser.add_argument("-v", "--verbose", dest="verbose", action='store_true', default=0)
 
     args = argParser.parse_args()
@@ -69,15 +84,52 @@ def main():
             chameleon = Chameleon.Device(verboseFunc)
 
             if (chameleon.connect(args.port)):
+                logFormat = chameleon.cmdLogFormat()['response']
+                logFormat = Chameleon.Log.logFormats.get(logFormat, Chameleon.Log.LOG_FORMAT_STANDARD)
+                liveLog = Chameleon.Log.LiveLog(args.decode, logFormat)
                 chameleon.cmdLogMode("LIVE")
 
                 while True:
-                    stream = io.BytesIO(chameleon.read())
-                    log = Chameleon.Log.parseBinary(stream, args.decode)
+                    # Format changes announced in the stream are followed by the parser
+                    log = liveLog.feed(chameleon.read())
                     if (len(log) > 0):
                         print(outputTypes[args.type](log))
+
       
+    elif (args.follow):
+        # Streaming download of the FRAM log while it is being written
+        if (args.port is not None):
+            chameleon = Chameleon.Device(verboseFunc)
+
+            if (chameleon.connect(args.port)):
+                if (args.mode is not None):
+                    chameleon.cmdLogMode(args.mode)
+
+                # LOGINDEX? returns the first, end entry, first and last time
+                nextEntry = int(chameleon.cmdLogIndex()['response'].split(',')[1])
+
+                while True:
+                    time.sleep(1)
+                    endEntry = int(chameleon.cmdLogIndex()['response'].split(',')[1])
+
+                    if (endEntry == nextEntry):
+                        continue
+
+                    handle = io.BytesIO()
+                    chameleon.cmdDownloadLog(handle, '{},{}'.format(nextEntry, endEntry))
+                    handle.seek(0)
+
+                    log = Chameleon.Log.parseBinary(handle, args.decode, count=endEntry - nextEntry)
+                    nextEntry = endEntry
+
+                    # Leave out the header of each download, up to its LOG FORMAT entry
+                    header = next((i for (i, logEntry) in enumerate(log) if logEntry['eventName'] == 'LOG FORMAT'), -1)
+                    log = log[header + 1:]
+                    print(outputTypes[args.type](log))
+
     else:
+        count = None
+
         if (args.logfile is not None):
             handle = open(args.logfile, "rb")
         elif (args.port is not None):
@@ -85,8 +137,13 @@ def main():
 
             if (chameleon.connect(args.port)):
                 handle = io.BytesIO()
-                chameleon.cmdDownloadLog(handle)
+                chameleon.cmdDownloadLog(handle, args.range)
                 handle.seek(0)
+
+                # The blocks holding a range of entries may hold more of them
+                if (args.range is not None and not args.range.startswith('T') and ',' in args.range):
+                    (first, end) = args.range.split(',', 1)
+                    count = max(int(end) - int(first), 0)
                 
                 if (args.clear):
                     chameleon.cmdClearLog()
@@ -99,7 +156,7 @@ def main():
                 sys.exit(2)
                 
         # Parse actual logfile
-        log = Chameleon.Log.parseBinary(handle, args.decode)
+        log = Chameleon.Log.parseBinary(handle, args.decode, count=count)
 
         # Print to console using chosen output type
         print(outputTypes[args.type](log))
@@ -200,6 +200,14 @@ def cmdAutoThreshold(chameleon, arg):
         else:
             return "Setting Autothreshold failed: {}".format(arg, result['statusText'])
           
+def cmdUsbBench(chameleon, arg):
+    result = chameleon.cmdUsbBench(arg)
+
+    if (result is None or result['statusCode'] not in chameleon.STATUS_CODES_SUCCESS):
+        return "USB benchmark failed: {}".format(result['statusText'] if result else "Timeout")
+    else:
+        return "IN {:.0f} B/s with {} errors, OUT {:.0f} B/s (device: {})".format(result['inRate'], result['inErrors'], result['outRate'], result['response'])
+
 def cmdUpgrade(chameleon, arg):
     if(chameleon.cmdUpgrade() == 0):
         print ("Device changed into Upgrade Mode")
@@ -248,6 +256,7 @@ def main():
     cmdArgGroup.add_argument("-th",  "--threshold",  dest="threshold",   action=CmdListAction, nargs='?', help="retrieve or set the threshold")
     cmdArgGroup.add_argument("-ac",  "--autocalibrate",  dest="auto_calib",   action=CmdListAction, nargs=0, help="Send AutoCalibration command")
     cmdArgGroup.add_argument("-at",  "--autothreshold",  dest="auto_thres",   action=CmdListAction, metavar="0/1", nargs='?', help="DIS-/ENABLES Autothreshold for SniffIso15693 Codec")
+    cmdArgGroup.add_argument("-ub",  "--usbbench",   dest="usbbench",    action=CmdListAction, metavar="BYTES", nargs='?', type=int, const=65536, help="measure the USB throughput in both directions, 65536 bytes by default")
     cmdArgGroup.add_argument("-ug",  "--upgrade",    dest="upgrade",     action=CmdListAction, nargs=0,   help="set the micro Controller to upgrade mode")
 
     args = argParser.parse_args()
@@ -284,6 +293,7 @@ def main():
                 "threshold" : cmdThreshold,
                 "auto_calib": cmdAutoCalibrate,
                 "auto_thres": cmdAutoThreshold,
+                "usbbench"  : cmdUsbBench,
                 "upgrade"   : cmdUpgrade,
             }
 